@@ -41,7 +41,7 @@
 #define _CREATEEDGES_TASK_H_
 
 //#include "common.h"
-#include "SPPM_Integrators/SAH_InPlace_KD_par.h"
+#include "SPPM_Integrators/SPPM_Pixel.h"
 
 //using namespace pbrt;
 
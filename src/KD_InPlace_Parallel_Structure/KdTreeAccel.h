@@ -46,7 +46,7 @@
 #include "SplitMemo.h"
 #include "SAH.h"
 #include "KdTreeNode_inplace.h"
-#include "SPPM_Integrators/SAH_InPlace_KD_par.h"
+#include "SPPM_Integrators/SPPM_Pixel.h"
 
 using namespace pbrt;
 //struct SPPMPixel;
@@ -68,6 +68,11 @@ class KdTreeAccel {
   void build();
 
   KdTreeNode_inplace* root();
+  size_t nodeCount() const { return kdTreeNodeObj->size(); }
+  // the sorted box edges, kept until the next build
+  size_t edgeBytes() const {
+    return proxy.capacity() * sizeof(BoxEdge_inplace);
+  }
 
 protected:
   KdTreeNode_inplace *m_root;
@@ -42,7 +42,7 @@
 
 #include <tbb/concurrent_vector.h>
 
-#include "SPPM_Integrators/SAH_InPlace_KD_par.h"
+#include "SPPM_Integrators/SPPM_Pixel.h"
 #include "BoxEdge_inplace.h"
 #include "common_inplace.h"
 
@@ -40,7 +40,7 @@
 #ifndef _SAH_H_
 #define _SAH_H_
 
-#include "SPPM_Integrators/SAH_InPlace_KD_par.h"
+#include "SPPM_Integrators/SPPM_Pixel.h"
 #include "common_inplace.h"
 
 using namespace pbrt;
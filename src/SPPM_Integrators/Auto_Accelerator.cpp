@@ -0,0 +1,255 @@
+
+#include "SPPM_Integrators/Auto_Accelerator.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "SPPM_Integrators/SPPM_Pixel.h"
+#include "parallel.h"
+#include "paramset.h"
+#include "stats.h"
+
+namespace pbrt {
+
+STAT_COUNTER("SPPM accelerator/Auto accelerator switches", autoSwitches);
+
+// Older measurements count half as much at each new one, since the search
+// radii and with them the costs shrink from one iteration to the next
+static double RunningAverage(double average, double x, int count) {
+    return count == 0 ? x : .5 * (average + x);
+}
+
+// AutoAccelerator Method Definitions
+AutoAccelerator::AutoAccelerator(
+    std::vector<std::string> names,
+    std::vector<std::unique_ptr<SPPMAccelerator>> candidates,
+    int photonsPerIteration, int explore, Float margin)
+    : names(std::move(names)),
+      candidates(std::move(candidates)),
+      models(this->candidates.size()),
+      photonsPerIteration(photonsPerIteration),
+      explore(explore),
+      margin(margin) {}
+
+void AutoAccelerator::CostModel::Fit(double *q0, double *q1) const {
+    *q0 = *q1 = 0;
+    if (n == 0) return;
+    double det = n * sumT2 - sumT * sumT;
+    if (det > 1e-9 * n * sumT2) {
+        *q1 = (n * sumTY - sumT * sumY) / det;
+        *q0 = (sumY - *q1 * sumT) / n;
+    }
+    // Fall back to a constant or a proportional cost when the timings don't
+    // support both terms
+    if (*q1 <= 0) {
+        *q1 = 0;
+        *q0 = sumY / n;
+    } else if (*q0 < 0) {
+        *q0 = 0;
+        *q1 = sumTY / sumT2;
+    }
+}
+
+void AutoAccelerator::Build(const std::vector<SPPMPixel *> &pixels) {
+    // Fold the queries since the last build into the active model
+    RecordQueries();
+    if ((int)counters.size() != MaxThreadIndex())
+        counters = std::vector<QueryCounters>(MaxThreadIndex());
+
+    // Compute the expected overlap of the search spheres
+    nPoints = pixels.size();
+    Bounds3f bounds;
+    double sumR = 0, sumR3 = 0;
+    Float maxR = 0;
+    for (const SPPMPixel *pixel : pixels) {
+        Float r = pixel->radius;
+        bounds = Union(bounds, pixel->WorldBound());
+        sumR += r;
+        sumR3 += (double)r * r * r;
+        maxR = std::max(maxR, r);
+    }
+    overlap = 0;
+    if (nPoints > 0 && sumR > 0 && bounds.Volume() > 0)
+        overlap = 4. / 3. * Pi * sumR3 / bounds.Volume() *
+                  (maxR * nPoints / sumR);
+
+    // Build the chosen candidate, freeing the one it replaces
+    int next = Choose();
+    if (active >= 0 && next != active)
+        candidates[active]->Build(std::vector<SPPMPixel *>());
+    active = next;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    candidates[active]->Build(pixels);
+    double ns = std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    CostModel &model = models[active];
+    if (nPoints > 0) {
+        model.buildNs = RunningAverage(model.buildNs, ns / nPoints,
+                                       model.builds);
+        ++model.builds;
+    }
+    ++iteration;
+}
+
+void AutoAccelerator::RecordQueries() {
+    QueryCounters total;
+    for (QueryCounters &c : counters) {
+        total.queries += c.queries;
+        total.tested += c.tested;
+        total.n += c.n;
+        total.sumT += c.sumT;
+        total.sumT2 += c.sumT2;
+        total.sumY += c.sumY;
+        total.sumTY += c.sumTY;
+        c = QueryCounters();
+    }
+    if (active < 0 || total.queries == 0) return;
+
+    CostModel &model = models[active];
+    double decay = model.queryIterations > 0 ? .5 : 0;
+    model.n = decay * model.n + total.n;
+    model.sumT = decay * model.sumT + total.sumT;
+    model.sumT2 = decay * model.sumT2 + total.sumT2;
+    model.sumY = decay * model.sumY + total.sumY;
+    model.sumTY = decay * model.sumTY + total.sumTY;
+    if (overlap > 0)
+        model.tau = RunningAverage(
+            model.tau, (double)total.tested / total.queries / overlap,
+            model.queryIterations);
+    ++model.queryIterations;
+    queriesPerPhoton = (double)total.queries / photonsPerIteration;
+}
+
+double AutoAccelerator::Predict(int c) const {
+    const CostModel &model = models[c];
+    if (model.builds == 0 || model.queryIterations == 0) return Infinity;
+    double q0, q1;
+    model.Fit(&q0, &q1);
+    double queries = queriesPerPhoton * photonsPerIteration;
+    return model.buildNs * nPoints +
+           queries * (q0 + q1 * model.tau * overlap);
+}
+
+double AutoAccelerator::PredictedMs(int c) const {
+    return Predict(c) * 1e-6;
+}
+
+int AutoAccelerator::Choose() {
+    int nCandidates = candidates.size();
+    if (iteration < explore * nCandidates) {
+        int c = iteration / explore;
+        LOG(INFO) << "SPPM auto accelerator: iteration " << iteration
+                  << " measures " << names[c];
+        return c;
+    }
+
+    int best = active;
+    double bestCost = Predict(active);
+    for (int c = 0; c < nCandidates; ++c) {
+        double cost = Predict(c);
+        if (cost < bestCost) {
+            best = c;
+            bestCost = cost;
+        }
+    }
+    double activeCost = Predict(active);
+    if (best != active && bestCost < (1 - margin) * activeCost) {
+        LOG(INFO) << "SPPM auto accelerator: iteration " << iteration
+                  << " switches from " << names[active] << " ("
+                  << activeCost * 1e-6 << " ms predicted) to " << names[best]
+                  << " (" << bestCost * 1e-6 << " ms) for " << nPoints
+                  << " visible points, overlap " << overlap;
+        ++autoSwitches;
+        return best;
+    }
+    VLOG(1) << "SPPM auto accelerator: iteration " << iteration << " keeps "
+            << names[active] << " (" << activeCost * 1e-6
+            << " ms predicted)";
+    return active;
+}
+
+int AutoAccelerator::Query(const Point3f &p, SPPMPixelVisitor func) const {
+    if (active < 0) return 0;
+    QueryCounters &c = counters[ThreadIndex];
+    int tested;
+    if (c.queries++ % sampleInterval != 0) {
+        tested = candidates[active]->Query(p, func);
+    } else {
+        // Time this query for the model's least squares fit
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        tested = candidates[active]->Query(p, func);
+        double ns = std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        c.n += 1;
+        c.sumT += tested;
+        c.sumT2 += (double)tested * tested;
+        c.sumY += ns;
+        c.sumTY += tested * ns;
+    }
+    c.tested += tested;
+    return tested;
+}
+
+size_t AutoAccelerator::BytesUsed() const {
+    return active >= 0 ? candidates[active]->BytesUsed() : 0;
+}
+
+size_t AutoAccelerator::PeakBytesUsed() const {
+    return active >= 0 ? candidates[active]->PeakBytesUsed() : 0;
+}
+
+std::vector<std::pair<std::string, double>> AutoAccelerator::Shape() const {
+    if (active < 0) return {};
+    std::vector<std::pair<std::string, double>> shape =
+        candidates[active]->Shape();
+    shape.push_back({"autoCandidate", (double)active});
+    double predicted = PredictedMs(active);
+    if (predicted < Infinity) shape.push_back({"autoPredictedMs", predicted});
+    return shape;
+}
+
+void AutoAccelerator::VisitNodes(
+    const std::function<void(const SPPMAcceleratorNode &)> &func) const {
+    if (active >= 0) candidates[active]->VisitNodes(func);
+}
+
+SPPMAccelerator *CreateAutoAccelerator(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings) {
+    std::vector<std::string> requested = {"grid", "hierarchical_grid", "lbvh",
+                                          "sah_nested_kd_parsort"};
+    int nNames;
+    const std::string *list = params.FindString("autocandidates", &nNames);
+    if (list) requested.assign(list, list + nNames);
+
+    // The candidates see the same parameters as the auto accelerator
+    std::vector<std::string> names;
+    std::vector<std::unique_ptr<SPPMAccelerator>> candidates;
+    for (const std::string &name : requested) {
+        std::unique_ptr<SPPMAccelerator> accel;
+        if (name != "auto")
+            accel = CreateSPPMAccelerator(name, params, settings);
+        if (!accel) {
+            Error("\"%s\": not an SPPM accelerator the auto accelerator can "
+                  "use", name.c_str());
+            continue;
+        }
+        names.push_back(name);
+        candidates.push_back(std::move(accel));
+    }
+    if (candidates.empty()) {
+        Error("The auto SPPM accelerator has no candidates.");
+        return nullptr;
+    }
+    // Iterations each candidate is measured for before any is predicted
+    int explore = std::max(1, params.FindOneInt("autoexplore", 1));
+    // Fraction by which another candidate must be predicted to be faster
+    Float margin = Clamp(params.FindOneFloat("automargin", .1f), 0, 1);
+    return new AutoAccelerator(std::move(names), std::move(candidates),
+                               settings.photonsPerIteration, explore, margin);
+}
+
+}  // namespace pbrt
@@ -0,0 +1,96 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef AUTOACCELERATOR_H
+#define AUTOACCELERATOR_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "SPPM_Integrators/accelerator.h"
+#include "pbrt.h"
+
+namespace pbrt {
+
+// Accelerator that renders each iteration with whichever of several
+// candidate accelerators it predicts to be fastest.
+//
+// It first uses every candidate for _explore_ iterations, timing the
+// builds and one query in _sampleInterval_. It then predicts the cost of
+// the next iteration for each candidate as
+//     n * build + Q * (q0 + q1 * tested),  tested = overlap * spread * tau
+// where _n_ is the visible point count, _Q_ the expected photon queries
+// (photons per iteration times the queries per photon last iteration),
+// _overlap_ the summed search sphere volume over the volume of the
+// points' bounds and _spread_ the largest over the mean radius. _build_
+// and _tau_ are running averages per candidate; _q0_ and _q1_ are fitted
+// by least squares to the timed queries. The accelerator switches between
+// iterations when another candidate is predicted to be faster by more
+// than _margin_, and logs every decision.
+class AutoAccelerator : public SPPMAccelerator {
+  public:
+    // AutoAccelerator Public Methods
+    AutoAccelerator(
+        std::vector<std::string> names,
+        std::vector<std::unique_ptr<SPPMAccelerator>> candidates,
+        int photonsPerIteration, int explore, Float margin);
+    void Build(const std::vector<SPPMPixel *> &pixels);
+    int Query(const Point3f &p, SPPMPixelVisitor func) const;
+    size_t BytesUsed() const;
+    size_t PeakBytesUsed() const;
+    std::vector<std::pair<std::string, double>> Shape() const;
+    void VisitNodes(
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
+
+    // Candidate used by the last build, or -1 before the first one
+    int ActiveCandidate() const { return active; }
+    // Predicted milliseconds of the last build's iteration for candidate
+    // _c_, or infinity if it hasn't been measured yet
+    double PredictedMs(int c) const;
+
+  private:
+    // AutoAccelerator Private Declarations
+    struct CostModel {
+        // Running averages of the build nanoseconds per visible point and
+        // of the points tested per query over the expected overlap
+        double buildNs = 0, tau = 0;
+        int builds = 0, queryIterations = 0;
+        // Least squares sums of query nanoseconds against points tested
+        double n = 0, sumT = 0, sumT2 = 0, sumY = 0, sumTY = 0;
+        void Fit(double *q0, double *q1) const;
+    };
+    struct alignas(64) QueryCounters {
+        int64_t queries = 0, tested = 0;
+        double n = 0, sumT = 0, sumT2 = 0, sumY = 0, sumTY = 0;
+    };
+
+    // AutoAccelerator Private Methods
+    void RecordQueries();
+    // Predicted nanoseconds of the next iteration with candidate _c_
+    double Predict(int c) const;
+    int Choose();
+
+    // AutoAccelerator Private Data
+    static constexpr int sampleInterval = 64;
+    const std::vector<std::string> names;
+    std::vector<std::unique_ptr<SPPMAccelerator>> candidates;
+    std::vector<CostModel> models;
+    const int photonsPerIteration, explore;
+    const Float margin;
+    mutable std::vector<QueryCounters> counters;
+    int active = -1, iteration = 0;
+    // Visible points and expected overlap of the last build
+    int nPoints = 0;
+    double overlap = 0, queriesPerPhoton = 0;
+};
+
+SPPMAccelerator *CreateAutoAccelerator(const ParamSet &params,
+                                       const SPPMAcceleratorSettings &settings);
+
+}  // namespace pbrt
+
+#endif  // AUTOACCELERATOR_H
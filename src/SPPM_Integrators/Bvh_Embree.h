@@ -7,45 +7,43 @@
 #ifndef BVHEMBREESPPMINTEGRATOR_H
 #define BVHEMBREESPPMINTEGRATOR_H
 
-#include "camera.h"
-#include "film.h"
-#include "integrator.h"
+#include <memory>
+#include <vector>
+
+#include "SPPM_Integrators/accelerator.h"
 #include "pbrt.h"
-#include "tbb/tbb.h"
+
+struct Point;
+namespace tinyembree {
+class PointQuery;
+}
 
 namespace pbrt {
-struct SPPMPixel;
 
 // SPPM Declarations
-class BVHSPPMIntegrator : public Integrator {
+class BVHAccelerator : public SPPMAccelerator {
   public:
-    // SPPMIntegrator Public Methods
-    BVHSPPMIntegrator(std::shared_ptr<const Camera> &camera, int nIterations,
-                     int photonsPerIteration, int maxDepth,
-                     Float initialSearchRadius, int writeFrequency)
-        : camera(camera),
-          initialSearchRadius(initialSearchRadius),
-          nIterations(nIterations),
-          maxDepth(maxDepth),
-          photonsPerIteration(photonsPerIteration > 0
-                                  ? photonsPerIteration
-                                  : camera->film->croppedPixelBounds.Area()),
-          writeFrequency(writeFrequency) {}
-    void Render(const Scene &scene);
+    // BVHAccelerator Public Methods
+    BVHAccelerator();
+    ~BVHAccelerator();
+    void Build(const std::vector<SPPMPixel *> &pixels);
+    int Query(const Point3f &p, SPPMPixelVisitor func) const;
+    size_t BytesUsed() const;
+    size_t PeakBytesUsed() const;
+    std::vector<std::pair<std::string, double>> Shape() const;
 
   private:
-    // SPPMIntegrator Private Data
-    std::shared_ptr<const Camera> camera;
-    const Float initialSearchRadius;
-    const int nIterations;
-    const int maxDepth;
-    const int photonsPerIteration;
-    const int writeFrequency;
+    // BVHAccelerator Private Data
+    std::unique_ptr<tinyembree::PointQuery> query;
+    std::unique_ptr<Point[]> BVHPoints;
+    size_t pointCapacity = 0;
+    std::vector<SPPMPixel *> BVHPixels;
+    float maxRadius = 0;
 };
 
-Integrator *CreateBVHSPPMIntegrator(const ParamSet &params,
-                                   std::shared_ptr<const Camera> camera);
+SPPMAccelerator *CreateBVHAccelerator(const ParamSet &params,
+                                      const SPPMAcceleratorSettings &settings);
 
 }  // namespace pbrt
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,78 @@
+
+#include "SPPM_Integrators/Cell_Hash_Table.h"
+
+#include "stats.h"
+
+namespace pbrt {
+
+STAT_PERCENT("Stochastic Progressive Photon Mapping/Grid cell inserts probing "
+             "past another cell",
+             cellInsertCollisions, cellInserts);
+
+// CellHashTable Method Definitions
+const int64_t CellHashTable::MaxCapacity;
+const int CellHashTable::MaxResolution;
+
+CellHashTable::CellHashTable(Float loadFactor)
+    : loadFactor(Clamp(loadFactor, (Float)0.05, (Float)0.95)) {}
+
+bool CellHashTable::Reset(int64_t maxCells) {
+    if (maxCells > MaxCapacity) {
+        capacity = 0;
+        keys.reset();
+        return false;
+    }
+    int64_t slots = std::min(
+        MaxCapacity,
+        RoundUpPow2(std::max((int64_t)1, (int64_t)(maxCells / loadFactor))));
+    if (slots != capacity) {
+        capacity = (int)slots;
+        keys.reset(new std::atomic<uint64_t>[capacity]);
+    }
+    for (int i = 0; i < capacity; ++i)
+        keys[i].store(emptyKey, std::memory_order_relaxed);
+    return true;
+}
+
+int CellHashTable::Insert(const Point3i &cell) {
+    DCHECK(cell.x >= 0 && cell.x < MaxResolution && cell.y >= 0 &&
+           cell.y < MaxResolution && cell.z >= 0 && cell.z < MaxResolution);
+    uint64_t key = Key(cell);
+    int mask = capacity - 1;
+    ++cellInserts;
+    bool collided = false;
+    for (int probe = 0, slot = Hash(key) & mask; probe < capacity;
+         ++probe, slot = (slot + 1) & mask) {
+        uint64_t k = keys[slot].load(std::memory_order_relaxed);
+        if (k == emptyKey &&
+            keys[slot].compare_exchange_strong(k, key,
+                                               std::memory_order_relaxed))
+            return slot;
+        // _k_ now holds the key stored in the slot, possibly by another
+        // thread that just claimed it
+        if (k == key) return slot;
+        if (!collided) {
+            ++cellInsertCollisions;
+            collided = true;
+        }
+    }
+    LOG(FATAL) << "CellHashTable: more cells inserted than reserved";
+    return -1;
+}
+
+int CellHashTable::Find(const Point3i &cell, int64_t *probes) const {
+    uint64_t key = Key(cell);
+    int mask = capacity - 1;
+    for (int probe = 0, slot = Hash(key) & mask; probe < capacity;
+         ++probe, slot = (slot + 1) & mask) {
+        uint64_t k = keys[slot].load(std::memory_order_relaxed);
+        if (k == key || k == emptyKey) {
+            if (probes) *probes += probe + 1;
+            return k == key ? slot : -1;
+        }
+    }
+    if (probes) *probes += capacity;
+    return -1;
+}
+
+}  // namespace pbrt
@@ -0,0 +1,84 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef CELLHASHTABLE_H
+#define CELLHASHTABLE_H
+
+#include <atomic>
+#include <memory>
+
+#include "geometry.h"
+#include "pbrt.h"
+
+namespace pbrt {
+
+// Open-addressing hash table mapping grid cells to slot indices.
+//
+// Each slot stores the full cell key, so lookups never return a slot that
+// belongs to another cell. Collisions are resolved by linear probing in a
+// power-of-two table, and the capacity is chosen from an upper bound on
+// the number of distinct cells and the load factor. Slots are claimed with
+// a single compare-and-swap, so any number of threads may insert
+// concurrently; callers keep their per-cell data in arrays indexed by slot.
+class CellHashTable {
+  public:
+    CellHashTable(Float loadFactor = 0.5f);
+
+    // Empties the table and sizes it for at most _maxCells_ distinct cells.
+    // Past _MaxCapacity_ slots the load factor is exceeded; returns false,
+    // leaving the table empty, if even that many slots can't hold the cells.
+    bool Reset(int64_t maxCells);
+
+    // Returns the slot of _cell_, claiming a free one if the cell is new.
+    // Cell coordinates must be in [0, MaxResolution).
+    int Insert(const Point3i &cell);
+
+    // Returns the slot of _cell_, or -1 if no point was inserted there. The
+    // number of slots probed is added to _*probes_ if it is given.
+    int Find(const Point3i &cell, int64_t *probes = nullptr) const;
+
+    // Returns the cell stored in _slot_, or false if the slot is free
+    bool Cell(int slot, Point3i *cell) const {
+        uint64_t key = keys[slot].load(std::memory_order_relaxed);
+        if (key == emptyKey) return false;
+        const uint64_t mask = (1ull << 21) - 1;
+        *cell = Point3i((int)(key >> 42), (int)((key >> 21) & mask),
+                        (int)(key & mask));
+        return true;
+    }
+
+    static const int64_t MaxCapacity = (int64_t)1 << 30;
+    // Cells per axis that the 21-bit keys keep apart; grids must be
+    // coarsened to fit
+    static const int MaxResolution = 1 << 21;
+    int Capacity() const { return capacity; }
+    size_t BytesUsed() const { return capacity * sizeof(uint64_t); }
+
+  private:
+    // CellHashTable Private Methods
+    static uint64_t Key(const Point3i &p) {
+        return ((uint64_t)p.x << 42) | ((uint64_t)p.y << 21) | (uint64_t)p.z;
+    }
+    static uint64_t Hash(uint64_t key) {
+        // Finalizer of MurmurHash3; mixes all key bits into the low ones
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ull;
+        key ^= key >> 33;
+        return key;
+    }
+
+    // CellHashTable Private Data
+    static const uint64_t emptyKey = ~0ull;
+    const Float loadFactor;
+    int capacity = 0;
+    std::unique_ptr<std::atomic<uint64_t>[]> keys;
+};
+
+}  // namespace pbrt
+
+#endif  // CELLHASHTABLE_H
@@ -38,45 +38,58 @@
 #ifndef GRID_H
 #define GRID_H
 
-// integrators/sppm.h*
-#include "camera.h"
-#include "film.h"
-#include "integrator.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "SPPM_Integrators/Cell_Hash_Table.h"
+#include "SPPM_Integrators/accelerator.h"
+#include "memory.h"
 #include "pbrt.h"
 
 namespace pbrt {
 
-// SPPM Declarations
-class GridSPPMIntegrator : public Integrator {
+struct SPPMPixelListNode;
+
+// Uniform grid of pbrt's SPPM integrator. Cells are as wide as the largest
+// search radius, each occupied cell keeps a linked list of the visible
+// points whose bounds overlap it, and cells are found through a
+// CellHashTable. The sequential variant inserts the visible points on the
+// calling thread only.
+class GridAccelerator : public SPPMAccelerator {
   public:
-    // SPPMIntegrator Public Methods
-    GridSPPMIntegrator(std::shared_ptr<const Camera> &camera,
-                          int nIterations, int photonsPerIteration,
-                          int maxDepth, Float initialSearchRadius,
-                          int writeFrequency)
-        : camera(camera),
-          initialSearchRadius(initialSearchRadius),
-          nIterations(nIterations),
-          maxDepth(maxDepth),
-          photonsPerIteration(photonsPerIteration > 0
-                                  ? photonsPerIteration
-                                  : camera->film->croppedPixelBounds.Area()),
-          writeFrequency(writeFrequency) {}
-    void Render(const Scene &scene);
+    // GridAccelerator Public Methods
+    GridAccelerator(Float loadFactor, bool parallelBuild)
+        : parallelBuild(parallelBuild), cells(loadFactor) {}
+    void Build(const std::vector<SPPMPixel *> &pixels);
+    int Query(const Point3f &p, SPPMPixelVisitor func) const;
+    size_t BytesUsed() const;
+    size_t PeakBytesUsed() const;
+    std::vector<std::pair<std::string, double>> Shape() const;
+    void VisitNodes(
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
 
   private:
-    // SPPMIntegrator Private Data
-    std::shared_ptr<const Camera> camera;
-    const Float initialSearchRadius;
-    const int nIterations;
-    const int maxDepth;
-    const int photonsPerIteration;
-    const int writeFrequency;
+    // GridAccelerator Private Data
+    const bool parallelBuild;
+    CellHashTable cells;
+    // Visible point lists of the occupied grid cells, indexed by the cells'
+    // slots in _cells_
+    std::unique_ptr<std::atomic<SPPMPixelListNode *>[]> grid;
+    // Arenas for the list nodes, with blocks sized to the last build
+    std::deque<MemoryArena> arenas;
+    size_t arenaBlockSize = 0;
+    Bounds3f gridBounds;
+    int gridRes[3] = {0, 0, 0};
+    int64_t cellRefs = 0;
 };
 
-Integrator *CreateGridSPPMIntegrator(const ParamSet &params,
-                                        std::shared_ptr<const Camera> camera);
+SPPMAccelerator *CreateGridAccelerator(const ParamSet &params,
+                                       const SPPMAcceleratorSettings &settings);
+SPPMAccelerator *CreateGridParAccelerator(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings);
 
 }  // namespace pbrt
 
-#endif  // PBRT_INTEGRATORS_SPPM_H
+#endif  // GRID_H
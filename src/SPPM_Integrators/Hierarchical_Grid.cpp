@@ -0,0 +1,303 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+// integrators/sppm.cpp*
+#include "SPPM_Integrators/Hierarchical_Grid.h"
+#include "SPPM_Integrators/SPPM_Pixel.h"
+#include "parallel.h"
+#include "paramset.h"
+#include "stats.h"
+
+namespace pbrt {
+
+STAT_INT_DISTRIBUTION(
+    "Stochastic Progressive Photon Mapping/Grid cells per visible point",
+    gridCellsPerVisiblePoint);
+STAT_INT_DISTRIBUTION(
+    "Stochastic Progressive Photon Mapping/Grid levels searched per photon "
+    "intersection",
+    gridLevelsSearched);
+STAT_RATIO(
+    "Stochastic Progressive Photon Mapping/Grid hash table probes per lookup",
+    cellLookupProbes, cellLookups);
+
+struct SPPMPixelListNode {
+    SPPMPixel *pixel;
+    SPPMPixelListNode *next;
+};
+
+// Returns the finest level whose cells are at least as wide as the search
+// sphere's diameter, so each sphere overlaps at most 2x2x2 cells of its level
+static int GridLevelForRadius(Float radius, Float invBaseCellSize,
+                              int nLevels) {
+    Float cells = 2 * radius * invBaseCellSize;
+    int level = 0;
+    while (level < nLevels - 1 && (Float)(1 << level) < cells) ++level;
+    return level;
+}
+
+// Returns the cell of _level_ containing _p_, clamped to the level's grid
+// before converting so that distant points can't overflow the cell index
+static Point3i ToLevelCell(const Point3f &p, const Point3f &origin,
+                           const GridLevel &level) {
+    Vector3f pg = (p - origin) * level.invCellSize;
+    Point3i cell;
+    for (int i = 0; i < 3; ++i)
+        cell[i] = (int)Clamp(std::floor(pg[i]), 0, level.gridRes[i] - 1);
+    return cell;
+}
+
+// HierarchicalGridAccelerator Method Definitions
+HierarchicalGridAccelerator::HierarchicalGridAccelerator(Float loadFactor) {
+    levels.reserve(maxGridLevels);
+    for (int l = 0; l < maxGridLevels; ++l) levels.emplace_back(loadFactor);
+}
+
+void HierarchicalGridAccelerator::Build(
+    const std::vector<SPPMPixel *> &pixels) {
+    for (GridLevel &level : levels) level.lists.reset();
+    activeLevels.clear();
+    gridBounds = Bounds3f();
+    cellRefs = 0;
+    int nPixels = pixels.size();
+    if (nPixels == 0) return;
+
+    // Compute grid bounds and radius range for SPPM visible points
+    Float minRadius = Infinity, maxRadius = 0.;
+    for (const SPPMPixel *pixel : pixels) {
+        Bounds3f vpBound = Expand(Bounds3f(pixel->vp.p), pixel->radius);
+        gridBounds = Union(gridBounds, vpBound);
+        minRadius = std::min(minRadius, pixel->radius);
+        maxRadius = std::max(maxRadius, pixel->radius);
+    }
+
+    // Size level 0 so the smallest search spheres span one cell, but no
+    // finer than the cell table can key, and add levels until the largest
+    // spheres fit as well. The cells are coarsened while some level's table
+    // can't hold the cells its points overlap.
+    Vector3f diag = gridBounds.Diagonal();
+    Float baseCellSize =
+        std::max(2 * minRadius,
+                 MaxComponent(diag) / (CellHashTable::MaxResolution - 1));
+    Float invBaseCellSize = 0;
+    int nLevels = 1;
+    // Returns the level of _pixel_ and the range of its cells there
+    auto cellRange = [&](const SPPMPixel &pixel, Point3i *pMin,
+                         Point3i *pMax) {
+        Float radius = pixel.radius;
+        int l = GridLevelForRadius(radius, invBaseCellSize, nLevels);
+        *pMin = ToLevelCell(pixel.vp.p - Vector3f(radius, radius, radius),
+                            gridBounds.pMin, levels[l]);
+        *pMax = ToLevelCell(pixel.vp.p + Vector3f(radius, radius, radius),
+                            gridBounds.pMin, levels[l]);
+        return l;
+    };
+    for (;; baseCellSize *= 2) {
+        invBaseCellSize = baseCellSize > 0 ? 1 / baseCellSize : 0;
+        nLevels =
+            GridLevelForRadius(maxRadius, invBaseCellSize, maxGridLevels) + 1;
+        for (int l = 0; l < nLevels; ++l) {
+            GridLevel &level = levels[l];
+            level.invCellSize = invBaseCellSize / (Float)(1 << l);
+            for (int i = 0; i < 3; ++i)
+                level.gridRes[i] = (int)std::min<Float>(
+                    diag[i] * level.invCellSize + 1,
+                    CellHashTable::MaxResolution);
+        }
+
+        // Count the points and cell references of each level
+        std::vector<int64_t> threadCounts(MaxThreadIndex() * 2 * nLevels);
+        ParallelFor(
+            [&](int i) {
+                Point3i pMin, pMax;
+                int l = cellRange(*pixels[i], &pMin, &pMax);
+                int64_t *counts = &threadCounts[ThreadIndex * 2 * nLevels];
+                ++counts[2 * l];
+                counts[2 * l + 1] += (int64_t)(1 + pMax.x - pMin.x) *
+                                     (1 + pMax.y - pMin.y) *
+                                     (1 + pMax.z - pMin.z);
+            },
+            nPixels, 4096);
+
+        // Size each level's cell table by the cells its points overlap
+        bool fits = true;
+        activeLevels.clear();
+        cellRefs = 0;
+        for (int l = 0; l < nLevels && fits; ++l) {
+            GridLevel &level = levels[l];
+            level.nPoints = 0;
+            level.cellRefs = 0;
+            for (int t = 0; t < MaxThreadIndex(); ++t) {
+                level.nPoints += threadCounts[(t * nLevels + l) * 2];
+                level.cellRefs += threadCounts[(t * nLevels + l) * 2 + 1];
+            }
+            if (level.nPoints == 0) continue;
+            double levelCells = (double)level.gridRes[0] * level.gridRes[1] *
+                                level.gridRes[2];
+            int64_t maxCells = levelCells < level.cellRefs
+                                   ? (int64_t)levelCells
+                                   : level.cellRefs;
+            fits = level.cells.Reset(maxCells);
+            activeLevels.push_back(l);
+            cellRefs += level.cellRefs;
+        }
+        if (fits) break;
+    }
+    // Size the arena blocks to each thread's share of the list nodes, so
+    // that small builds don't hold on to large blocks
+    size_t blockSize = Clamp(
+        RoundUpPow2((int64_t)(cellRefs * sizeof(SPPMPixelListNode) /
+                              MaxThreadIndex())),
+        (int64_t)4096, (int64_t)262144);
+    if ((int)arenas.size() != MaxThreadIndex() ||
+        blockSize != arenaBlockSize) {
+        arenas.clear();
+        for (int t = 0; t < MaxThreadIndex(); ++t)
+            arenas.emplace_back(blockSize);
+        arenaBlockSize = blockSize;
+    }
+    for (MemoryArena &arena : arenas) arena.Reset();
+    for (int l : activeLevels)
+        levels[l].lists.reset(
+            new std::atomic<SPPMPixelListNode *>[levels[l].cells.Capacity()]());
+
+    // Add visible points to the grid level matching their radius
+    ParallelFor(
+        [&](int i) {
+            MemoryArena &arena = arenas[ThreadIndex];
+            SPPMPixel &pixel = *pixels[i];
+            Point3i pMin, pMax;
+            GridLevel &level = levels[cellRange(pixel, &pMin, &pMax)];
+            for (int z = pMin.z; z <= pMax.z; ++z)
+                for (int y = pMin.y; y <= pMax.y; ++y)
+                    for (int x = pMin.x; x <= pMax.x; ++x) {
+                        // Add visible point to grid cell $(x, y, z)$ of its
+                        // level
+                        int h = level.cells.Insert(Point3i(x, y, z));
+                        SPPMPixelListNode *node =
+                            arena.Alloc<SPPMPixelListNode>();
+                        node->pixel = &pixel;
+
+                        // Atomically add _node_ to the start of the cell's
+                        // linked list
+                        std::atomic<SPPMPixelListNode *> &cell =
+                            level.lists[h];
+                        node->next = cell;
+                        while (cell.compare_exchange_weak(node->next, node) ==
+                               false)
+                            ;
+                    }
+            ReportValue(gridCellsPerVisiblePoint, (1 + pMax.x - pMin.x) *
+                                                      (1 + pMax.y - pMin.y) *
+                                                      (1 + pMax.z - pMin.z));
+        },
+        nPixels, 4096);
+}
+
+int HierarchicalGridAccelerator::Query(
+    const Point3f &p, SPPMPixelVisitor func) const {
+    // Points outside the grid bounds are in no search sphere
+    if (!Inside(p, gridBounds)) return 0;
+    // Test the visible points of one cell per non-empty level
+    ReportValue(gridLevelsSearched, activeLevels.size());
+    int tested = 0;
+    for (int l : activeLevels) {
+        const GridLevel &level = levels[l];
+        int h = level.cells.Find(ToLevelCell(p, gridBounds.pMin, level),
+                                 &cellLookupProbes);
+        ++cellLookups;
+        if (h < 0) continue;
+        for (SPPMPixelListNode *node =
+                 level.lists[h].load(std::memory_order_relaxed);
+             node != nullptr; node = node->next) {
+            ++tested;
+            SPPMPixel *pixel = node->pixel;
+            Float radius = pixel->radius;
+            if (DistanceSquared(pixel->vp.p, p) <= radius * radius)
+                func(pixel);
+        }
+    }
+    return tested;
+}
+
+size_t HierarchicalGridAccelerator::BytesUsed() const {
+    size_t bytes = cellRefs * sizeof(SPPMPixelListNode);
+    for (int l : activeLevels)
+        bytes += levels[l].cells.BytesUsed() +
+                 levels[l].cells.Capacity() *
+                     sizeof(std::atomic<SPPMPixelListNode *>);
+    return bytes;
+}
+
+size_t HierarchicalGridAccelerator::PeakBytesUsed() const {
+    // The list nodes live in arena blocks, which are kept between builds
+    size_t arenaBytes = 0;
+    for (const MemoryArena &arena : arenas)
+        arenaBytes += arena.TotalAllocated();
+    size_t nodeBytes = cellRefs * sizeof(SPPMPixelListNode);
+    return BytesUsed() - nodeBytes + std::max(nodeBytes, arenaBytes);
+}
+
+std::vector<std::pair<std::string, double>>
+HierarchicalGridAccelerator::Shape() const {
+    return {{"levels", (double)activeLevels.size()},
+            {"cellReferences", (double)cellRefs}};
+}
+
+void HierarchicalGridAccelerator::VisitNodes(
+    const std::function<void(const SPPMAcceleratorNode &)> &func) const {
+    for (int l : activeLevels) {
+        const GridLevel &level = levels[l];
+        Float cellSize = level.invCellSize > 0 ? 1 / level.invCellSize : 0;
+        for (int h = 0; h < level.cells.Capacity(); ++h) {
+            Point3i c;
+            if (!level.cells.Cell(h, &c)) continue;
+            SPPMAcceleratorNode node;
+            Point3f pMin = gridBounds.pMin + cellSize * Vector3f(c.x, c.y, c.z);
+            node.bounds =
+                Bounds3f(pMin, pMin + Vector3f(cellSize, cellSize, cellSize));
+            for (SPPMPixelListNode *n =
+                     level.lists[h].load(std::memory_order_relaxed);
+                 n != nullptr; n = n->next)
+                ++node.nPoints;
+            func(node);
+        }
+    }
+}
+
+SPPMAccelerator *CreateHierarchicalGridAccelerator(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings) {
+    Float loadFactor = params.FindOneFloat("loadfactor", .5f);
+    return new HierarchicalGridAccelerator(loadFactor);
+}
+
+}  // namespace pbrt
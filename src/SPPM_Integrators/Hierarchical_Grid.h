@@ -0,0 +1,103 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef HIERARCHICALGRID_H
+#define HIERARCHICALGRID_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "SPPM_Integrators/Cell_Hash_Table.h"
+#include "SPPM_Integrators/accelerator.h"
+#include "memory.h"
+#include "pbrt.h"
+
+namespace pbrt {
+
+struct SPPMPixelListNode;
+
+// One level of the hierarchical grid. Cells of level $l$ are $2^l$ times
+// the base cell size, and each level has its own table of cell lists.
+struct GridLevel {
+    GridLevel(Float loadFactor) : cells(loadFactor) {}
+    Float invCellSize = 0;
+    int gridRes[3] = {0, 0, 0};
+    int nPoints = 0;
+    int64_t cellRefs = 0;
+    CellHashTable cells;
+    std::unique_ptr<std::atomic<SPPMPixelListNode *>[]> lists;
+};
+
+// Maximum number of levels; visible points with larger radii go to the
+// coarsest level and just overlap more of its cells
+static const int maxGridLevels = 16;
+
+// Stack of uniform grids whose cell sizes double from level to level. Each
+// visible point is stored in the level whose cells match its search
+// diameter, so points with very different radii do not force one cell size
+// on each other; a photon looks up one cell in every non-empty level.
+class HierarchicalGridAccelerator : public SPPMAccelerator {
+  public:
+    // HierarchicalGridAccelerator Public Methods
+    HierarchicalGridAccelerator(Float loadFactor);
+    void Build(const std::vector<SPPMPixel *> &pixels);
+    int Query(const Point3f &p, SPPMPixelVisitor func) const;
+    size_t BytesUsed() const;
+    size_t PeakBytesUsed() const;
+    std::vector<std::pair<std::string, double>> Shape() const;
+    void VisitNodes(
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
+
+  private:
+    // HierarchicalGridAccelerator Private Data
+    Bounds3f gridBounds;
+    std::vector<GridLevel> levels;
+    std::vector<int> activeLevels;
+    // Arenas for the list nodes, with blocks sized to the last build
+    std::deque<MemoryArena> arenas;
+    size_t arenaBlockSize = 0;
+    int64_t cellRefs = 0;
+};
+
+SPPMAccelerator *CreateHierarchicalGridAccelerator(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings);
+
+}  // namespace pbrt
+
+#endif  // HIERARCHICALGRID_H
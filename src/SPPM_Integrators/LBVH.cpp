@@ -0,0 +1,222 @@
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "SPPM_Integrators/LBVH.h"
+#include "SPPM_Integrators/SPPM_Pixel.h"
+#include "parallel.h"
+#include "paramset.h"
+#include "stats.h"
+#include <tbb/parallel_sort.h>
+
+namespace pbrt {
+
+STAT_INT_DISTRIBUTION("Stochastic Progressive Photon Mapping/LBVH nodes",
+                      lbvhNodes);
+
+// LBVHAccelerator Method Definitions
+void LBVHAccelerator::Build(const std::vector<SPPMPixel *> &pixels) {
+    // Gather the visible points and their search radii; the LBVH keeps its
+    // own copies, so these are freed once it is built
+    BVHPixels = pixels;
+    int nBVHPixels = BVHPixels.size();
+    std::vector<Point3f> BVHPoints(nBVHPixels);
+    std::vector<Float> BVHRadii(nBVHPixels);
+    ParallelFor(
+        [&](int64_t i) {
+            BVHPoints[i] = BVHPixels[i]->vp.p;
+            BVHRadii[i] = BVHPixels[i]->radius;
+        },
+        nBVHPixels, 4096);
+    lbvh.Build(nBVHPixels, BVHPoints.data(), BVHRadii.data());
+    ReportValue(lbvhNodes, lbvh.NodeCount());
+}
+
+int LBVHAccelerator::Query(const Point3f &p, SPPMPixelVisitor func) const {
+    return lbvh.Query(p, [&](int index) { func(BVHPixels[index]); });
+}
+
+// Spreads the low 10 bits of _x_ so there are two zero bits between each
+static inline uint32_t LeftShift3(uint32_t x) {
+    if (x == (1 << 10)) --x;
+    x = (x | (x << 16)) & 0x30000ff;
+    x = (x | (x << 8)) & 0x300f00f;
+    x = (x | (x << 4)) & 0x30c30c3;
+    x = (x | (x << 2)) & 0x9249249;
+    return x;
+}
+
+// Length of the common prefix of sorted keys _i_ and _j_, or -1 if _j_ is
+// out of range. Keys are unique since their low bits hold the point index.
+static inline int Delta(const std::vector<uint64_t> &keys, int64_t i,
+                        int64_t j) {
+    if (j < 0 || j >= (int64_t)keys.size()) return -1;
+    return CountLeadingZeros(keys[i] ^ keys[j]);
+}
+
+void LBVH::Build(int nPoints, const Point3f *p, const Float *radius) {
+    const int chunkSize = 4096;
+    int nChunks = (nPoints + chunkSize - 1) / chunkSize;
+
+    // Compute bounds of the sphere centers, one partial union per thread
+    std::vector<Bounds3f> threadBounds(MaxThreadIndex());
+    ParallelFor(
+        [&](int chunk) {
+            Bounds3f &b = threadBounds[ThreadIndex];
+            int end = std::min(nPoints, (chunk + 1) * chunkSize);
+            for (int i = chunk * chunkSize; i < end; ++i) b = Union(b, p[i]);
+        },
+        nChunks);
+    Bounds3f centroidBounds;
+    for (const Bounds3f &b : threadBounds)
+        centroidBounds = Union(centroidBounds, b);
+
+    // Compute 30-bit Morton codes, with the point index in the low bits
+    std::vector<uint64_t> keys(nPoints);
+    ParallelFor(
+        [&](int64_t i) {
+            const int mortonBits = 10;
+            const int mortonScale = 1 << mortonBits;
+            Vector3f o = centroidBounds.Offset(p[i]) * mortonScale;
+            uint32_t code = (LeftShift3((uint32_t)o.z) << 2) |
+                            (LeftShift3((uint32_t)o.y) << 1) |
+                            LeftShift3((uint32_t)o.x);
+            keys[i] = ((uint64_t)code << 32) | (uint64_t)i;
+        },
+        nPoints, chunkSize);
+    tbb::parallel_sort(keys.begin(), keys.end());
+
+    // Store the spheres in Morton order
+    points.resize(nPoints);
+    radii.resize(nPoints);
+    indices.resize(nPoints);
+    ParallelFor(
+        [&](int64_t i) {
+            int index = (int)(keys[i] & 0xffffffff);
+            points[i] = p[index];
+            radii[i] = radius[index];
+            indices[i] = index;
+        },
+        nPoints, chunkSize);
+
+    // Emit the interior nodes; node _i_ covers a key range that starts or
+    // ends at key _i_ and splits where the common prefix first changes
+    int nInterior = std::max(nPoints - 1, 0);
+    nodes.resize(nInterior);
+    // Parents of interior nodes, then of leaves
+    std::vector<int> parents(nInterior + nPoints, -1);
+    ParallelFor(
+        [&](int64_t i) {
+            int d = Delta(keys, i, i + 1) > Delta(keys, i, i - 1) ? 1 : -1;
+
+            // Find the other end of the range with an exponential then a
+            // binary search
+            int deltaMin = Delta(keys, i, i - d);
+            int64_t lMax = 2;
+            while (Delta(keys, i, i + lMax * d) > deltaMin) lMax *= 2;
+            int64_t l = 0;
+            for (int64_t t = lMax / 2; t >= 1; t /= 2)
+                if (Delta(keys, i, i + (l + t) * d) > deltaMin) l += t;
+            int64_t j = i + l * d;
+
+            // Find the split position within the range
+            int deltaNode = Delta(keys, i, j);
+            int64_t s = 0, t = l;
+            do {
+                t = (t + 1) / 2;
+                if (Delta(keys, i, i + (s + t) * d) > deltaNode) s += t;
+            } while (t > 1);
+            int64_t split = i + s * d + std::min(d, 0);
+
+            LBVHNode &node = nodes[i];
+            if (std::min(i, j) == split) {
+                node.child[0] = (uint32_t)split | LBVHNode::leafFlag;
+                parents[nInterior + split] = i;
+            } else {
+                node.child[0] = (uint32_t)split;
+                parents[split] = i;
+            }
+            if (std::max(i, j) == split + 1) {
+                node.child[1] = (uint32_t)(split + 1) | LBVHNode::leafFlag;
+                parents[nInterior + split + 1] = i;
+            } else {
+                node.child[1] = (uint32_t)(split + 1);
+                parents[split + 1] = i;
+            }
+        },
+        nInterior, chunkSize);
+
+    // Fit bounds bottom-up; the second child to reach a node computes its
+    // bounds, so every node is written once after both children are done
+    std::unique_ptr<std::atomic<int>[]> visits(new std::atomic<int>[nInterior]);
+    for (int i = 0; i < nInterior; ++i) visits[i] = 0;
+    scratchBytes = threadBounds.size() * sizeof(Bounds3f) +
+                   keys.size() * sizeof(uint64_t) +
+                   parents.size() * sizeof(int) +
+                   nInterior * sizeof(std::atomic<int>);
+    auto childBounds = [&](uint32_t child) {
+        if (child & LBVHNode::leafFlag) {
+            int i = child & ~LBVHNode::leafFlag;
+            return Expand(Bounds3f(points[i]), radii[i]);
+        }
+        const LBVHNode &n = nodes[child];
+        return Bounds3f(Point3f(n.pMin[0], n.pMin[1], n.pMin[2]),
+                        Point3f(n.pMax[0], n.pMax[1], n.pMax[2]));
+    };
+    ParallelFor(
+        [&](int64_t leaf) {
+            int node = parents[nInterior + leaf];
+            while (node >= 0) {
+                if (visits[node].fetch_add(1, std::memory_order_acq_rel) == 0)
+                    return;
+                Bounds3f b = Union(childBounds(nodes[node].child[0]),
+                                   childBounds(nodes[node].child[1]));
+                for (int c = 0; c < 3; ++c) {
+#ifdef PBRT_FLOAT_AS_DOUBLE
+                    nodes[node].pMin[c] = NextFloatDown((float)b.pMin[c]);
+                    nodes[node].pMax[c] = NextFloatUp((float)b.pMax[c]);
+#else
+                    nodes[node].pMin[c] = b.pMin[c];
+                    nodes[node].pMax[c] = b.pMax[c];
+#endif
+                }
+                node = parents[node];
+            }
+        },
+        nPoints, chunkSize);
+}
+
+void LBVH::VisitNodes(
+    const std::function<void(const SPPMAcceleratorNode &)> &func) const {
+    if (points.empty()) return;
+    std::vector<std::pair<uint32_t, int>> stack;
+    stack.push_back({nodes.empty() ? LBVHNode::leafFlag : 0, 0});
+    while (!stack.empty()) {
+        uint32_t ref = stack.back().first;
+        SPPMAcceleratorNode node;
+        node.depth = stack.back().second;
+        stack.pop_back();
+        if (ref & LBVHNode::leafFlag) {
+            int i = ref & ~LBVHNode::leafFlag;
+            node.bounds = Expand(Bounds3f(points[i]), radii[i]);
+            node.nPoints = 1;
+            func(node);
+            continue;
+        }
+        const LBVHNode &n = nodes[ref];
+        node.bounds = Bounds3f(Point3f(n.pMin[0], n.pMin[1], n.pMin[2]),
+                               Point3f(n.pMax[0], n.pMax[1], n.pMax[2]));
+        node.leaf = false;
+        func(node);
+        for (int c = 1; c >= 0; --c)
+            stack.push_back({n.child[c], node.depth + 1});
+    }
+}
+
+SPPMAccelerator *CreateLBVHAccelerator(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings) {
+    return new LBVHAccelerator;
+}
+
+}  // namespace pbrt
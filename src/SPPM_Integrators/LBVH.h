@@ -0,0 +1,135 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef LBVHSPPMINTEGRATOR_H
+#define LBVHSPPMINTEGRATOR_H
+
+#include <vector>
+
+#include "SPPM_Integrators/accelerator.h"
+#include "pbrt.h"
+
+namespace pbrt {
+
+// Interior node of the LBVH. Children with _leafFlag_ set refer to visible
+// points, by their position in Morton order, instead of to other nodes.
+// The bounds are kept in single precision so a node is exactly 32 bytes.
+struct LBVHNode {
+    static const uint32_t leafFlag = 0x80000000u;
+    float pMin[3], pMax[3];
+    uint32_t child[2];
+};
+static_assert(sizeof(LBVHNode) == 32, "LBVHNode should be 32 bytes");
+
+// Linear BVH over visible point search spheres, built with the parallel
+// construction of Karras, "Maximizing Parallelism in the Construction of
+// BVHs, Octrees, and k-d Trees" (HPG 2012): sort by Morton code, emit every
+// interior node independently from the sorted keys, then fit bounds
+// bottom-up with one atomic visit counter per node.
+class LBVH {
+  public:
+    // Builds the hierarchy over the spheres (_p_[i], _radius_[i])
+    void Build(int nPoints, const Point3f *p, const Float *radius);
+
+    // Calls _func_ with the index of every sphere that contains _p_ and
+    // returns the number of spheres tested
+    template <typename F>
+    int Query(const Point3f &p, F func) const;
+
+    // Calls _func_ for every node, with each visible point as a leaf
+    void VisitNodes(
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
+
+    int NodeCount() const { return (int)nodes.size(); }
+    size_t BytesUsed() const {
+        return nodes.size() * sizeof(LBVHNode) +
+               points.size() * (sizeof(Point3f) + sizeof(Float) + sizeof(int));
+    }
+    // Adds the Morton keys and parent links freed at the end of Build()
+    size_t PeakBytesUsed() const { return BytesUsed() + scratchBytes; }
+
+  private:
+    // LBVH Private Methods
+    bool Inside(uint32_t child, const Point3f &p) const {
+        const LBVHNode &node = nodes[child];
+        return p.x >= node.pMin[0] && p.x <= node.pMax[0] &&
+               p.y >= node.pMin[1] && p.y <= node.pMax[1] &&
+               p.z >= node.pMin[2] && p.z <= node.pMax[2];
+    }
+
+    // LBVH Private Data
+    std::vector<LBVHNode> nodes;
+    // Sphere centers, radii and original indices, in Morton order
+    std::vector<Point3f> points;
+    std::vector<Float> radii;
+    std::vector<int> indices;
+    size_t scratchBytes = 0;
+};
+
+template <typename F>
+int LBVH::Query(const Point3f &p, F func) const {
+    int tested = 0;
+    if (points.empty()) return tested;
+    uint32_t stack[128];
+    int stackTop = 0;
+    stack[stackTop++] = nodes.empty() ? LBVHNode::leafFlag : 0;
+    while (stackTop > 0) {
+        uint32_t ref = stack[--stackTop];
+        if (ref & LBVHNode::leafFlag) {
+            // Test the visible point's search sphere
+            int i = ref & ~LBVHNode::leafFlag;
+            ++tested;
+            if (DistanceSquared(points[i], p) <= radii[i] * radii[i])
+                func(indices[i]);
+            continue;
+        }
+        // Visit the children whose bounds contain _p_; leaves are tested
+        // directly since their sphere test is as cheap as a box test
+        const LBVHNode &node = nodes[ref];
+        for (int c = 0; c < 2; ++c) {
+            uint32_t child = node.child[c];
+            if ((child & LBVHNode::leafFlag) || Inside(child, p))
+                stack[stackTop++] = child;
+        }
+    }
+    return tested;
+}
+
+// SPPM Declarations
+class LBVHAccelerator : public SPPMAccelerator {
+  public:
+    // LBVHAccelerator Public Methods
+    void Build(const std::vector<SPPMPixel *> &pixels);
+    int Query(const Point3f &p, SPPMPixelVisitor func) const;
+    size_t BytesUsed() const {
+        return lbvh.BytesUsed() + BVHPixels.capacity() * sizeof(SPPMPixel *);
+    }
+    // Adds the points and radii gathered for LBVH::Build()
+    size_t PeakBytesUsed() const {
+        return lbvh.PeakBytesUsed() +
+               BVHPixels.capacity() * sizeof(SPPMPixel *) +
+               BVHPixels.size() * (sizeof(Point3f) + sizeof(Float));
+    }
+    std::vector<std::pair<std::string, double>> Shape() const {
+        return {{"nodes", (double)lbvh.NodeCount()}};
+    }
+    void VisitNodes(
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const {
+        lbvh.VisitNodes(func);
+    }
+
+  private:
+    // LBVHAccelerator Private Data
+    LBVH lbvh;
+    std::vector<SPPMPixel *> BVHPixels;
+};
+
+SPPMAccelerator *CreateLBVHAccelerator(const ParamSet &params,
+                                       const SPPMAcceleratorSettings &settings);
+
+}  // namespace pbrt
+
+#endif
@@ -4,11 +4,12 @@
 #pragma once
 #endif
 
-#ifndef NESTEDGRIDSPPMINTEGRATOR_H
-#define NESTEDGRIDSPPMINTEGRATOR_H
-#include "camera.h"
-#include "film.h"
-#include "integrator.h"
+#ifndef NESTEDGRID_H
+#define NESTEDGRID_H
+#include <memory>
+#include <vector>
+
+#include "SPPM_Integrators/accelerator.h"
 #include "pbrt.h"
 #include "tbb/tbb.h"
 
@@ -16,41 +17,15 @@ namespace pbrt {
 class NestedGrid;
 struct SPPMPixel;
 
-// SPPM Declarations
-class NestedGridSPPMIntegrator : public Integrator {
-  public:
-    // SPPMIntegrator Public Methods
-    NestedGridSPPMIntegrator(std::shared_ptr<const Camera> &camera,
-                                 int nIterations, int photonsPerIteration,
-                                 int maxDepth, Float initialSearchRadius,
-                                 int writeFrequency)
-        : camera(camera),
-          initialSearchRadius(initialSearchRadius),
-          nIterations(nIterations),
-          maxDepth(maxDepth),
-          photonsPerIteration(photonsPerIteration > 0
-                                  ? photonsPerIteration
-                                  : camera->film->croppedPixelBounds.Area()),
-          writeFrequency(writeFrequency) {}
-    void Render(const Scene &scene);
-
-  private:
-    // SPPMIntegrator Private Data
-    std::shared_ptr<const Camera> camera;
-    const Float initialSearchRadius;
-    const int nIterations;
-    const int maxDepth;
-    const int photonsPerIteration;
-    const int writeFrequency;
-};
-
 class NestedGrid {
   public:
     // Integrator Interface
-    NestedGrid(std::vector<SPPMPixel *> *pixels, int base, float maxRadius,
-                   int threshold, int depth)
+    // The node divides into _base_^3 children, and they into _childBase_^3
+    NestedGrid(std::vector<SPPMPixel *> *pixels, int base, int childBase,
+               float maxRadius, int threshold, int depth)
         : _points(pixels),
           base(base),
+          childBase(childBase),
           maxRadius(maxRadius),
           threshold(threshold),
           depth(depth),
@@ -70,13 +45,20 @@ class NestedGrid {
 
     void build();
     std::vector<int> *trace(Point3f p);
+    // Adds the node count and memory of this subtree to _nodes_ and _bytes_
+    void countNodes(int *nodes, size_t *bytes) const;
+    // Reports this subtree, whose root is at depth _level_, to _func_
+    void visitNodes(
+        int level,
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
 
   protected:
     std::vector<SPPMPixel *> *_points;
+    int base;
+    int childBase;
     float maxRadius;
     int threshold;
     int depth;
-    int base;
     std::vector<NestedGrid *> _child;
     int child_count;
     std::vector<int> assigned_points;
@@ -88,8 +70,32 @@ class NestedGrid {
     float z_add;
 };
 
-Integrator *CreateNestedGridSPPMIntegrator(
-    const ParamSet &params, std::shared_ptr<const Camera> camera);
+// SPPM Declarations
+class NestedGridAccelerator : public SPPMAccelerator {
+  public:
+    // NestedGridAccelerator Public Methods
+    NestedGridAccelerator(int topGridRes, int gridRes, int maxLeafPoints,
+                          int maxTreeDepth)
+        : topGridRes(topGridRes),
+          gridRes(gridRes),
+          maxLeafPoints(maxLeafPoints),
+          maxTreeDepth(maxTreeDepth) {}
+    void Build(const std::vector<SPPMPixel *> &pixels);
+    int Query(const Point3f &p, SPPMPixelVisitor func) const;
+    size_t BytesUsed() const;
+    std::vector<std::pair<std::string, double>> Shape() const;
+    void VisitNodes(
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
+
+  private:
+    // NestedGridAccelerator Private Data
+    const int topGridRes, gridRes, maxLeafPoints, maxTreeDepth;
+    std::vector<SPPMPixel *> points;
+    std::unique_ptr<NestedGrid> tree;
+};
+
+SPPMAccelerator *CreateNestedGridAccelerator(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings);
 
 }  // namespace pbrt
 
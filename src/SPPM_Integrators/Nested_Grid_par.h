@@ -4,11 +4,12 @@
 #pragma once
 #endif
 
-#ifndef NESTEDGRIDPARSPPMINTEGRATOR_H
-#define NESTEDGRIDPARSPPMINTEGRATOR_H
-#include "camera.h"
-#include "film.h"
-#include "integrator.h"
+#ifndef NESTEDGRIDPAR_H
+#define NESTEDGRIDPAR_H
+#include <memory>
+#include <vector>
+
+#include "SPPM_Integrators/accelerator.h"
 #include "pbrt.h"
 #include "tbb/tbb.h"
 
@@ -16,42 +17,15 @@ namespace pbrt {
 class NestedGrid;
 struct SPPMPixel;
 
-// SPPM Declarations
-class NestedGridParSPPMIntegrator : public Integrator {
-  public:
-    // SPPMIntegrator Public Methods
-    NestedGridParSPPMIntegrator(std::shared_ptr<const Camera> &camera,
-                                 int nIterations,
-                     int photonsPerIteration, int maxDepth,
-                     Float initialSearchRadius, int writeFrequency)
-        : camera(camera),
-          initialSearchRadius(initialSearchRadius),
-          nIterations(nIterations),
-          maxDepth(maxDepth),
-          photonsPerIteration(photonsPerIteration > 0
-                                  ? photonsPerIteration
-                                  : camera->film->croppedPixelBounds.Area()),
-          writeFrequency(writeFrequency) {}
-    void Render(const Scene &scene);
-
-  private:
-    // SPPMIntegrator Private Data
-    std::shared_ptr<const Camera> camera;
-    const Float initialSearchRadius;
-    const int nIterations;
-    const int maxDepth;
-    const int photonsPerIteration;
-    const int writeFrequency;
-
-};
-
 class NestedGridPar {
   public:
     // Integrator Interface
-    NestedGridPar(std::vector<SPPMPixel *> *pixels, int base, float maxRadius,
-                   int threshold, int depth)
+    // The node divides into _base_^3 children, and they into _childBase_^3
+    NestedGridPar(std::vector<SPPMPixel *> *pixels, int base, int childBase,
+               float maxRadius, int threshold, int depth)
         : _points(pixels),
           base(base),
+          childBase(childBase),
           maxRadius(maxRadius),
           threshold(threshold),
           depth(depth),
@@ -71,13 +45,20 @@ class NestedGridPar {
 
     void build();
     std::vector<int> *trace(Point3f p);
+    // Adds the node count and memory of this subtree to _nodes_ and _bytes_
+    void countNodes(int *nodes, size_t *bytes) const;
+    // Reports this subtree, whose root is at depth _level_, to _func_
+    void visitNodes(
+        int level,
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
 
   protected:
     std::vector<SPPMPixel *> *_points;
+    int base;
+    int childBase;
     float maxRadius;
     int threshold;
     int depth;
-    int base;
     std::vector<NestedGridPar *> _child;
     int child_count;
     std::vector<int> assigned_points;
@@ -89,9 +70,32 @@ class NestedGridPar {
     float z_add;
 };
 
-Integrator *CreateNestedGridParSPPMIntegrator(
-    const ParamSet &params,
-                                   std::shared_ptr<const Camera> camera);
+// SPPM Declarations
+class NestedGridParAccelerator : public SPPMAccelerator {
+  public:
+    // NestedGridParAccelerator Public Methods
+    NestedGridParAccelerator(int topGridRes, int gridRes, int maxLeafPoints,
+                             int maxTreeDepth)
+        : topGridRes(topGridRes),
+          gridRes(gridRes),
+          maxLeafPoints(maxLeafPoints),
+          maxTreeDepth(maxTreeDepth) {}
+    void Build(const std::vector<SPPMPixel *> &pixels);
+    int Query(const Point3f &p, SPPMPixelVisitor func) const;
+    size_t BytesUsed() const;
+    std::vector<std::pair<std::string, double>> Shape() const;
+    void VisitNodes(
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
+
+  private:
+    // NestedGridParAccelerator Private Data
+    const int topGridRes, gridRes, maxLeafPoints, maxTreeDepth;
+    std::vector<SPPMPixel *> points;
+    std::unique_ptr<NestedGridPar> tree;
+};
+
+SPPMAccelerator *CreateNestedGridParAccelerator(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings);
 
 }  // namespace pbrt
 
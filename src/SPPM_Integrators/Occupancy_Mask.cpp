@@ -0,0 +1,99 @@
+
+#include "SPPM_Integrators/Occupancy_Mask.h"
+
+#include <vector>
+
+#include "parallel.h"
+
+namespace pbrt {
+
+static bool IsEmpty(const Bounds3f &b) {
+    return b.pMin.x > b.pMax.x || b.pMin.y > b.pMax.y || b.pMin.z > b.pMax.z;
+}
+
+OccupancyMask::OccupancyMask(int res)
+    : resolution(std::max(8, (res + 7) & ~7)),
+      nBlocks(resolution / 8),
+      nFineWords(nBlocks * nBlocks * nBlocks * 8),
+      nCoarseWords((nBlocks * nBlocks * nBlocks + 63) / 64),
+      fine(new std::atomic<uint64_t>[nFineWords]),
+      coarse(new std::atomic<uint64_t>[nCoarseWords]) {
+    for (int i = 0; i < nFineWords; ++i) fine[i] = 0;
+    for (int i = 0; i < nCoarseWords; ++i) coarse[i] = 0;
+}
+
+void OccupancyMask::Build(int nPoints,
+                          const std::function<Bounds3f(int)> &pointBound) {
+    for (int i = 0; i < nFineWords; ++i) fine[i] = 0;
+    for (int i = 0; i < nCoarseWords; ++i) coarse[i] = 0;
+
+    // Compute the bounds of all visible points, one partial union per thread
+    const int chunkSize = 4096;
+    int nChunks = (nPoints + chunkSize - 1) / chunkSize;
+    std::vector<Bounds3f> threadBounds(MaxThreadIndex());
+    ParallelFor(
+        [&](int chunk) {
+            Bounds3f &tb = threadBounds[ThreadIndex];
+            int end = std::min(nPoints, (chunk + 1) * chunkSize);
+            for (int i = chunk * chunkSize; i < end; ++i) {
+                Bounds3f b = pointBound(i);
+                if (!IsEmpty(b)) tb = Union(tb, b);
+            }
+        },
+        nChunks);
+    bounds = Bounds3f();
+    for (const Bounds3f &tb : threadBounds) bounds = Union(bounds, tb);
+    empty = IsEmpty(bounds);
+    if (empty) return;
+
+    Vector3f diag = bounds.Diagonal();
+    for (int i = 0; i < 3; ++i)
+        invCellSize[i] = diag[i] > 0 ? resolution / diag[i] : 0;
+
+    // Mark the cells overlapped by each visible point
+    ParallelFor(
+        [&](int chunk) {
+            int end = std::min(nPoints, (chunk + 1) * chunkSize);
+            for (int i = chunk * chunkSize; i < end; ++i) {
+                Bounds3f b = pointBound(i);
+                if (!IsEmpty(b)) MarkBox(b);
+            }
+        },
+        nChunks);
+}
+
+void OccupancyMask::MarkBox(const Bounds3f &b) {
+    int cMin[3], cMax[3];
+    for (int i = 0; i < 3; ++i) {
+        cMin[i] = Clamp((int)((b.pMin[i] - bounds.pMin[i]) * invCellSize[i]),
+                        0, resolution - 1);
+        cMax[i] = Clamp((int)((b.pMax[i] - bounds.pMin[i]) * invCellSize[i]),
+                        0, resolution - 1);
+    }
+
+    // Within a block, the bits of one z slice live in a single word with x
+    // varying fastest, so each slice is updated with one atomic OR
+    for (int bz = cMin[2] >> 3; bz <= cMax[2] >> 3; ++bz)
+        for (int by = cMin[1] >> 3; by <= cMax[1] >> 3; ++by)
+            for (int bx = cMin[0] >> 3; bx <= cMax[0] >> 3; ++bx) {
+                int x0 = std::max(cMin[0] - bx * 8, 0);
+                int x1 = std::min(cMax[0] - bx * 8, 7);
+                int y0 = std::max(cMin[1] - by * 8, 0);
+                int y1 = std::min(cMax[1] - by * 8, 7);
+                int z0 = std::max(cMin[2] - bz * 8, 0);
+                int z1 = std::min(cMax[2] - bz * 8, 7);
+
+                uint64_t row = ((1ull << (x1 + 1)) - 1) & ~((1ull << x0) - 1);
+                uint64_t slice = 0;
+                for (int y = y0; y <= y1; ++y) slice |= row << (8 * y);
+
+                int block = BlockIndex(bx, by, bz);
+                for (int z = z0; z <= z1; ++z)
+                    fine[block * 8 + z].fetch_or(slice,
+                                                 std::memory_order_relaxed);
+                coarse[block >> 6].fetch_or(1ull << (block & 63),
+                                            std::memory_order_relaxed);
+            }
+}
+
+}  // namespace pbrt
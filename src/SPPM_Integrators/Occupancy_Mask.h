@@ -0,0 +1,80 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef OCCUPANCYMASK_H
+#define OCCUPANCYMASK_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "geometry.h"
+#include "pbrt.h"
+
+namespace pbrt {
+
+// Two-level occupancy bitmap over the bounds of the visible points.
+//
+// The fine level stores one bit per cell of a _resolution_^3 grid, grouped
+// in blocks of 8x8x8 cells (eight 64-bit words per block, one word per z
+// slice). The coarse level stores one bit per block, so a photon that lands
+// in an empty region is usually rejected after touching a single cache
+// line. A cell is marked when the bounding box of any visible point's
+// search sphere overlaps it; an unmarked cell therefore cannot contain a
+// visible point within reach of the photon.
+class OccupancyMask {
+  public:
+    // resolution is rounded up to a multiple of the block size (8)
+    OccupancyMask(int resolution = 64);
+
+    // Marks every cell overlapped by the _nPoints_ bounds returned by
+    // _pointBound_. Empty bounds are skipped, so callers may pass the whole
+    // pixel array and return Bounds3f() for pixels without a visible point.
+    void Build(int nPoints, const std::function<Bounds3f(int)> &pointBound);
+
+    bool Occupied(const Point3f &p) const {
+        if (empty) return false;
+        int c[3];
+        for (int i = 0; i < 3; ++i) {
+            Float v = (p[i] - bounds.pMin[i]) * invCellSize[i];
+            // The negated test also rejects NaNs
+            if (!(v >= 0 && v <= resolution)) return false;
+            c[i] = std::min((int)v, resolution - 1);
+        }
+        int block = BlockIndex(c[0] >> 3, c[1] >> 3, c[2] >> 3);
+        if ((coarse[block >> 6].load(std::memory_order_relaxed) &
+             (1ull << (block & 63))) == 0)
+            return false;
+        uint64_t word =
+            fine[block * 8 + (c[2] & 7)].load(std::memory_order_relaxed);
+        return (word & (1ull << (((c[1] & 7) << 3) + (c[0] & 7)))) != 0;
+    }
+
+    const Bounds3f &WorldBound() const { return bounds; }
+    int Resolution() const { return resolution; }
+    size_t BytesUsed() const {
+        return (nFineWords + nCoarseWords) * sizeof(uint64_t);
+    }
+
+  private:
+    // OccupancyMask Private Methods
+    int BlockIndex(int bx, int by, int bz) const {
+        return (bz * nBlocks + by) * nBlocks + bx;
+    }
+    void MarkBox(const Bounds3f &b);
+
+    // OccupancyMask Private Data
+    const int resolution, nBlocks;
+    const int nFineWords, nCoarseWords;
+    std::unique_ptr<std::atomic<uint64_t>[]> fine, coarse;
+    Bounds3f bounds;
+    Vector3f invCellSize;
+    bool empty = true;
+};
+
+}  // namespace pbrt
+
+#endif  // OCCUPANCYMASK_H
@@ -4,11 +4,12 @@
 #pragma once
 #endif
 
-#ifndef OCTREESPPMINTEGRATOR_H
-#define OCTREESPPMINTEGRATOR_H
-#include "camera.h"
-#include "film.h"
-#include "integrator.h"
+#ifndef OCTREE_H
+#define OCTREE_H
+#include <memory>
+#include <vector>
+
+#include "SPPM_Integrators/accelerator.h"
 #include "pbrt.h"
 #include "tbb/tbb.h"
 
@@ -16,34 +17,6 @@ namespace pbrt {
 class Octree;
 struct SPPMPixel;
 
-// SPPM Declarations
-class OctreeSPPMIntegrator : public Integrator {
-  public:
-    // SPPMIntegrator Public Methods
-    OctreeSPPMIntegrator(std::shared_ptr<const Camera> &camera,
-                                 int nIterations, int photonsPerIteration,
-                                 int maxDepth, Float initialSearchRadius,
-                                 int writeFrequency)
-        : camera(camera),
-          initialSearchRadius(initialSearchRadius),
-          nIterations(nIterations),
-          maxDepth(maxDepth),
-          photonsPerIteration(photonsPerIteration > 0
-                                  ? photonsPerIteration
-                                  : camera->film->croppedPixelBounds.Area()),
-          writeFrequency(writeFrequency) {}
-    void Render(const Scene &scene);
-
-  private:
-    // SPPMIntegrator Private Data
-    std::shared_ptr<const Camera> camera;
-    const Float initialSearchRadius;
-    const int nIterations;
-    const int maxDepth;
-    const int photonsPerIteration;
-    const int writeFrequency;
-};
-
 class Octree {
   public:
     // Integrator Interface
@@ -64,6 +37,12 @@ class Octree {
 
     void build();
     std::vector<int> *trace(Point3f p);
+    // Adds the node count and memory of this subtree to _nodes_ and _bytes_
+    void countNodes(int *nodes, size_t *bytes) const;
+    // Reports this subtree, whose root is at depth _level_, to _func_
+    void visitNodes(
+        int level,
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
 
   protected:
     Octree *_child[8];
@@ -76,8 +55,32 @@ class Octree {
     Point3f c;
 };
 
-Integrator *CreateOctreeSPPMIntegrator(
-    const ParamSet &params, std::shared_ptr<const Camera> camera);
+// SPPM Declarations
+class OctreeAccelerator : public SPPMAccelerator {
+  public:
+    // OctreeAccelerator Public Methods
+    OctreeAccelerator(Float initialSearchRadius, int maxLeafPoints,
+                      int maxTreeDepth)
+        : initialSearchRadius(initialSearchRadius),
+          maxLeafPoints(maxLeafPoints),
+          maxTreeDepth(maxTreeDepth) {}
+    void Build(const std::vector<SPPMPixel *> &pixels);
+    int Query(const Point3f &p, SPPMPixelVisitor func) const;
+    size_t BytesUsed() const;
+    std::vector<std::pair<std::string, double>> Shape() const;
+    void VisitNodes(
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
+
+  private:
+    // OctreeAccelerator Private Data
+    const Float initialSearchRadius;
+    const int maxLeafPoints, maxTreeDepth;
+    std::vector<SPPMPixel *> points;
+    std::unique_ptr<Octree> tree;
+};
+
+SPPMAccelerator *CreateOctreeAccelerator(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings);
 
 }  // namespace pbrt
 
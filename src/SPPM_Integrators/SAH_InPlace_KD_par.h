@@ -7,77 +7,42 @@
 #ifndef SAHINPLACEKDPAR_H
 #define SAHINPLACEKDPAR_H
 
-#include "camera.h"
-#include "film.h"
-#include "integrator.h"
-#include "pbrt.h"
-
-namespace pbrt {
-
+#include <memory>
+#include <vector>
 
-    // SPPM Local Definitions
-struct SPPMPixel {
-    // SPPMPixel Public Methods
-    SPPMPixel() : M(0) {}
+#include "SPPM_Integrators/accelerator.h"
+#include "pbrt.h"
 
-    // SPPMPixel Public Methods
-    Bounds3f WorldBound() const {
-        Bounds3f b(vp.p);
-        b.pMin = vp.p - Vector3f(radius, radius, radius);
-        b.pMax = vp.p + Vector3f(radius, radius, radius);
-        return b;
-    }
+class KdTreeAccel;
 
-    // SPPMPixel Public Data
-    Float radius = 0;
-    Spectrum Ld;
-    struct VisiblePoint {
-        // VisiblePoint Public Methods
-        VisiblePoint() {}
-        VisiblePoint(const Point3f &p, const Vector3f &wo, const BSDF *bsdf,
-                     const Spectrum &beta)
-            : p(p), wo(wo), bsdf(bsdf), beta(beta) {}
-        Point3f p;
-        Vector3f wo;
-        const BSDF *bsdf = nullptr;
-        Spectrum beta;
-    } vp;
-    AtomicFloat Phi[Spectrum::nSamples];
-    std::atomic<int> M;
-    Float N = 0;
-    Spectrum tau;
-};
+namespace pbrt {
 
 // SPPM Declarations
-class SAHInPlaceKDParSPPMIntegrator : public Integrator {
+class SAHInPlaceKDParAccelerator : public SPPMAccelerator {
   public:
-    // SPPMIntegrator Public Methods
-    SAHInPlaceKDParSPPMIntegrator(std::shared_ptr<const Camera> &camera,
-                              int nIterations, int photonsPerIteration,
-                              int maxDepth, Float initialSearchRadius,
-                              int writeFrequency)
-        : camera(camera),
-          initialSearchRadius(initialSearchRadius),
-          nIterations(nIterations),
-          maxDepth(maxDepth),
-          photonsPerIteration(photonsPerIteration > 0
-                                  ? photonsPerIteration
-                                  : camera->film->croppedPixelBounds.Area()),
-          writeFrequency(writeFrequency) {}
-    void Render(const Scene &scene);
+    // SAHInPlaceKDParAccelerator Public Methods
+    SAHInPlaceKDParAccelerator(int photonsPerIteration,
+                               const SPPMKdTreeParams &kdParams);
+    ~SAHInPlaceKDParAccelerator();
+    void Build(const std::vector<SPPMPixel *> &pixels);
+    int Query(const Point3f &p, SPPMPixelVisitor func) const;
+    size_t BytesUsed() const;
+    size_t PeakBytesUsed() const;
+    std::vector<std::pair<std::string, double>> Shape() const;
+    void VisitNodes(
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
 
   private:
-    // SPPMIntegrator Private Data
-    std::shared_ptr<const Camera> camera;
-    const Float initialSearchRadius;
-    const int nIterations;
-    const int maxDepth;
+    // SAHInPlaceKDParAccelerator Private Data
     const int photonsPerIteration;
-    const int writeFrequency;
+    const SPPMKdTreeParams kdParams;
+    std::vector<SPPMPixel *> kdPixels;
+    std::unique_ptr<KdTreeAccel> tree;
+    int maxD = 0;
 };
 
-Integrator *CreateSAHInPlaceKDParSPPMIntegrator(
-    const ParamSet &params, std::shared_ptr<const Camera> camera);
+SPPMAccelerator *CreateSAHInPlaceKDParAccelerator(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings);
 
 }  // namespace pbrt
-#endif
\ No newline at end of file
+#endif
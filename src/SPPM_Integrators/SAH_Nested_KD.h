@@ -4,12 +4,13 @@
 #pragma once
 #endif
 
-#ifndef SAHNESTEDKDSPPMINTEGRATOR_H
-#define SAHNESTEDKDSPPMINTEGRATOR_H
+#ifndef SAHNESTEDKD_H
+#define SAHNESTEDKD_H
 
-#include "camera.h"
-#include "film.h"
-#include "integrator.h"
+#include <memory>
+#include <vector>
+
+#include "SPPM_Integrators/accelerator.h"
 #include "pbrt.h"
 
 namespace pbrt {
@@ -18,54 +19,53 @@ struct KdAccelNode;
 struct BoundEdge;
 
 // SPPM Declarations
-class SAHNestedKDSPPMIntegrator : public Integrator {
+class SAHNestedKDAccelerator : public SPPMAccelerator {
   public:
-    // SPPMIntegrator Public Methods
-    SAHNestedKDSPPMIntegrator(std::shared_ptr<const Camera> &camera,
-                              int nIterations,
-                     int photonsPerIteration, int maxDepth,
-                     Float initialSearchRadius, int writeFrequency)
-        : camera(camera),
-          initialSearchRadius(initialSearchRadius),
+    // SAHNestedKDAccelerator Public Methods
+    SAHNestedKDAccelerator(int photonsPerIteration, int nIterations,
+                           const SPPMKdTreeParams &kdParams)
+        : photonsPerIteration(photonsPerIteration),
           nIterations(nIterations),
-          maxDepth(maxDepth),
-          photonsPerIteration(photonsPerIteration > 0
-                                  ? photonsPerIteration
-                                  : camera->film->croppedPixelBounds.Area()),
-          writeFrequency(writeFrequency) {}
-    void Render(const Scene &scene);
+          kdParams(kdParams) {}
+    ~SAHNestedKDAccelerator();
+    void Build(const std::vector<SPPMPixel *> &pixels);
+    int Query(const Point3f &p, SPPMPixelVisitor func) const;
+    size_t BytesUsed() const;
+    size_t PeakBytesUsed() const;
+    std::vector<std::pair<std::string, double>> Shape() const;
+    void VisitNodes(
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
 
   private:
-    // SPPMIntegrator Private Data
-    std::shared_ptr<const Camera> camera;
-    const Float initialSearchRadius;
-    const int nIterations;
-    const int maxDepth;
-    const int photonsPerIteration;
-    const int writeFrequency;
-    // KDtree
-
-    int nextFreeNode;
-    int nAllocedNodes;
-    int isectCost;
-    int traversalCost;
-    Float emptyBonus;
-    int maxvis = 1;
-    int maxD;
-    std::vector<int> visPointsIndices;
-    Bounds3f bounds;
-
+    // SAHNestedKDAccelerator Private Methods
     void buildTree(int nodeNum, const Bounds3f &bounds,
                    const std::vector<Bounds3f> &primBounds, int *primNums,
                    int nprims, int depth,
                    const std::unique_ptr<BoundEdge[]> edges[3], int *prims0,
                    int *prims1, KdAccelNode *&nodes,
                    int badRefines = 0);
+
+    // SAHNestedKDAccelerator Private Data
+    const int photonsPerIteration;
+    const int nIterations;
+    const SPPMKdTreeParams kdParams;
+    std::vector<SPPMPixel *> kdPixels;
+    KdAccelNode *nodes = nullptr;
+    int nextFreeNode = 0;
+    int nAllocedNodes = 0;
+    int isectCost;
+    int traversalCost;
+    Float emptyBonus;
+    int maxvis = 1;
+    int maxD = 0;
+    Bounds3f bounds;
+    std::vector<int> visPointsIndices;
+    // Bounds, edges and index lists freed at the end of Build()
+    size_t buildScratchBytes = 0;
 };
 
-Integrator *CreateSAHNestedKDSPPMIntegrator(
-    const ParamSet &params,
-                                   std::shared_ptr<const Camera> camera);
+SPPMAccelerator *CreateSAHNestedKDAccelerator(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings);
 
 }  // namespace pbrt
 #endif
\ No newline at end of file
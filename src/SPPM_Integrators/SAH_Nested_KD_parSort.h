@@ -4,12 +4,13 @@
 #pragma once
 #endif
 
-#ifndef SAHNESTEDKDPARSPPMINTEGRATOR_H
-#define SAHNESTEDKDPARSPPMINTEGRATOR_H
+#ifndef SAHNESTEDKDPARSORT_H
+#define SAHNESTEDKDPARSORT_H
 
-#include "camera.h"
-#include "film.h"
-#include "integrator.h"
+#include <memory>
+#include <vector>
+
+#include "SPPM_Integrators/accelerator.h"
 #include "pbrt.h"
 
 namespace pbrt {
@@ -18,52 +19,52 @@ struct KdAccelNode;
 struct BoundEdge;
 
 // SPPM Declarations
-class SAHNestedKDParSPPMIntegrator : public Integrator {
+class SAHNestedKDParAccelerator : public SPPMAccelerator {
   public:
-    // SPPMIntegrator Public Methods
-    SAHNestedKDParSPPMIntegrator(std::shared_ptr<const Camera> &camera,
-                              int nIterations, int photonsPerIteration,
-                              int maxDepth, Float initialSearchRadius,
-                              int writeFrequency)
-        : camera(camera),
-          initialSearchRadius(initialSearchRadius),
+    // SAHNestedKDParAccelerator Public Methods
+    SAHNestedKDParAccelerator(int photonsPerIteration, int nIterations,
+                              const SPPMKdTreeParams &kdParams)
+        : photonsPerIteration(photonsPerIteration),
           nIterations(nIterations),
-          maxDepth(maxDepth),
-          photonsPerIteration(photonsPerIteration > 0
-                                  ? photonsPerIteration
-                                  : camera->film->croppedPixelBounds.Area()),
-          writeFrequency(writeFrequency) {}
-    void Render(const Scene &scene);
+          kdParams(kdParams) {}
+    ~SAHNestedKDParAccelerator();
+    void Build(const std::vector<SPPMPixel *> &pixels);
+    int Query(const Point3f &p, SPPMPixelVisitor func) const;
+    size_t BytesUsed() const;
+    size_t PeakBytesUsed() const;
+    std::vector<std::pair<std::string, double>> Shape() const;
+    void VisitNodes(
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
 
   private:
-    // SPPMIntegrator Private Data
-    std::shared_ptr<const Camera> camera;
-    const Float initialSearchRadius;
-    const int nIterations;
-    const int maxDepth;
-    const int photonsPerIteration;
-    const int writeFrequency;
-    // KDtree
+    // SAHNestedKDParAccelerator Private Methods
+    void buildTree(int nodeNum, const Bounds3f &bounds,
+                   const std::vector<Bounds3f> &primBounds, int *primNums,
+                   int nprims, int depth,
+                   const std::unique_ptr<BoundEdge[]> edges[3], int *prims0,
+                   int *prims1, KdAccelNode *&nodes, int badRefines = 0);
 
-    int nextFreeNode;
-    int nAllocedNodes;
+    // SAHNestedKDParAccelerator Private Data
+    const int photonsPerIteration;
+    const int nIterations;
+    const SPPMKdTreeParams kdParams;
+    std::vector<SPPMPixel *> kdPixels;
+    KdAccelNode *nodes = nullptr;
+    int nextFreeNode = 0;
+    int nAllocedNodes = 0;
     int isectCost;
     int traversalCost;
     Float emptyBonus;
     int maxvis = 1;
-    float maxD;
-    std::vector<int> visPointsIndices;
+    int maxD = 0;
     Bounds3f bounds;
-
-    void buildTree(int nodeNum, const Bounds3f &bounds,
-                   const std::vector<Bounds3f> &primBounds, int *primNums,
-                   int nprims, int depth,
-                   const std::unique_ptr<BoundEdge[]> edges[3], int *prims0,
-                   int *prims1, KdAccelNode *&nodes, int badRefines = 0);
+    std::vector<int> visPointsIndices;
+    // Bounds, edges and index lists freed at the end of Build()
+    size_t buildScratchBytes = 0;
 };
 
-Integrator *CreateSAHNestedKDParSPPMIntegrator(
-    const ParamSet &params, std::shared_ptr<const Camera> camera);
+SPPMAccelerator *CreateSAHNestedKDParAccelerator(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings);
 
 }  // namespace pbrt
 #endif
\ No newline at end of file
@@ -0,0 +1,118 @@
+
+#include "SPPM_Integrators/SPPM_Capture.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+namespace pbrt {
+
+static const char captureMagic[8] = "SPPMCAP";
+static const uint32_t captureVersion = 1;
+
+bool WriteSPPMCapture(const std::string &filename,
+                      const SPPMCaptureHeader &header,
+                      const std::vector<SPPMCapturePoint> &points,
+                      const std::vector<SPPMCaptureHit> &hits) {
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        return false;
+    }
+    SPPMCaptureHeader h = header;
+    memcpy(h.magic, captureMagic, sizeof(h.magic));
+    h.version = captureVersion;
+    h.nPoints = points.size();
+    h.nHits = hits.size();
+    h.pad = 0;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(points.data(), sizeof(SPPMCapturePoint), points.size(),
+                     f) == points.size() &&
+              fwrite(hits.data(), sizeof(SPPMCaptureHit), hits.size(), f) ==
+                  hits.size();
+    if (fclose(f) != 0) ok = false;
+    if (!ok) Error("%s: error writing SPPM capture", filename.c_str());
+    return ok;
+}
+
+SPPMCapture::~SPPMCapture() {
+#ifdef PBRT_HAVE_MMAP
+    if (mapping) munmap(mapping, mappingLength);
+#endif
+}
+
+bool SPPMCapture::Open(const std::string &filename) {
+    const char *data = nullptr;
+    size_t len = 0;
+#ifdef PBRT_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat stat;
+    if (fstat(fd, &stat) != 0) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
+    len = stat.st_size;
+    if (len > 0) {
+        void *ptr = mmap(0, len, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) {
+            Error("%s: %s", filename.c_str(), strerror(errno));
+            close(fd);
+            return false;
+        }
+        mapping = ptr;
+        mappingLength = len;
+        data = (const char *)ptr;
+    }
+    close(fd);
+#else
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        return false;
+    }
+    char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        buffer.insert(buffer.end(), chunk, chunk + n);
+    fclose(f);
+    data = buffer.data();
+    len = buffer.size();
+#endif
+
+    // Validate the header and the section sizes
+    if (len < sizeof(SPPMCaptureHeader) ||
+        memcmp(data, captureMagic, sizeof(captureMagic)) != 0) {
+        Error("%s: not an SPPM capture file", filename.c_str());
+        return false;
+    }
+    header = (const SPPMCaptureHeader *)data;
+    if (header->version != captureVersion) {
+        Error("%s: unsupported SPPM capture version %u", filename.c_str(),
+              header->version);
+        return false;
+    }
+    uint64_t expected = sizeof(SPPMCaptureHeader) +
+                        header->nPoints * sizeof(SPPMCapturePoint) +
+                        header->nHits * sizeof(SPPMCaptureHit);
+    if (len < expected) {
+        Error("%s: truncated SPPM capture file", filename.c_str());
+        return false;
+    }
+    points = (const SPPMCapturePoint *)(data + sizeof(SPPMCaptureHeader));
+    hits = (const SPPMCaptureHit *)(points + header->nPoints);
+    return true;
+}
+
+}  // namespace pbrt
@@ -0,0 +1,82 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMCAPTURE_H
+#define SPPMCAPTURE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "pbrt.h"
+
+namespace pbrt {
+
+// One SPPM iteration captured with --sppmcapture, for replaying the
+// accelerator build and queries outside the renderer. The file holds a
+// SPPMCaptureHeader, then _nPoints_ SPPMCapturePoints and _nHits_
+// SPPMCaptureHits, all in native byte order.
+struct SPPMCaptureHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t iteration;
+    uint64_t nPoints, nHits;
+    float initialSearchRadius;
+    int32_t photonsPerIteration;
+    int32_t nIterations;
+    int32_t pad;
+};
+static_assert(sizeof(SPPMCaptureHeader) == 48,
+              "SPPMCaptureHeader should be 48 bytes");
+
+// A visible point: position, current search radius and the BxDFType bits
+// of the lobes its BSDF has
+struct SPPMCapturePoint {
+    float p[3];
+    float radius;
+    uint32_t bsdf;
+};
+
+// A photon intersection that the accelerator was (or would have been)
+// queried at
+struct SPPMCaptureHit {
+    float p[3];
+};
+
+bool WriteSPPMCapture(const std::string &filename,
+                      const SPPMCaptureHeader &header,
+                      const std::vector<SPPMCapturePoint> &points,
+                      const std::vector<SPPMCaptureHit> &hits);
+
+// Read-only view of a capture file, memory mapped where possible
+class SPPMCapture {
+  public:
+    SPPMCapture() {}
+    ~SPPMCapture();
+    SPPMCapture(const SPPMCapture &) = delete;
+    SPPMCapture &operator=(const SPPMCapture &) = delete;
+
+    // Returns false and reports an error if the file can't be read or
+    // isn't a capture
+    bool Open(const std::string &filename);
+
+    const SPPMCaptureHeader &Header() const { return *header; }
+    const SPPMCapturePoint *Points() const { return points; }
+    const SPPMCaptureHit *Hits() const { return hits; }
+
+  private:
+    // SPPMCapture Private Data
+    const SPPMCaptureHeader *header = nullptr;
+    const SPPMCapturePoint *points = nullptr;
+    const SPPMCaptureHit *hits = nullptr;
+    void *mapping = nullptr;
+    size_t mappingLength = 0;
+    std::vector<char> buffer;
+};
+
+}  // namespace pbrt
+
+#endif  // SPPMCAPTURE_H
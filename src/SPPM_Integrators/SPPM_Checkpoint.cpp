@@ -0,0 +1,167 @@
+
+#include "SPPM_Integrators/SPPM_Checkpoint.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+namespace pbrt {
+
+static const char checkpointMagic[8] = "SPPMCKP";
+static const uint32_t checkpointVersion = 2;
+
+bool WriteSPPMCheckpoint(const std::string &filename,
+                         const SPPMCheckpointHeader &header,
+                         const std::vector<SPPMCheckpointPixel> &pixels,
+                         const std::vector<uint64_t> &emissionCounts) {
+    std::string tmpFilename = filename + ".tmp";
+    FILE *f = fopen(tmpFilename.c_str(), "wb");
+    if (!f) {
+        Error("%s: %s", tmpFilename.c_str(), strerror(errno));
+        return false;
+    }
+    SPPMCheckpointHeader h = header;
+    memcpy(h.magic, checkpointMagic, sizeof(h.magic));
+    h.version = checkpointVersion;
+    h.floatSize = sizeof(Float);
+    h.nSpectrumSamples = Spectrum::nSamples;
+    uint64_t nCounts = emissionCounts.size();
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(pixels.data(), sizeof(SPPMCheckpointPixel),
+                     pixels.size(), f) == pixels.size() &&
+              fwrite(&nCounts, sizeof(nCounts), 1, f) == 1 &&
+              fwrite(emissionCounts.data(), sizeof(uint64_t), nCounts, f) ==
+                  nCounts;
+    if (fclose(f) != 0) ok = false;
+    if (ok && rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        return false;
+    }
+    if (!ok) Error("%s: error writing SPPM checkpoint", tmpFilename.c_str());
+    return ok;
+}
+
+// SPPMCheckpointWriter Method Definitions
+void SPPMCheckpointWriter::Write(const SPPMCheckpointHeader &header,
+                                 std::vector<SPPMCheckpointPixel> pixels,
+                                 std::vector<uint64_t> emissionCounts) {
+    Wait();
+    writer = std::thread(
+        [this, header](std::vector<SPPMCheckpointPixel> pixels,
+                       std::vector<uint64_t> emissionCounts) {
+            WriteSPPMCheckpoint(filename, header, pixels, emissionCounts);
+        },
+        std::move(pixels), std::move(emissionCounts));
+}
+
+void SPPMCheckpointWriter::Wait() {
+    if (writer.joinable()) writer.join();
+}
+
+// SPPMCheckpoint Method Definitions
+SPPMCheckpoint::~SPPMCheckpoint() {
+#ifdef PBRT_HAVE_MMAP
+    if (mapping) munmap(mapping, mappingLength);
+#endif
+}
+
+bool SPPMCheckpoint::Open(const std::string &filename) {
+    const char *data = nullptr;
+    size_t len = 0;
+#ifdef PBRT_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat stat;
+    if (fstat(fd, &stat) != 0) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
+    len = stat.st_size;
+    if (len > 0) {
+        void *ptr = mmap(0, len, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) {
+            Error("%s: %s", filename.c_str(), strerror(errno));
+            close(fd);
+            return false;
+        }
+        mapping = ptr;
+        mappingLength = len;
+        data = (const char *)ptr;
+    }
+    close(fd);
+#else
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        return false;
+    }
+    char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        buffer.insert(buffer.end(), chunk, chunk + n);
+    fclose(f);
+    data = buffer.data();
+    len = buffer.size();
+#endif
+
+    // Validate the header and the pixel count
+    if (len < sizeof(SPPMCheckpointHeader) ||
+        memcmp(data, checkpointMagic, sizeof(checkpointMagic)) != 0) {
+        Error("%s: not an SPPM checkpoint file", filename.c_str());
+        return false;
+    }
+    header = (const SPPMCheckpointHeader *)data;
+    if (header->version != 1 && header->version != checkpointVersion) {
+        Error("%s: unsupported SPPM checkpoint version %u", filename.c_str(),
+              header->version);
+        return false;
+    }
+    if (header->floatSize != sizeof(Float) ||
+        header->nSpectrumSamples != Spectrum::nSamples) {
+        Error("%s: SPPM checkpoint of a pbrt built with another Float or "
+              "Spectrum", filename.c_str());
+        return false;
+    }
+    uint64_t nPixels =
+        (uint64_t)(header->pixelBounds[1] - header->pixelBounds[0]) *
+        (header->pixelBounds[3] - header->pixelBounds[2]);
+    if (len < sizeof(SPPMCheckpointHeader) +
+                  nPixels * sizeof(SPPMCheckpointPixel)) {
+        Error("%s: truncated SPPM checkpoint file", filename.c_str());
+        return false;
+    }
+    pixels = (const SPPMCheckpointPixel *)(data + sizeof(SPPMCheckpointHeader));
+
+    // Read the emission guide counts that follow the pixels
+    emissionCounts.clear();
+    if (header->version == 1) return true;
+    size_t countsStart = sizeof(SPPMCheckpointHeader) +
+                         nPixels * sizeof(SPPMCheckpointPixel);
+    uint64_t nCounts;
+    if (len < countsStart + sizeof(nCounts)) {
+        Error("%s: truncated SPPM checkpoint file", filename.c_str());
+        return false;
+    }
+    memcpy(&nCounts, data + countsStart, sizeof(nCounts));
+    if ((len - countsStart - sizeof(nCounts)) / sizeof(uint64_t) < nCounts) {
+        Error("%s: truncated SPPM checkpoint file", filename.c_str());
+        return false;
+    }
+    emissionCounts.resize(nCounts);
+    memcpy(emissionCounts.data(), data + countsStart + sizeof(nCounts),
+           nCounts * sizeof(uint64_t));
+    return true;
+}
+
+}  // namespace pbrt
@@ -0,0 +1,105 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMCHECKPOINT_H
+#define SPPMCHECKPOINT_H
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pbrt.h"
+#include "spectrum.h"
+
+namespace pbrt {
+
+// The state of an SPPM render between two iterations, written with
+// --sppmcheckpoint and read back with --resume. The file holds an
+// SPPMCheckpointHeader followed by one SPPMCheckpointPixel per pixel of
+// the cropped image, in scanline order, and by the uint64_t count and
+// values of the emission guide's counts, all in native byte order.
+// Version 1 files, which predate the guide counts, are still read.
+struct SPPMCheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    // sizeof(Float) and Spectrum::nSamples of the writer
+    int32_t floatSize, nSpectrumSamples;
+    // x0, x1, y0, y1 of the cropped image
+    int32_t pixelBounds[4];
+    int32_t photonsPerIteration, nIterations;
+    // Iterations done, and photons shot by them: the Halton index of the
+    // next photon
+    int32_t iterations;
+    uint64_t photonsShot;
+};
+static_assert(sizeof(SPPMCheckpointHeader) == 56,
+              "SPPMCheckpointHeader should be 56 bytes");
+
+struct SPPMCheckpointPixel {
+    Float radius, N;
+    Float Ld[Spectrum::nSamples], tau[Spectrum::nSamples];
+};
+
+bool WriteSPPMCheckpoint(
+    const std::string &filename, const SPPMCheckpointHeader &header,
+    const std::vector<SPPMCheckpointPixel> &pixels,
+    const std::vector<uint64_t> &emissionCounts = std::vector<uint64_t>());
+
+// Writes checkpoints on a background thread, so that the render continues
+// while the file is written. Each file is written next to _filename_ and
+// then renamed over it, so that a render killed mid-write leaves the
+// previous checkpoint intact.
+class SPPMCheckpointWriter {
+  public:
+    SPPMCheckpointWriter(const std::string &filename) : filename(filename) {}
+    ~SPPMCheckpointWriter() { Wait(); }
+
+    // Waits for the previous write, then starts writing _pixels_ and
+    // _emissionCounts_
+    void Write(const SPPMCheckpointHeader &header,
+               std::vector<SPPMCheckpointPixel> pixels,
+               std::vector<uint64_t> emissionCounts = std::vector<uint64_t>());
+    void Wait();
+
+  private:
+    // SPPMCheckpointWriter Private Data
+    const std::string filename;
+    std::thread writer;
+};
+
+// Read-only view of a checkpoint file, memory mapped where possible
+class SPPMCheckpoint {
+  public:
+    SPPMCheckpoint() {}
+    ~SPPMCheckpoint();
+    SPPMCheckpoint(const SPPMCheckpoint &) = delete;
+    SPPMCheckpoint &operator=(const SPPMCheckpoint &) = delete;
+
+    // Returns false and reports an error if the file can't be read or
+    // isn't a checkpoint of this build's Float and Spectrum
+    bool Open(const std::string &filename);
+
+    const SPPMCheckpointHeader &Header() const { return *header; }
+    const SPPMCheckpointPixel *Pixels() const { return pixels; }
+    // Counts of the emission guide; empty if the render had none
+    const std::vector<uint64_t> &EmissionCounts() const {
+        return emissionCounts;
+    }
+
+  private:
+    // SPPMCheckpoint Private Data
+    const SPPMCheckpointHeader *header = nullptr;
+    const SPPMCheckpointPixel *pixels = nullptr;
+    void *mapping = nullptr;
+    size_t mappingLength = 0;
+    std::vector<char> buffer;
+    std::vector<uint64_t> emissionCounts;
+};
+
+}  // namespace pbrt
+
+#endif  // SPPMCHECKPOINT_H
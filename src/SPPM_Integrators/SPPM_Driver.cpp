@@ -0,0 +1,1058 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// integrators/sppm.cpp*
+#include "SPPM_Integrators/SPPM_Driver.h"
+#include "SPPM_Integrators/Occupancy_Mask.h"
+#include "SPPM_Integrators/SPPM_Capture.h"
+#include "SPPM_Integrators/SPPM_Checkpoint.h"
+#include "SPPM_Integrators/SPPM_Emission.h"
+#include "SPPM_Integrators/SPPM_LookupCost.h"
+#include "SPPM_Integrators/SPPM_Memory.h"
+#include "SPPM_Integrators/SPPM_OutOfCore.h"
+#include "SPPM_Integrators/SPPM_PhotonSampler.h"
+#include "SPPM_Integrators/SPPM_Pixel.h"
+#include "SPPM_Integrators/SPPM_Shards.h"
+#include "SPPM_Integrators/SPPM_Telemetry.h"
+#include "SPPM_Integrators/SPPM_TimeBudget.h"
+#include "SPPM_Integrators/SPPM_Tuning.h"
+#include "imageio.h"
+#include "interaction.h"
+#include "parallel.h"
+#include "paramset.h"
+#include "parser.h"
+#include "progressreporter.h"
+#include "reflection.h"
+#include "rng.h"
+#include "samplers/halton.h"
+#include "sampling.h"
+#include "scene.h"
+#include "spectrum.h"
+#include "stats.h"
+#include "timeline.h"
+
+namespace pbrt {
+
+STAT_RATIO(
+    "Stochastic Progressive Photon Mapping/Visible points checked per photon "
+    "intersection",
+    visiblePointsChecked, totalPhotonSurfaceInteractions);
+STAT_COUNTER("Stochastic Progressive Photon Mapping/Photon paths followed",
+             photonPaths);
+STAT_MEMORY_COUNTER("Memory/SPPM Pixels", pixelMemoryBytes);
+STAT_FLOAT_DISTRIBUTION("Memory/SPPM BSDF and Grid Memory", memoryArenaMB);
+STAT_PERCENT(
+    "Stochastic Progressive Photon Mapping/Photon hits rejected by occupancy "
+    "mask",
+    occupancyRejected, occupancyTests);
+STAT_PERCENT(
+    "Stochastic Progressive Photon Mapping/Photon paths that reach a visible "
+    "point",
+    usefulPhotonPaths, tracedPhotonPaths);
+
+// Returns false for photon hits in cells that no visible point overlaps
+static bool ConsultOccupancy(const OccupancyMask &mask, const Point3f &p) {
+    ++occupancyTests;
+    if (mask.Occupied(p)) return true;
+    ++occupancyRejected;
+    return false;
+}
+
+// Returns the BxDFType bits of the lobes _bsdf_ has
+static uint32_t BSDFLobes(const BSDF &bsdf) {
+    uint32_t lobes = 0;
+    for (BxDFType lobe : {BSDF_DIFFUSE, BSDF_GLOSSY, BSDF_SPECULAR})
+        if (bsdf.NumComponents(
+                BxDFType(lobe | BSDF_REFLECTION | BSDF_TRANSMISSION)) > 0)
+            lobes |= lobe;
+    for (BxDFType side : {BSDF_REFLECTION, BSDF_TRANSMISSION})
+        if (bsdf.NumComponents(BxDFType(side | BSDF_DIFFUSE | BSDF_GLOSSY |
+                                        BSDF_SPECULAR)) > 0)
+            lobes |= side;
+    return lobes;
+}
+
+// Gathers the pixels that hold a visible point into _active_, in pixel
+// order, with a parallel stream compaction: every chunk of pixels counts
+// its visible points, an exclusive prefix sum over the counts gives each
+// chunk its offset in _active_, and the chunks then write their pointers
+// there in parallel
+static void CompactActivePixels(SPPMPixel *pixels,
+                                const SPPMPixelCold *coldPixels, int nPixels,
+                                std::vector<SPPMPixel *> *active) {
+    const int chunkSize = 4096;
+    int nChunks = (nPixels + chunkSize - 1) / chunkSize;
+    std::vector<int> offsets(nChunks + 1, 0);
+    ParallelFor(
+        [&](int64_t chunk) {
+            int start = chunk * chunkSize;
+            int end = std::min(nPixels, start + chunkSize);
+            int n = 0;
+            for (int i = start; i < end; ++i)
+                if (!coldPixels[i].beta.IsBlack()) ++n;
+            offsets[chunk + 1] = n;
+        },
+        nChunks);
+    for (int chunk = 0; chunk < nChunks; ++chunk)
+        offsets[chunk + 1] += offsets[chunk];
+    active->resize(offsets[nChunks]);
+    ParallelFor(
+        [&](int64_t chunk) {
+            int start = chunk * chunkSize;
+            int end = std::min(nPixels, start + chunkSize);
+            SPPMPixel **out = active->data() + offsets[chunk];
+            for (int i = start; i < end; ++i)
+                if (!coldPixels[i].beta.IsBlack()) *out++ = &pixels[i];
+        },
+        nChunks);
+}
+
+// SPPM Method Definitions
+void AcceleratedSPPMIntegrator::Render(const Scene &scene) {
+    SPPMTelemetry telemetry(acceleratorName + "_sppm");
+    ProfilePhase p(Prof::IntegratorRender);
+    // Initialize _pixelBounds_ and _pixels_ array for SPPM
+    Bounds2i pixelBounds = camera->film->croppedPixelBounds;
+    int nPixels = pixelBounds.Area();
+    SPPMMemoryTracker memory((size_t)PbrtOptions.sppmMemoryBudgetMB << 20);
+    size_t pixelBytes = nPixels * (sizeof(SPPMPixel) + sizeof(SPPMPixelCold));
+    // Out of core, the pixels live in scratch files the system pages out
+    bool outOfCore = outOfCoreMemory > 0;
+    memory.Update(SPPMMemoryComponent::Pixels, outOfCore ? 0 : pixelBytes);
+    SPPMMappedArray<SPPMPixel> pixels(nPixels, outOfCore);
+    SPPMMappedArray<SPPMPixelCold> coldPixels(nPixels, outOfCore);
+    std::unique_ptr<SPPMBricks> bricks;
+    if (outOfCore) bricks.reset(new SPPMBricks(outOfCoreMemory, maxDepth));
+    for (int i = 0; i < nPixels; ++i) pixels[i].radius = initialSearchRadius;
+    const Float invSqrtSPP = 1.f / std::sqrt(nIterations);
+    pixelMemoryBytes = pixelBytes;
+    // Compute _lightDistr_ for sampling lights proportional to power
+    std::unique_ptr<Distribution1D> lightDistr =
+        ComputeLightPowerDistribution(scene);
+    std::unique_ptr<SPPMEmissionGuide> emission;
+    if (adaptiveEmission && lightDistr)
+        emission.reset(new SPPMEmissionGuide(*lightDistr));
+
+    // Perform _nIterations_ of SPPM integration
+    HaltonSampler sampler(nIterations, pixelBounds);
+
+    // Compute number of tiles to use for SPPM camera pass
+    Vector2i pixelExtent = pixelBounds.Diagonal();
+    const int tileSize = 16;
+    Point2i nTiles((pixelExtent.x + tileSize - 1) / tileSize,
+                   (pixelExtent.y + tileSize - 1) / tileSize);
+    // With a time limit, the progress is the share of the budget used
+    int64_t budgetMS = timeLimit > 0 ? (int64_t)(timeLimit * 1000) : 0;
+    ProgressReporter progress(budgetMS > 0 ? budgetMS : 2 * nIterations,
+                              "Rendering");
+    int64_t progressMS = 0;
+    auto updateProgress = [&]() {
+        if (budgetMS == 0) {
+            progress.Update();
+            return;
+        }
+        int64_t ms = std::min(budgetMS, (int64_t)progress.ElapsedMS());
+        progress.Update(ms - progressMS);
+        progressMS = ms;
+    };
+    std::vector<MemoryArena> perThreadArenas(MaxThreadIndex());
+
+    // Pick the iteration to write with --sppmcapture
+    int captureIteration = -1;
+    if (!PbrtOptions.sppmCaptureFile.empty())
+        captureIteration = PbrtOptions.sppmCaptureIteration < 0
+                               ? nIterations - 1
+                               : std::min(PbrtOptions.sppmCaptureIteration,
+                                          nIterations - 1);
+
+    // Gather lookup-cost diagnostics, if requested
+    std::unique_ptr<SPPMLookupCost> lookupCost;
+    if (getenv("SPPM_COST")) lookupCost.reset(new SPPMLookupCost(nPixels));
+
+    // Pixels with a visible point this iteration; the accelerator build,
+    // the photon pass and the pixel update only look at these
+    std::vector<SPPMPixel *> activePixels;
+    // With a time limit, iterate until the budget is used, adapting the
+    // photons of the last iteration to the time left
+    SPPMTimeBudget budget(timeLimit, photonsPerIteration);
+    int iterPhotons = photonsPerIteration, nIterationsDone = 0;
+    // Photons shot by the iterations before this one
+    uint64_t photonsShot = 0;
+    std::string timeLimitSummary;
+
+    // Continue from the --sppmcheckpoint file with --resume. Pixels keep
+    // only their radius, $N$, $\tau$ and direct lighting between
+    // iterations, and the camera and photon samples depend only on the
+    // iteration and the photons shot before it, so the resumed render
+    // matches an uninterrupted one.
+    int firstIteration = 0;
+    const std::string &checkpointFile = PbrtOptions.sppmCheckpointFile;
+    if (PbrtOptions.sppmResume && !checkpointFile.empty()) {
+        FILE *f = fopen(checkpointFile.c_str(), "rb");
+        if (!f)
+            Warning("%s: no SPPM checkpoint to resume from; starting over",
+                    checkpointFile.c_str());
+        else {
+            fclose(f);
+            SPPMCheckpoint checkpoint;
+            if (!checkpoint.Open(checkpointFile)) exit(1);
+            const SPPMCheckpointHeader &header = checkpoint.Header();
+            if (header.pixelBounds[0] != pixelBounds.pMin.x ||
+                header.pixelBounds[1] != pixelBounds.pMax.x ||
+                header.pixelBounds[2] != pixelBounds.pMin.y ||
+                header.pixelBounds[3] != pixelBounds.pMax.y ||
+                header.photonsPerIteration != photonsPerIteration ||
+                header.nIterations != nIterations) {
+                Error("%s: SPPM checkpoint of a render with other pixel "
+                      "bounds, photons per iteration or iterations",
+                      checkpointFile.c_str());
+                exit(1);
+            }
+            const SPPMCheckpointPixel *saved = checkpoint.Pixels();
+            ParallelFor(
+                [&](int i) {
+                    pixels[i].radius = saved[i].radius;
+                    coldPixels[i].N = saved[i].N;
+                    for (int c = 0; c < Spectrum::nSamples; ++c) {
+                        coldPixels[i].Ld[c] = saved[i].Ld[c];
+                        coldPixels[i].tau[c] = saved[i].tau[c];
+                    }
+                },
+                nPixels, 4096);
+            if (emission && !emission->Restore(checkpoint.EmissionCounts()))
+                Warning("%s: SPPM checkpoint has no matching emission guide; "
+                        "resuming unguided", checkpointFile.c_str());
+            firstIteration = header.iterations;
+            photonsShot = header.photonsShot;
+            if (budgetMS == 0) progress.Update(2 * firstIteration);
+            LOG(INFO) << "Resuming SPPM render at iteration "
+                      << firstIteration << " from " << checkpointFile;
+        }
+    }
+    SPPMCheckpointWriter checkpointWriter(checkpointFile);
+
+    // Split the photon passes across processes with --sppmshards. Workers
+    // run every iteration the coordinator plans and write nothing.
+    std::unique_ptr<SPPMPhotonShards> shards;
+    if (!PbrtOptions.sppmWorkerSocket.empty()) {
+        shards = ConnectSPPMShardCoordinator(PbrtOptions.sppmWorkerSocket);
+        if (!shards) exit(1);
+    } else if (PbrtOptions.sppmShards > 1) {
+        shards = StartSPPMShardWorkers(PbrtOptions.sppmShards,
+                                       PbrtOptions.commandLine,
+                                       PbrtOptions.nThreads);
+        if (!shards) exit(1);
+    }
+    bool worker = shards && shards->IsWorker();
+
+    for (int iter = firstIteration;
+         worker || timeLimit > 0 || iter < nIterations; ++iter) {
+        // Agree on this iteration's photons and this process' share of them
+        int shardBegin = 0, shardEnd = iterPhotons;
+        if (shards) {
+            SPPMShardPlan plan = {iter, iterPhotons, photonsShot, 0, 0};
+            if (!shards->ExchangePlan(&plan)) {
+                Error("SPPM photon shards: lost connection");
+                exit(1);
+            }
+            if (plan.iteration < 0) break;
+            if (plan.iteration != iter || plan.photonsShot != photonsShot) {
+                Error("SPPM shard worker at iteration %d, coordinator at %d",
+                      iter, plan.iteration);
+                exit(1);
+            }
+            iterPhotons = plan.photons;
+            shardBegin = plan.begin;
+            shardEnd = plan.end;
+        }
+        Float iterationStartMS = progress.ElapsedMS();
+        telemetry.BeginIteration(iter);
+        // Generate SPPM visible points
+        {
+            ProfilePhase _(Prof::SPPMCameraPass);
+            SPPMPhaseTimer timer(telemetry, SPPMPhase::CameraPass);
+            ParallelFor2D(
+                [&](Point2i tile) {
+                    MemoryArena &arena = perThreadArenas[ThreadIndex];
+                    // Follow camera paths for _tile_ in image for SPPM
+                    int tileIndex = tile.y * nTiles.x + tile.x;
+                    std::unique_ptr<Sampler> tileSampler =
+                        sampler.Clone(tileIndex);
+
+                    // Compute _tileBounds_ for SPPM tile
+                    int x0 = pixelBounds.pMin.x + tile.x * tileSize;
+                    int x1 = std::min(x0 + tileSize, pixelBounds.pMax.x);
+                    int y0 = pixelBounds.pMin.y + tile.y * tileSize;
+                    int y1 = std::min(y0 + tileSize, pixelBounds.pMax.y);
+                    Bounds2i tileBounds(Point2i(x0, y0), Point2i(x1, y1));
+                    for (Point2i pPixel : tileBounds) {
+                        // Prepare _tileSampler_ for _pPixel_
+                        tileSampler->StartPixel(pPixel);
+                        tileSampler->SetSampleNumber(iter);
+
+                        // Generate camera ray for pixel for SPPM
+                        CameraSample cameraSample =
+                            tileSampler->GetCameraSample(pPixel);
+                        RayDifferential ray;
+                        Spectrum beta =
+                            camera->GenerateRayDifferential(cameraSample, &ray);
+                        if (beta.IsBlack()) continue;
+                        ray.ScaleDifferentials(invSqrtSPP);
+
+                        // Follow camera ray path until a visible point is
+                        // created
+
+                        // Get _SPPMPixel_ for _pPixel_
+                        Point2i pPixelO = Point2i(pPixel - pixelBounds.pMin);
+                        int pixelOffset =
+                            pPixelO.x + pPixelO.y * (pixelBounds.pMax.x -
+                                                     pixelBounds.pMin.x);
+                        SPPMPixel &pixel = pixels[pixelOffset];
+                        SPPMPixelCold &cold = coldPixels[pixelOffset];
+                        bool specularBounce = false;
+                        for (int depth = 0; depth < maxDepth; ++depth) {
+                            SurfaceInteraction isect;
+                            ++totalPhotonSurfaceInteractions;
+                            if (!scene.Intersect(ray, &isect)) {
+                                // Accumulate light contributions for ray with
+                                // no intersection
+                                for (const auto &light : scene.lights)
+                                    cold.Ld += beta * light->Le(ray);
+                                break;
+                            }
+                            // Process SPPM camera ray intersection
+
+                            // Compute BSDF at SPPM camera ray intersection
+                            isect.ComputeScatteringFunctions(ray, arena, true);
+                            if (!isect.bsdf) {
+                                ray = isect.SpawnRay(ray.d);
+                                --depth;
+                                continue;
+                            }
+                            const BSDF &bsdf = *isect.bsdf;
+
+                            // Accumulate direct illumination at SPPM camera ray
+                            // intersection
+                            Vector3f wo = -ray.d;
+                            if (depth == 0 || specularBounce)
+                                cold.Ld += beta * isect.Le(wo);
+                            cold.Ld +=
+                                beta * UniformSampleOneLight(
+                                           isect, scene, arena, *tileSampler);
+
+                            // Possibly create visible point and end camera path
+                            bool isDiffuse =
+                                bsdf.NumComponents(
+                                    BxDFType(BSDF_DIFFUSE | BSDF_REFLECTION |
+                                             BSDF_TRANSMISSION)) > 0;
+                            bool isGlossy = bsdf.NumComponents(BxDFType(
+                                                BSDF_GLOSSY | BSDF_REFLECTION |
+                                                BSDF_TRANSMISSION)) > 0;
+                            if (isDiffuse ||
+                                (isGlossy && depth == maxDepth - 1)) {
+                                pixel.vp = {isect.p, wo, &bsdf};
+                                cold.beta = beta;
+                                break;
+                            }
+
+                            // Spawn ray from SPPM camera path vertex
+                            if (depth < maxDepth - 1) {
+                                Float pdf;
+                                Vector3f wi;
+                                BxDFType type;
+                                Spectrum f =
+                                    bsdf.Sample_f(wo, &wi, tileSampler->Get2D(),
+                                                  &pdf, BSDF_ALL, &type);
+                                if (pdf == 0. || f.IsBlack()) break;
+                                specularBounce = (type & BSDF_SPECULAR) != 0;
+                                beta *= f * AbsDot(wi, isect.shading.n) / pdf;
+                                if (beta.y() < 0.25) {
+                                    Float continueProb =
+                                        std::min((Float)1, beta.y());
+                                    if (tileSampler->Get1D() > continueProb)
+                                        break;
+                                    beta /= continueProb;
+                                }
+                                ray = (RayDifferential)isect.SpawnRay(wi);
+                            }
+                        }
+                    }
+                },
+                nTiles);
+        }
+        updateProgress();
+        size_t cameraArenaBytes = 0;
+        for (const MemoryArena &arena : perThreadArenas)
+            cameraArenaBytes += arena.TotalAllocated();
+        memory.Update(SPPMMemoryComponent::CameraArenas, cameraArenaBytes);
+        ReportValue(memoryArenaMB, cameraArenaBytes / (1024.f * 1024.f));
+
+        telemetry.BeginPhase(SPPMPhase::Build);
+        // Build the accelerator over the pixels that have a visible point
+        CompactActivePixels(pixels.get(), coldPixels.get(), nPixels,
+                            &activePixels);
+        int nActive = activePixels.size();
+        memory.Update(SPPMMemoryComponent::VisiblePointList,
+                      activePixels.capacity() * sizeof(SPPMPixel *));
+        OccupancyMask occupancy;
+        {
+            ProfilePhase _(Prof::SPPMGridConstruction);
+            // Mark the cells around visible points in the occupancy mask
+            occupancy.Build(nActive, [&](int i) {
+                return activePixels[i]->WorldBound();
+            });
+            {
+                TimelineScope build("Accelerator build", "build", "points",
+                                    nActive);
+                // Out of core, the bricks get their accelerators in the
+                // photon pass, from the budget that the visible point list
+                // and the occupancy mask leave
+                if (bricks) {
+                    size_t residentBytes =
+                        activePixels.capacity() * sizeof(SPPMPixel *) +
+                        occupancy.BytesUsed();
+                    bricks->Build(activePixels, pixels.get(), residentBytes);
+                } else {
+                    // Build each copy with the threads of the node that
+                    // queries it, so that its pages are allocated there
+                    RunOnNumaNode(0,
+                                  [&]() { accelerator->Build(activePixels); });
+                    for (size_t k = 0; k < numaReplicas.size(); ++k)
+                        RunOnNumaNode(k + 1, [&]() {
+                            numaReplicas[k]->Build(activePixels);
+                        });
+                }
+            }
+        }
+        telemetry.EndPhase(SPPMPhase::Build);
+        memory.Update(SPPMMemoryComponent::OccupancyMask,
+                      occupancy.BytesUsed());
+        if (bricks)
+            telemetry.SetStructure(bricks->MappedBytes(), bricks->Shape());
+        else {
+            memory.Update(SPPMMemoryComponent::Accelerator,
+                          accelerator->BytesUsed() * (1 + numaReplicas.size()),
+                          accelerator->PeakBytesUsed() *
+                              (1 + numaReplicas.size()));
+            SPPMAcceleratorStats stats =
+                ReportSPPMAcceleratorStats(*accelerator, nActive);
+            std::vector<std::pair<std::string, double>> shape =
+                accelerator->Shape();
+            if (stats.nodes > 0) {
+                shape.push_back({"leaves", (double)stats.leaves});
+                shape.push_back({"maxLeafDepth", (double)stats.maxDepth});
+                shape.push_back({"meanLeafDepth", stats.meanDepth});
+                shape.push_back({"duplication", stats.duplication});
+                if (stats.sahCost >= 0)
+                    shape.push_back({"sahCost", stats.sahCost});
+            }
+            telemetry.SetStructure(accelerator->BytesUsed(), shape);
+        }
+        if (lookupCost) lookupCost->SetWorldBound(occupancy.WorldBound());
+
+        // Record this iteration's visible points and photon hits, if
+        // requested
+        bool capture = iter == captureIteration;
+        std::vector<SPPMCapturePoint> capturePoints;
+        std::vector<std::vector<SPPMCaptureHit>> captureHits;
+        if (capture) {
+            capturePoints.resize(nActive);
+            for (int i = 0; i < nActive; ++i) {
+                const SPPMPixel &pixel = *activePixels[i];
+                SPPMCapturePoint &cp = capturePoints[i];
+                for (int c = 0; c < 3; ++c) cp.p[c] = pixel.vp.p[c];
+                cp.radius = pixel.radius;
+                cp.bsdf = BSDFLobes(*pixel.vp.bsdf);
+            }
+            captureHits.resize(MaxThreadIndex());
+        }
+
+        telemetry.BeginPhase(SPPMPhase::PhotonPass);
+        // Trace photons and accumulate contributions
+        {
+            ProfilePhase _(Prof::SPPMPhotonPass);
+            std::vector<MemoryArena> photonShootArenas(MaxThreadIndex());
+            // A photon uses one sample for the light, five to leave it and
+            // three per bounce
+            std::vector<SPPMPhotonSampler> photonSamplers(
+                MaxThreadIndex(),
+                SPPMPhotonSampler(photonSequence, 6 + 3 * maxDepth));
+            // Look up the visible points near hits kept for the bricks
+            auto queryHits = [&](const SPPMPhotonHit *hits, int nHits) {
+                SPPMTelemetry::ThreadCounters &counters = telemetry.Counters();
+                const SPPMPhotonHit *hit = nullptr;
+                auto deposit = [&](SPPMPixel *pixel) {
+                    Spectrum Phi =
+                        hit->beta * pixel->vp.bsdf->f(pixel->vp.wo, hit->wi);
+                    pixel->AddFlux(Phi);
+                    ++pixel->M;
+                    ++counters.deposits;
+                    if (lookupCost)
+                        lookupCost->FoundBuffer().push_back(pixel -
+                                                            pixels.get());
+                };
+                for (int i = 0; i < nHits; ++i) {
+                    hit = &hits[i];
+                    int checked = accelerator->Query(hit->p, deposit);
+                    visiblePointsChecked += checked;
+                    counters.candidates += checked;
+                    if (lookupCost) lookupCost->AddQuery(hit->p, checked);
+                }
+            };
+            // Out of core, trace the photons in batches whose hits fit in
+            // the memory budget, and look them up brick by brick. When a
+            // thread's hit buffer fills up before the batch ends, the hits
+            // so far are looked up and the photons not yet traced, in
+            // _pending_, go next.
+            int batchBegin = shardBegin, batchEnd = shardBegin;
+            std::vector<int> pending;
+            std::vector<std::vector<int>> deferred(MaxThreadIndex());
+            while (batchEnd < shardEnd || !pending.empty()) {
+                if (pending.empty()) {
+                    batchBegin = batchEnd;
+                    batchEnd = bricks
+                                   ? bricks->NextBatchEnd(batchBegin, shardEnd)
+                                   : shardEnd;
+                    for (SPPMPhotonSampler &sampler : photonSamplers)
+                        sampler.StartBatch(photonsShot + batchBegin,
+                                           photonsShot + batchEnd);
+                }
+                int nTraced =
+                    pending.empty() ? batchEnd - batchBegin : pending.size();
+                ParallelFor(
+                    [&](int batchPhoton) {
+                        int photonIndex = pending.empty()
+                                              ? batchBegin + batchPhoton
+                                              : pending[batchPhoton];
+                        if (bricks && !bricks->HasRoom()) {
+                            deferred[ThreadIndex].push_back(photonIndex);
+                            return;
+                        }
+                        // Where this path's hits start, so they can be
+                        // dropped if the path doesn't fit in the buffers
+                        size_t pathStart = bricks ? bricks->PathStart() : 0;
+                        size_t captureStart =
+                            capture ? captureHits[ThreadIndex].size() : 0;
+                        MemoryArena &arena = photonShootArenas[ThreadIndex];
+                        SPPMTelemetry::ThreadCounters &counters =
+                            telemetry.Counters();
+                        // Follow photon path for _photonIndex_
+                        int node = ThreadNumaNode();
+                        SPPMAccelerator *nodeAccelerator =
+                            node > 0 && node <= (int)numaReplicas.size()
+                                ? numaReplicas[node - 1].get()
+                                : accelerator.get();
+                        SPPMPhotonSampler &sampler =
+                            photonSamplers[ThreadIndex];
+                        sampler.StartPhoton(photonsShot + photonIndex);
+                        int sampleDim = 0;
+
+                        // Choose light to shoot photon from
+                        Float lightPdf;
+                        Float lightSample = sampler.Get(sampleDim++);
+                        int lightNum =
+                            emission
+                                ? emission->SampleLight(lightSample, &lightPdf)
+                                : lightDistr->SampleDiscrete(lightSample,
+                                                             &lightPdf);
+                        const std::shared_ptr<Light> &light =
+                            scene.lights[lightNum];
+
+                        // Compute sample values for photon ray leaving light
+                        // source
+                        Point2f uLight0(sampler.Get(sampleDim),
+                                        sampler.Get(sampleDim + 1));
+                        Point2f uLight1(sampler.Get(sampleDim + 2),
+                                        sampler.Get(sampleDim + 3));
+                        Float uLightTime =
+                            Lerp(sampler.Get(sampleDim + 4),
+                                 camera->shutterOpen, camera->shutterClose);
+                        sampleDim += 5;
+                        // Warp the light samples toward useful emission
+                        int emissionBins[2] = {0, 0};
+                        Float emissionPdf = 1;
+                        if (emission) {
+                            Float pdf0, pdf1;
+                            uLight0 = emission->SampleEmission(
+                                lightNum, 0, uLight0, &emissionBins[0], &pdf0);
+                            uLight1 = emission->SampleEmission(
+                                lightNum, 1, uLight1, &emissionBins[1], &pdf1);
+                            emissionPdf = pdf0 * pdf1;
+                        }
+                        bool useful = false;
+                        auto recordEmission = [&]() {
+                            ++tracedPhotonPaths;
+                            if (useful) ++usefulPhotonPaths;
+                            if (emission)
+                                emission->Record(lightNum, emissionBins,
+                                                 useful);
+                        };
+
+                        // Generate _photonRay_ from light source and initialize
+                        // _beta_
+                        RayDifferential photonRay;
+                        Normal3f nLight;
+                        Float pdfPos, pdfDir;
+                        Spectrum Le = light->Sample_Le(
+                            uLight0, uLight1, uLightTime, &photonRay, &nLight,
+                            &pdfPos, &pdfDir);
+                        if (pdfPos == 0 || pdfDir == 0 || Le.IsBlack()) {
+                            recordEmission();
+                            return;
+                        }
+                        Spectrum beta =
+                            (AbsDot(nLight, photonRay.d) * Le) /
+                            (lightPdf * pdfPos * pdfDir * emissionPdf);
+                        if (beta.IsBlack()) {
+                            recordEmission();
+                            return;
+                        }
+
+                        // Update _pixel_ $\Phi$ and $M$ for a nearby photon
+                        // A stack lambda; Query() takes it by reference,
+                        // so no std::function is allocated per photon
+                        auto deposit = [&](SPPMPixel *pixel) {
+                            Vector3f wi = -photonRay.d;
+                            Spectrum Phi =
+                                beta * pixel->vp.bsdf->f(pixel->vp.wo, wi);
+                            pixel->AddFlux(Phi);
+                            ++pixel->M;
+                            ++counters.deposits;
+                            useful = true;
+                            if (lookupCost)
+                                lookupCost->FoundBuffer().push_back(
+                                    pixel - pixels.get());
+                        };
+
+                        // Follow photon path through scene and record
+                        // intersections
+                        SurfaceInteraction isect;
+                        bool overflow = false;
+                        for (int depth = 0; depth < maxDepth; ++depth) {
+                            if (!scene.Intersect(photonRay, &isect)) break;
+                            ++totalPhotonSurfaceInteractions;
+                            if (depth > 0 && capture)
+                                captureHits[ThreadIndex].push_back(
+                                    {{(float)isect.p.x, (float)isect.p.y,
+                                      (float)isect.p.z}});
+                            if (depth > 0 &&
+                                ConsultOccupancy(occupancy, isect.p)) {
+                                // Add photon contribution to nearby visible
+                                // points, or keep it for its brick; a kept
+                                // hit counts as useful, as it's near one
+                                if (bricks) {
+                                    overflow = !bricks->AddHit(
+                                        isect.p, -photonRay.d, beta);
+                                    if (overflow) break;
+                                    useful = true;
+                                } else {
+                                    int checked = nodeAccelerator->Query(
+                                        isect.p, deposit);
+                                    visiblePointsChecked += checked;
+                                    counters.candidates += checked;
+                                    if (lookupCost)
+                                        lookupCost->AddQuery(isect.p, checked);
+                                }
+                            }
+                            // Sample new photon ray direction
+
+                            // Compute BSDF at photon intersection point
+                            isect.ComputeScatteringFunctions(
+                                photonRay, arena, true,
+                                TransportMode::Importance);
+                            if (!isect.bsdf) {
+                                --depth;
+                                photonRay = isect.SpawnRay(photonRay.d);
+                                continue;
+                            }
+                            const BSDF &photonBSDF = *isect.bsdf;
+
+                            // Sample BSDF _fr_ and direction _wi_ for reflected
+                            // photon
+                            Vector3f wi, wo = -photonRay.d;
+                            Float pdf;
+                            BxDFType flags;
+
+                            // Generate _bsdfSample_ for outgoing photon sample
+                            Point2f bsdfSample(sampler.Get(sampleDim),
+                                               sampler.Get(sampleDim + 1));
+                            sampleDim += 2;
+                            Spectrum fr = photonBSDF.Sample_f(
+                                wo, &wi, bsdfSample, &pdf, BSDF_ALL, &flags);
+                            if (fr.IsBlack() || pdf == 0.f) break;
+                            Spectrum bnew =
+                                beta * fr * AbsDot(wi, isect.shading.n) / pdf;
+
+                            // Possibly terminate photon path with Russian
+                            // roulette
+                            Float q =
+                                std::max((Float)0, 1 - bnew.y() / beta.y());
+                            if (sampler.Get(sampleDim++) < q)
+                                break;
+                            beta = bnew / (1 - q);
+                            photonRay = (RayDifferential)isect.SpawnRay(wi);
+                        }
+                        arena.Reset();
+                        if (overflow) {
+                            // Trace the path again once the hits so far are
+                            // looked up
+                            bricks->DiscardPath(pathStart);
+                            if (capture)
+                                captureHits[ThreadIndex].resize(captureStart);
+                            deferred[ThreadIndex].push_back(photonIndex);
+                            return;
+                        }
+                        recordEmission();
+                    },
+                    nTraced, 8192);
+                pending.clear();
+                for (std::vector<int> &photons : deferred) {
+                    pending.insert(pending.end(), photons.begin(),
+                                   photons.end());
+                    photons.clear();
+                }
+                std::sort(pending.begin(), pending.end());
+                nTraced -= pending.size();
+                if (bricks)
+                    bricks->ProcessHits(accelerator.get(), nTraced, queryHits);
+            }
+            if (bricks) bricks->EndPass();
+
+            // Replace this process' flux with that of all the shards
+            if (shards) {
+                std::vector<SPPMFluxDelta> deltas(nActive);
+                memory.Update(SPPMMemoryComponent::ShardDeltas,
+                              nActive * sizeof(SPPMFluxDelta));
+                ParallelFor(
+                    [&](int i) {
+                        const SPPMPixel &p = *activePixels[i];
+                        for (int c = 0; c < SPPMPixel::nFluxSamples; ++c)
+                            deltas[i].Phi[c] = p.Phi[c];
+                        deltas[i].M = p.M;
+                    },
+                    nActive, 4096);
+                if (!shards->Merge(&deltas)) {
+                    Error("SPPM photon shards: lost connection");
+                    exit(1);
+                }
+                ParallelFor(
+                    [&](int i) {
+                        SPPMPixel &p = *activePixels[i];
+                        for (int c = 0; c < SPPMPixel::nFluxSamples; ++c)
+                            p.Phi[c] = deltas[i].Phi[c];
+                        p.M = deltas[i].M;
+                    },
+                    nActive, 4096);
+            }
+            updateProgress();
+            photonPaths += shardEnd - shardBegin;
+            photonsShot += iterPhotons;
+            if (emission) {
+                // Shards learn one guide from the counts of all photons
+                std::vector<uint64_t> newCounts = emission->NewCounts();
+                if (shards && !shards->MergeCounts(&newCounts)) {
+                    Error("SPPM photon shards: lost connection");
+                    exit(1);
+                }
+                emission->Update(newCounts);
+            }
+
+            // Out of core, the accelerator memory is that of the hits and
+            // the brick accelerators, which the bricks keep within the
+            // budget or exit with an error
+            if (bricks) {
+                memory.Update(SPPMMemoryComponent::Accelerator, 0,
+                              bricks->BytesUsed());
+                DCHECK_LE(bricks->PeakBytesUsed(), outOfCoreMemory);
+            }
+
+            // The photon arenas are freed at the end of the pass
+            size_t photonArenaBytes = 0;
+            for (const MemoryArena &arena : photonShootArenas)
+                photonArenaBytes += arena.TotalAllocated();
+            memory.Update(SPPMMemoryComponent::PhotonArenas, 0,
+                          photonArenaBytes);
+        }
+
+        telemetry.EndPhase(SPPMPhase::PhotonPass);
+
+        size_t captureBytes =
+            capturePoints.capacity() * sizeof(SPPMCapturePoint);
+        for (const std::vector<SPPMCaptureHit> &h : captureHits)
+            captureBytes += h.capacity() * sizeof(SPPMCaptureHit);
+        memory.Update(SPPMMemoryComponent::Capture, captureBytes);
+        if (capture) {
+            std::vector<SPPMCaptureHit> hits;
+            for (const std::vector<SPPMCaptureHit> &h : captureHits)
+                hits.insert(hits.end(), h.begin(), h.end());
+            SPPMCaptureHeader header;
+            header.iteration = iter;
+            header.initialSearchRadius = initialSearchRadius;
+            header.photonsPerIteration = photonsPerIteration;
+            header.nIterations = nIterations;
+            WriteSPPMCapture(PbrtOptions.sppmCaptureFile, header,
+                             capturePoints, hits);
+        }
+
+        // Update pixel values from this pass's photons
+        {
+            ProfilePhase _(Prof::SPPMStatsUpdate);
+            SPPMPhaseTimer timer(telemetry, SPPMPhase::StatsUpdate);
+            ParallelFor(
+                [&](int i) {
+                    SPPMPixel &p = *activePixels[i];
+                    SPPMPixelCold &cold = coldPixels[&p - pixels.get()];
+                    if (p.M > 0) {
+                        // Update pixel photon count, search radius, and $\tau$
+                        // from photons
+                        Float gamma = (Float)2 / (Float)3;
+                        Float Nnew = cold.N + gamma * p.M;
+                        Float Rnew =
+                            p.radius * std::sqrt(Nnew / (cold.N + p.M));
+                        cold.tau = (cold.tau + cold.beta * p.Flux()) *
+                                   (Rnew * Rnew) / (p.radius * p.radius);
+                        cold.N = Nnew;
+                        p.radius = Rnew;
+                        p.ResetFlux();
+                    }
+                    // Reset _VisiblePoint_ in pixel
+                    cold.beta = 0.;
+                    p.vp.bsdf = nullptr;
+                },
+                nActive, 4096);
+            telemetry.Counters().visiblePoints += nActive;
+        }
+
+        // Plan the next iteration, if the time limit leaves room for one
+        bool lastIteration = !worker && iter + 1 == nIterations;
+        if (timeLimit > 0 && !worker) {
+            Float iterationSeconds =
+                (progress.ElapsedMS() - iterationStartMS) / 1000;
+            Float photonSeconds =
+                telemetry.PhaseSeconds(SPPMPhase::PhotonPass);
+            int shot = iterPhotons;
+            budget.Record(shot, photonSeconds,
+                          iterationSeconds - photonSeconds);
+            iterPhotons = budget.NextPhotons(progress.ElapsedMS() / 1000);
+            lastIteration = iterPhotons == 0;
+            // Report what the radius schedule depends on, so that the
+            // render can be repeated without the time limit
+            if (lastIteration) {
+                timeLimitSummary = StringPrintf(
+                    "SPPM time limit %.1fs: %d iterations, %llu photons "
+                    "(%d per iteration, %d in the last) in %.1fs",
+                    timeLimit, iter + 1, (unsigned long long)photonsShot,
+                    photonsPerIteration, shot, progress.ElapsedMS() / 1000);
+                LOG(INFO) << timeLimitSummary;
+            } else if (budget.Final())
+                VLOG(1) << "SPPM time limit: iteration " << iter + 1
+                        << " is the last, with " << iterPhotons
+                        << " photons";
+        }
+        nIterationsDone = iter + 1;
+
+        // Periodically save the pixel state in the background; the
+        // snapshot is taken here, so the render may go on changing pixels
+        if (!checkpointFile.empty() && !worker && !lastIteration &&
+            PbrtOptions.sppmCheckpointInterval > 0 &&
+            (iter + 1) % PbrtOptions.sppmCheckpointInterval == 0) {
+            std::vector<SPPMCheckpointPixel> snapshot(nPixels);
+            ParallelFor(
+                [&](int i) {
+                    SPPMCheckpointPixel &s = snapshot[i];
+                    s.radius = pixels[i].radius;
+                    s.N = coldPixels[i].N;
+                    for (int c = 0; c < Spectrum::nSamples; ++c) {
+                        s.Ld[c] = coldPixels[i].Ld[c];
+                        s.tau[c] = coldPixels[i].tau[c];
+                    }
+                },
+                nPixels, 4096);
+            SPPMCheckpointHeader header;
+            header.pixelBounds[0] = pixelBounds.pMin.x;
+            header.pixelBounds[1] = pixelBounds.pMax.x;
+            header.pixelBounds[2] = pixelBounds.pMin.y;
+            header.pixelBounds[3] = pixelBounds.pMax.y;
+            header.photonsPerIteration = photonsPerIteration;
+            header.nIterations = nIterations;
+            header.iterations = iter + 1;
+            header.photonsShot = photonsShot;
+            memory.Update(SPPMMemoryComponent::Checkpoint,
+                          nPixels * sizeof(SPPMCheckpointPixel));
+            checkpointWriter.Write(header, std::move(snapshot),
+                                   emission ? emission->Counts()
+                                            : std::vector<uint64_t>());
+        }
+
+        // Periodically store SPPM image in film and write image
+        if (!worker &&
+            (lastIteration || ((iter + 1) % writeFrequency) == 0)) {
+            int x0 = pixelBounds.pMin.x;
+            int x1 = pixelBounds.pMax.x;
+            uint64_t Np = photonsShot;
+            std::unique_ptr<Spectrum[]> image(new Spectrum[pixelBounds.Area()]);
+            int offset = 0;
+            for (int y = pixelBounds.pMin.y; y < pixelBounds.pMax.y; ++y) {
+                for (int x = x0; x < x1; ++x) {
+                    // Compute radiance _L_ for SPPM pixel _pixel_
+                    int i = (y - pixelBounds.pMin.y) * (x1 - x0) + (x - x0);
+                    const SPPMPixel &pixel = pixels[i];
+                    const SPPMPixelCold &cold = coldPixels[i];
+                    Spectrum L = cold.Ld / (iter + 1);
+                    L += cold.tau / (Np * Pi * pixel.radius * pixel.radius);
+                    image[offset++] = L;
+                }
+            }
+            camera->film->SetImage(image.get());
+            camera->film->WriteImage();
+            // Write SPPM radius image, if requested
+            if (getenv("SPPM_RADIUS")) {
+                std::unique_ptr<Float[]> rimg(
+                    new Float[3 * pixelBounds.Area()]);
+                Float minrad = 1e30f, maxrad = 0;
+                for (int y = pixelBounds.pMin.y; y < pixelBounds.pMax.y; ++y) {
+                    for (int x = x0; x < x1; ++x) {
+                        const SPPMPixel &p =
+                            pixels[(y - pixelBounds.pMin.y) * (x1 - x0) +
+                                   (x - x0)];
+                        minrad = std::min(minrad, p.radius);
+                        maxrad = std::max(maxrad, p.radius);
+                    }
+                }
+                fprintf(stderr,
+                        "iterations: %d (%.2f s) radius range: %f - %f\n",
+                        iter + 1, progress.ElapsedMS() / 1000., minrad, maxrad);
+                int offset = 0;
+                for (int y = pixelBounds.pMin.y; y < pixelBounds.pMax.y; ++y) {
+                    for (int x = x0; x < x1; ++x) {
+                        const SPPMPixel &p =
+                            pixels[(y - pixelBounds.pMin.y) * (x1 - x0) +
+                                   (x - x0)];
+                        Float v = 1.f - (p.radius - minrad) / (maxrad - minrad);
+                        rimg[offset++] = v;
+                        rimg[offset++] = v;
+                        rimg[offset++] = v;
+                    }
+                }
+                Point2i res(pixelBounds.pMax.x - pixelBounds.pMin.x,
+                            pixelBounds.pMax.y - pixelBounds.pMin.y);
+                WriteImage("sppm_radius.png", rimg.get(), pixelBounds, res);
+            }
+            // Write lookup-cost images and table, if requested
+            if (lookupCost) lookupCost->Write(pixelBounds);
+        }
+
+        telemetry.EndIteration();
+        if (PbrtOptions.sppmMemory)
+            fprintf(stderr, "SPPM iteration %d memory:\n%s", iter,
+                    memory.Report().c_str());
+
+        // Reset memory arenas
+        for (MemoryArena &arena : perThreadArenas) arena.Reset();
+        if (lastIteration) break;
+    }
+    checkpointWriter.Wait();
+    if (shards) shards->Finish();
+    progress.Done();
+    if (!timeLimitSummary.empty() && !PbrtOptions.quiet)
+        printf("%s\n", timeLimitSummary.c_str());
+    memory.ReportStats();
+    if (!PbrtOptions.quiet)
+        telemetry.PrintSummary(nPixels, photonsPerIteration, nIterationsDone);
+}
+
+Integrator *CreateAcceleratedSPPMIntegrator(
+    const std::string &acceleratorName, const ParamSet &params,
+    std::shared_ptr<const Camera> camera) {
+    int nIterations =
+        params.FindOneInt("iterations", params.FindOneInt("numiterations", 64));
+    int maxDepth = params.FindOneInt("maxdepth", 5);
+    int photonsPerIter = params.FindOneInt("photonsperiteration", -1);
+    int writeFreq = params.FindOneInt("imagewritefrequency", 1 << 31);
+    Float radius = params.FindOneFloat("radius", 1.f);
+    // Seconds to keep iterating for; "iterations" is then only the nominal
+    // count the sampler and the accelerators are set up for
+    Float timeLimit = std::max((Float)0, params.FindOneFloat("timelimit", 0));
+    // Memory budget in MB for frames too large to render in memory
+    int outOfCoreMB = std::max(0, params.FindOneInt("outofcorememory", 0));
+    // Guide photon emission by where earlier photons reached visible points
+    bool adaptiveEmission = params.FindOneBool("adaptiveemission", false);
+    // Low-discrepancy sequence the photon paths are sampled with
+    std::string sequenceName = params.FindOneString("photonsequence", "halton");
+    SPPMSampleSequence photonSequence = SPPMSampleSequence::Halton;
+    if (sequenceName == "sobol")
+        photonSequence = SPPMSampleSequence::Sobol;
+    else if (sequenceName != "halton")
+        Warning("Photon sequence \"%s\" unknown. Using \"halton\".",
+                sequenceName.c_str());
+    if (PbrtOptions.quickRender) nIterations = std::max(1, nIterations / 16);
+    if (photonsPerIter <= 0)
+        photonsPerIter = camera->film->croppedPixelBounds.Area();
+
+    SPPMAcceleratorSettings settings;
+    settings.initialSearchRadius = radius;
+    settings.photonsPerIteration = photonsPerIter;
+    settings.nIterations = nIterations;
+
+    // Build parameters that sppm_tune stored next to the scene file fill
+    // in the ones the scene doesn't set
+    ParamSet accelParams = params;
+    if (parserLoc && parserLoc->filename != "-") {
+        std::string tuningFile = SPPMTuningFilename(parserLoc->filename);
+        std::vector<SPPMTunedParam> tuned;
+        if (ReadSPPMTuning(tuningFile, &tuned)) {
+            int n = ApplySPPMTuning(tuned, acceleratorName, &accelParams);
+            if (n > 0 && !PbrtOptions.quiet)
+                printf("Using %d tuned %s parameter%s from %s\n", n,
+                       acceleratorName.c_str(), n > 1 ? "s" : "",
+                       tuningFile.c_str());
+        }
+    }
+    std::unique_ptr<SPPMAccelerator> accelerator =
+        CreateSPPMAccelerator(acceleratorName, accelParams, settings);
+    if (!accelerator) return nullptr;
+    // With --sppmnuma, threads on the other NUMA nodes query copies of
+    // their own; out of core, the accelerators are per brick instead
+    std::vector<std::unique_ptr<SPPMAccelerator>> numaReplicas;
+    if (PbrtOptions.sppmNumaReplicas && outOfCoreMB == 0)
+        for (int node = 1; node < NumaNodeCount(); ++node)
+            numaReplicas.push_back(
+                CreateSPPMAccelerator(acceleratorName, accelParams, settings));
+    return new AcceleratedSPPMIntegrator(
+        camera, nIterations, photonsPerIter, maxDepth, radius, writeFreq,
+        timeLimit, (size_t)outOfCoreMB << 20, adaptiveEmission, photonSequence,
+        acceleratorName,
+        std::move(accelerator), std::move(numaReplicas));
+}
+
+}  // namespace pbrt
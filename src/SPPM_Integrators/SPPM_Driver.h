@@ -0,0 +1,117 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMDRIVER_H
+#define SPPMDRIVER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "SPPM_Integrators/SPPM_PhotonSampler.h"
+#include "SPPM_Integrators/accelerator.h"
+#include "camera.h"
+#include "film.h"
+#include "integrator.h"
+#include "pbrt.h"
+
+namespace pbrt {
+
+// SPPM Declarations
+// SPPM integrator that finds the visible points near each photon hit with
+// an SPPMAccelerator. The scene file selects it as "<accelerator>_sppm".
+class AcceleratedSPPMIntegrator : public Integrator {
+  public:
+    // AcceleratedSPPMIntegrator Public Methods
+    AcceleratedSPPMIntegrator(std::shared_ptr<const Camera> &camera,
+                              int nIterations, int photonsPerIteration,
+                              int maxDepth, Float initialSearchRadius,
+                              int writeFrequency, Float timeLimit,
+                              size_t outOfCoreMemory, bool adaptiveEmission,
+                              SPPMSampleSequence photonSequence,
+                              const std::string &acceleratorName,
+                              std::unique_ptr<SPPMAccelerator> accelerator,
+                              std::vector<std::unique_ptr<SPPMAccelerator>>
+                                  numaReplicas)
+        : camera(camera),
+          initialSearchRadius(initialSearchRadius),
+          nIterations(nIterations),
+          maxDepth(maxDepth),
+          photonsPerIteration(photonsPerIteration),
+          writeFrequency(writeFrequency),
+          timeLimit(timeLimit),
+          outOfCoreMemory(outOfCoreMemory),
+          adaptiveEmission(adaptiveEmission),
+          photonSequence(photonSequence),
+          acceleratorName(acceleratorName),
+          accelerator(std::move(accelerator)),
+          numaReplicas(std::move(numaReplicas)) {}
+    void Render(const Scene &scene);
+
+  private:
+    // AcceleratedSPPMIntegrator Private Data
+    std::shared_ptr<const Camera> camera;
+    const Float initialSearchRadius;
+    const int nIterations;
+    const int maxDepth;
+    const int photonsPerIteration;
+    const int writeFrequency;
+    // Seconds to keep iterating for, or 0 for exactly _nIterations_
+    const Float timeLimit;
+    // Memory budget of the out-of-core photon pass in bytes, or 0 to keep
+    // the pixels and the accelerator in memory
+    const size_t outOfCoreMemory;
+    // Steer photon emission toward the lights and directions whose photons
+    // reach visible points
+    const bool adaptiveEmission;
+    const SPPMSampleSequence photonSequence;
+    const std::string acceleratorName;
+    std::unique_ptr<SPPMAccelerator> accelerator;
+    // Copies of _accelerator_ for NUMA nodes 1, 2, ..., built by and
+    // queried from the threads pinned there
+    std::vector<std::unique_ptr<SPPMAccelerator>> numaReplicas;
+};
+
+// Returns nullptr if _accelerator_ isn't a registered SPPMAccelerator
+Integrator *CreateAcceleratedSPPMIntegrator(
+    const std::string &accelerator, const ParamSet &params,
+    std::shared_ptr<const Camera> camera);
+
+}  // namespace pbrt
+
+#endif  // SPPMDRIVER_H
@@ -0,0 +1,122 @@
+
+#include "SPPM_Integrators/SPPM_Emission.h"
+
+#include <algorithm>
+
+#include "parallel.h"
+
+namespace pbrt {
+
+// SPPM Emission Local Definitions
+static const int maxBinnedLights = 1024;
+
+// Mixes the densities _uniformShare_ of _unguided_ and the rest in
+// proportion to _unguided_ times the useful rates _rate_
+static std::vector<Float> GuidedWeights(const std::vector<Float> &unguided,
+                                        const std::vector<double> &rate,
+                                        Float uniformShare) {
+    double total = 0, guided = 0;
+    for (size_t i = 0; i < unguided.size(); ++i) {
+        total += unguided[i];
+        guided += unguided[i] * rate[i];
+    }
+    std::vector<Float> weights(unguided.size());
+    for (size_t i = 0; i < unguided.size(); ++i) {
+        double w = total > 0 ? uniformShare * unguided[i] / total : 0;
+        if (guided > 0)
+            w += (1 - uniformShare) * unguided[i] * rate[i] / guided;
+        else if (total > 0)
+            w += (1 - uniformShare) * unguided[i] / total;
+        weights[i] = w;
+    }
+    return weights;
+}
+
+// SPPMEmissionGuide Method Definitions
+SPPMEmissionGuide::SPPMEmissionGuide(const Distribution1D &lightPower)
+    : power(lightPower.func),
+      nLights(lightPower.Count()),
+      binned(nLights <= maxBinnedLights),
+      nCounts(2 * nLights + (binned ? 2 * nLights * 2 * nBins : 0)),
+      counts(nCounts, 0),
+      threadCounts(MaxThreadIndex(), std::vector<uint64_t>(nCounts, 0)) {
+    lightDistrib.reset(new Distribution1D(power.data(), nLights));
+}
+
+int SPPMEmissionGuide::SampleLight(Float u, Float *pdf) const {
+    return lightDistrib->SampleDiscrete(u, pdf);
+}
+
+Point2f SPPMEmissionGuide::SampleEmission(int light, int pair,
+                                          const Point2f &u, int *bin,
+                                          Float *pdf) const {
+    // Until the first update, the samples are left as they are
+    Point2f w = u;
+    *pdf = 1;
+    if (!emissionDistribs.empty())
+        w = emissionDistribs[light * 2 + pair]->SampleContinuous(u, pdf);
+    int x = Clamp((int)(w.x * binRes), 0, binRes - 1);
+    int y = Clamp((int)(w.y * binRes), 0, binRes - 1);
+    *bin = y * binRes + x;
+    return w;
+}
+
+void SPPMEmissionGuide::Record(int light, const int bins[2], bool useful) {
+    std::vector<uint64_t> &c = threadCounts[ThreadIndex];
+    ++c[LightShot(light)];
+    if (useful) ++c[LightUseful(light)];
+    if (!binned) return;
+    for (int pair = 0; pair < 2; ++pair) {
+        ++c[BinShot(light, pair, bins[pair])];
+        if (useful) ++c[BinUseful(light, pair, bins[pair])];
+    }
+}
+
+std::vector<uint64_t> SPPMEmissionGuide::NewCounts() const {
+    std::vector<uint64_t> newCounts(nCounts, 0);
+    for (const std::vector<uint64_t> &c : threadCounts)
+        for (int i = 0; i < nCounts; ++i) newCounts[i] += c[i];
+    return newCounts;
+}
+
+void SPPMEmissionGuide::Update(const std::vector<uint64_t> &newCounts) {
+    CHECK_EQ(nCounts, (int)newCounts.size());
+    for (int i = 0; i < nCounts; ++i) counts[i] += newCounts[i];
+    for (std::vector<uint64_t> &c : threadCounts)
+        std::fill(c.begin(), c.end(), 0);
+    Rebuild();
+}
+
+bool SPPMEmissionGuide::Restore(const std::vector<uint64_t> &counts) {
+    if ((int)counts.size() != nCounts) return false;
+    this->counts = counts;
+    Rebuild();
+    return true;
+}
+
+void SPPMEmissionGuide::Rebuild() {
+    auto rate = [](uint64_t useful, uint64_t shot) {
+        return shot > 0 ? (double)useful / shot : 0.;
+    };
+    std::vector<double> lightRate(nLights);
+    for (int i = 0; i < nLights; ++i)
+        lightRate[i] = rate(counts[LightUseful(i)], counts[LightShot(i)]);
+    std::vector<Float> weights = GuidedWeights(power, lightRate, uniformShare);
+    lightDistrib.reset(new Distribution1D(weights.data(), nLights));
+
+    if (!binned) return;
+    emissionDistribs.resize(nLights * 2);
+    const std::vector<Float> uniform(nBins, (Float)1);
+    std::vector<double> binRate(nBins);
+    for (int light = 0; light < nLights; ++light)
+        for (int pair = 0; pair < 2; ++pair) {
+            for (int b = 0; b < nBins; ++b)
+                binRate[b] = rate(counts[BinUseful(light, pair, b)],
+                                  counts[BinShot(light, pair, b)]);
+            weights = GuidedWeights(uniform, binRate, uniformShare);
+            emissionDistribs[light * 2 + pair].reset(
+                new Distribution2D(weights.data(), binRes, binRes));
+        }
+}
+
+}  // namespace pbrt
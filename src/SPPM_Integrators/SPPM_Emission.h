@@ -0,0 +1,97 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMEMISSION_H
+#define SPPMEMISSION_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "geometry.h"
+#include "pbrt.h"
+#include "sampling.h"
+
+namespace pbrt {
+
+// Visibility-driven photon emission for SPPM.
+//
+// Photons that never reach a visible point cost as much to trace as those
+// that do. The guide counts, per light and per bin of each of the light's
+// two 2D emission samples, the photons shot and the photons that added
+// flux to a visible point, and steers later photons toward the lights and
+// bins whose photons were useful. The sample warps are piecewise constant
+// and mixed with the unguided densities, so every region keeps a nonzero
+// probability, and the photon throughput is divided by their densities:
+// the estimate stays unbiased. Only the distribution of the photons
+// changes.
+//
+// Each thread counts into its own array, and Update() adds them up and
+// rebuilds the distributions between photon passes. The counts are
+// integers, so a render doesn't depend on thread timing, and the totals
+// can be summed across photon shards and saved in checkpoints.
+class SPPMEmissionGuide {
+  public:
+    // SPPMEmissionGuide Public Methods
+    // _lightPower_ is the unguided light distribution
+    SPPMEmissionGuide(const Distribution1D &lightPower);
+
+    // Picks a light for the sample _u_, with its probability in _pdf_
+    int SampleLight(Float u, Float *pdf) const;
+    // Warps the emission sample _u_ of _light_'s sample pair _pair_ (0 or
+    // 1), returning its density in _pdf_ and the bin it falls in in _bin_
+    Point2f SampleEmission(int light, int pair, const Point2f &u, int *bin,
+                           Float *pdf) const;
+    // Counts a photon shot from _light_ with emission bins _bins_, and
+    // whether it was _useful_, in the calling thread's counters
+    void Record(int light, const int bins[2], bool useful);
+    // Returns the counts recorded by all threads since the last update
+    std::vector<uint64_t> NewCounts() const;
+    // Adds _newCounts_, as NewCounts() returns them, possibly summed over
+    // several processes, to the totals, clears the threads' counters and
+    // rebuilds the distributions
+    void Update(const std::vector<uint64_t> &newCounts);
+    void Update() { Update(NewCounts()); }
+    // The totals of all updates so far
+    const std::vector<uint64_t> &Counts() const { return counts; }
+    // Replaces the totals with _counts_ and rebuilds the distributions;
+    // returns false, leaving the guide as it was, if _counts_ doesn't
+    // match the lights
+    bool Restore(const std::vector<uint64_t> &counts);
+
+  private:
+    // SPPMEmissionGuide Private Methods
+    // Counts hold the photons shot from each light, then those of them
+    // that were useful, then the same two for each emission bin
+    int LightShot(int light) const { return light; }
+    int LightUseful(int light) const { return nLights + light; }
+    int BinShot(int light, int pair, int bin) const {
+        return 2 * nLights + (light * 2 + pair) * nBins + bin;
+    }
+    int BinUseful(int light, int pair, int bin) const {
+        return BinShot(light, pair, bin) + nLights * 2 * nBins;
+    }
+    void Rebuild();
+
+    // SPPMEmissionGuide Private Data
+    static constexpr int binRes = 8, nBins = binRes * binRes;
+    // Share of each density kept from the unguided one
+    static constexpr Float uniformShare = .25f;
+    const std::vector<Float> power;
+    const int nLights;
+    // Emission bins are only kept for scenes with few enough lights; with
+    // more, only the light choice is guided
+    const bool binned;
+    const int nCounts;
+    std::vector<uint64_t> counts;
+    std::vector<std::vector<uint64_t>> threadCounts;
+    std::unique_ptr<Distribution1D> lightDistrib;
+    std::vector<std::unique_ptr<Distribution2D>> emissionDistribs;
+};
+
+}  // namespace pbrt
+
+#endif  // SPPMEMISSION_H
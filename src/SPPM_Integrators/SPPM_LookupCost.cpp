@@ -0,0 +1,128 @@
+
+#include "SPPM_Integrators/SPPM_LookupCost.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "imageio.h"
+
+namespace pbrt {
+
+// SPPMLookupCost Method Definitions
+SPPMLookupCost::SPPMLookupCost(int nPixels, int worldResolution)
+    : nPixels(nPixels),
+      worldResolution(worldResolution),
+      pixels(new PixelCost[nPixels]),
+      threads(MaxThreadIndex()),
+      bins(new std::atomic<int64_t>[nBinCounters * worldResolution *
+                                    worldResolution * worldResolution]()) {}
+
+void SPPMLookupCost::SetWorldBound(const Bounds3f &bounds) {
+    if (haveBound || bounds.pMin.x > bounds.pMax.x) return;
+    worldBound = bounds;
+    Vector3f diag = bounds.Diagonal();
+    for (int i = 0; i < 3; ++i)
+        invBinSize[i] = diag[i] > 0 ? worldResolution / diag[i] : 0;
+    haveBound = true;
+}
+
+void SPPMLookupCost::AddQuery(const Point3f &p, int checked) {
+    ThreadData &t = threads[ThreadIndex];
+    int nFound = t.indices.size();
+    for (int index : t.indices) {
+        PixelCost &c = pixels[index];
+        c.photons.fetch_add(1, std::memory_order_relaxed);
+        c.candidates.fetch_add(checked, std::memory_order_relaxed);
+        c.found.fetch_add(nFound, std::memory_order_relaxed);
+    }
+    t.indices.clear();
+    ++t.histogram[checked == 0 ? 0 : std::min(1 + Log2Int((uint32_t)checked),
+                                              31)];
+
+    if (!haveBound) return;
+    int b[3];
+    for (int i = 0; i < 3; ++i)
+        b[i] = Clamp((int)((p[i] - worldBound.pMin[i]) * invBinSize[i]), 0,
+                     worldResolution - 1);
+    int bin = (b[2] * worldResolution + b[1]) * worldResolution + b[0];
+    std::atomic<int64_t> *counts = &bins[nBinCounters * bin];
+    counts[0].fetch_add(1, std::memory_order_relaxed);
+    counts[1].fetch_add(checked, std::memory_order_relaxed);
+    counts[2].fetch_add(nFound, std::memory_order_relaxed);
+}
+
+void SPPMLookupCost::Write(const Bounds2i &pixelBounds) const {
+    // Per-pixel candidates per received photon and false-positive ratio
+    std::vector<Float> cost(nPixels, 0), falsePositives(nPixels, 0);
+    Float maxCost = 0;
+    for (int i = 0; i < nPixels; ++i) {
+        const PixelCost &c = pixels[i];
+        int64_t photons = c.photons.load(std::memory_order_relaxed);
+        int64_t candidates = c.candidates.load(std::memory_order_relaxed);
+        if (photons == 0 || candidates == 0) continue;
+        cost[i] = (Float)candidates / photons;
+        falsePositives[i] =
+            1 - (Float)c.found.load(std::memory_order_relaxed) / candidates;
+        maxCost = std::max(maxCost, cost[i]);
+    }
+    fprintf(stderr, "max candidates per received photon: %f\n", maxCost);
+    std::unique_ptr<Float[]> img(new Float[3 * nPixels]);
+    Point2i res(pixelBounds.pMax.x - pixelBounds.pMin.x,
+                pixelBounds.pMax.y - pixelBounds.pMin.y);
+    auto writeGray = [&](const char *filename, const std::vector<Float> &v,
+                         Float scale) {
+        for (int i = 0; i < nPixels; ++i)
+            img[3 * i] = img[3 * i + 1] = img[3 * i + 2] = v[i] * scale;
+        WriteImage(filename, img.get(), pixelBounds, res);
+    };
+    writeGray("sppm_cost.png", cost, maxCost > 0 ? 1 / maxCost : 0);
+    writeGray("sppm_false_positives.png", falsePositives, 1);
+
+    // Distribution of candidates per query
+    int64_t histogram[32] = {};
+    for (const ThreadData &t : threads)
+        for (int i = 0; i < 32; ++i) histogram[i] += t.histogram[i];
+    fprintf(stderr, "candidates per query:");
+    for (int i = 0; i < 32; ++i) {
+        if (histogram[i] == 0) continue;
+        if (i < 2)
+            fprintf(stderr, " %d: %lld", i, (long long)histogram[i]);
+        else
+            fprintf(stderr, " %d-%d: %lld", 1 << (i - 1), (1 << i) - 1,
+                    (long long)histogram[i]);
+    }
+    fprintf(stderr, "\n");
+
+    // World-space bins that received queries
+    FILE *f = fopen("sppm_leaf_occupancy.csv", "w");
+    if (!f) {
+        Error("sppm_leaf_occupancy.csv: unable to open file");
+        return;
+    }
+    fprintf(f, "x0,y0,z0,x1,y1,z1,queries,candidates_per_query,"
+               "found_per_query,false_positive_ratio\n");
+    Vector3f binSize = worldBound.Diagonal() / worldResolution;
+    for (int z = 0; z < worldResolution; ++z)
+        for (int y = 0; y < worldResolution; ++y)
+            for (int x = 0; x < worldResolution; ++x) {
+                int bin = (z * worldResolution + y) * worldResolution + x;
+                const std::atomic<int64_t> *counts = &bins[nBinCounters * bin];
+                int64_t queries = counts[0].load(std::memory_order_relaxed);
+                if (queries == 0) continue;
+                int64_t candidates = counts[1].load(std::memory_order_relaxed);
+                int64_t deposits = counts[2].load(std::memory_order_relaxed);
+                Point3f p0 = worldBound.pMin +
+                             Vector3f(x * binSize.x, y * binSize.y,
+                                      z * binSize.z);
+                Point3f p1 = p0 + binSize;
+                fprintf(f, "%g,%g,%g,%g,%g,%g,%lld,%f,%f,%f\n", p0.x, p0.y,
+                        p0.z, p1.x, p1.y, p1.z, (long long)queries,
+                        (double)candidates / queries,
+                        (double)deposits / queries,
+                        candidates > 0 ? 1 - (double)deposits / candidates
+                                       : 0.);
+            }
+    fclose(f);
+}
+
+}  // namespace pbrt
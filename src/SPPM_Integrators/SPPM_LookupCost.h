@@ -0,0 +1,75 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMLOOKUPCOST_H
+#define SPPMLOOKUPCOST_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "geometry.h"
+#include "parallel.h"
+#include "pbrt.h"
+
+namespace pbrt {
+
+// Lookup-cost diagnostics of an SPPM render, enabled like sppm_radius.png
+// by setting the SPPM_COST environment variable.
+//
+// Every accelerator query in the photon pass reports how many visible
+// points it tested and which ones were inside their search radius. The
+// test counts are charged to the pixels that received the photon, giving
+// per-pixel images of the candidates tested per received photon
+// (sppm_cost.png) and of the fraction of them that were outside their
+// radius (sppm_false_positives.png). Queries are also binned over a coarse
+// grid in world space; sppm_leaf_occupancy.csv lists the mean candidates
+// per query of each non-empty bin. That is the occupancy of the leaves (or
+// grid cells) photons land in, so oversized leaves and leaves crowded with
+// duplicated points show up where they are.
+class SPPMLookupCost {
+  public:
+    SPPMLookupCost(int nPixels, int worldResolution = 32);
+
+    // Sets the world-space bins from the first non-empty _bounds_; later
+    // calls keep them so that the counts add up over the render
+    void SetWorldBound(const Bounds3f &bounds);
+
+    // Buffer for the indices of the pixels a query deposits into
+    std::vector<int> &FoundBuffer() { return threads[ThreadIndex].indices; }
+
+    // Records a query at _p_ that tested _checked_ visible points and
+    // deposited into the pixels in FoundBuffer(), and clears the buffer
+    void AddQuery(const Point3f &p, int checked);
+
+    // Writes the images and the world-space table and prints the
+    // distribution of candidates per query
+    void Write(const Bounds2i &pixelBounds) const;
+
+  private:
+    // SPPMLookupCost Private Data
+    struct PixelCost {
+        std::atomic<int64_t> photons{0}, candidates{0}, found{0};
+    };
+    struct alignas(64) ThreadData {
+        std::vector<int> indices;
+        // Queries by candidates tested: 0, 1, 2-3, 4-7, ...
+        int64_t histogram[32] = {};
+    };
+    static const int nBinCounters = 3;
+    const int nPixels, worldResolution;
+    std::unique_ptr<PixelCost[]> pixels;
+    std::vector<ThreadData> threads;
+    // Queries, candidates and deposits of each world bin
+    std::unique_ptr<std::atomic<int64_t>[]> bins;
+    Bounds3f worldBound;
+    Vector3f invBinSize;
+    bool haveBound = false;
+};
+
+}  // namespace pbrt
+
+#endif  // SPPMLOOKUPCOST_H
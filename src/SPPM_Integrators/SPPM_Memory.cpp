@@ -0,0 +1,84 @@
+
+#include "SPPM_Integrators/SPPM_Memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "stats.h"
+
+namespace pbrt {
+
+STAT_MEMORY_COUNTER("Memory/SPPM peak total", peakTotalBytes);
+STAT_MEMORY_COUNTER("Memory/SPPM peak camera arenas", peakCameraArenaBytes);
+STAT_MEMORY_COUNTER("Memory/SPPM peak photon arenas", peakPhotonArenaBytes);
+STAT_MEMORY_COUNTER("Memory/SPPM peak accelerator", peakAcceleratorBytes);
+
+static const char *componentNames[] = {
+    "pixels",        "camera arenas", "visible point list", "accelerator",
+    "occupancy mask", "photon arenas", "capture", "checkpoint",
+    "shard deltas"};
+
+const char *SPPMMemoryComponentName(SPPMMemoryComponent component) {
+    return componentNames[(int)component];
+}
+
+// SPPMMemoryTracker Method Definitions
+void SPPMMemoryTracker::Update(SPPMMemoryComponent component, size_t bytes,
+                               size_t peakBytes) {
+    int c = (int)component;
+    peakBytes = std::max(peakBytes, bytes);
+    size_t others = TotalCurrent() - current[c];
+    current[c] = bytes;
+    peak[c] = std::max(peak[c], peakBytes);
+    totalPeak = std::max(totalPeak, others + peakBytes);
+
+    if (budget > 0 && others + peakBytes > budget) {
+        Error("SPPM memory budget of %.1f MB exceeded: the %s need %.1f MB, "
+              "for %.1f MB in total. Reduce the image resolution or the "
+              "photons per iteration, choose a smaller accelerator, or raise "
+              "the budget with --sppmmembudget.\n%s",
+              budget / (1024. * 1024.), componentNames[c],
+              peakBytes / (1024. * 1024.),
+              (others + peakBytes) / (1024. * 1024.), Report().c_str());
+        exit(1);
+    }
+}
+
+size_t SPPMMemoryTracker::TotalCurrent() const {
+    size_t total = 0;
+    for (size_t bytes : current) total += bytes;
+    return total;
+}
+
+std::string SPPMMemoryTracker::Report() const {
+    std::string report;
+    char line[128];
+    snprintf(line, sizeof(line), "  %-20s %10s %10s\n", "SPPM memory (MB)",
+             "current", "peak");
+    report += line;
+    for (int c = 0; c < nSPPMMemoryComponents; ++c) {
+        snprintf(line, sizeof(line), "  %-20s %10.2f %10.2f\n",
+                 componentNames[c], current[c] / (1024. * 1024.),
+                 peak[c] / (1024. * 1024.));
+        report += line;
+    }
+    snprintf(line, sizeof(line), "  %-20s %10.2f %10.2f\n", "total",
+             TotalCurrent() / (1024. * 1024.), totalPeak / (1024. * 1024.));
+    report += line;
+    return report;
+}
+
+void SPPMMemoryTracker::ReportStats() const {
+    // Several renders in one run report the largest of their peaks
+    peakTotalBytes = std::max<int64_t>(peakTotalBytes, totalPeak);
+    peakCameraArenaBytes = std::max<int64_t>(
+        peakCameraArenaBytes, Peak(SPPMMemoryComponent::CameraArenas));
+    peakPhotonArenaBytes = std::max<int64_t>(
+        peakPhotonArenaBytes, Peak(SPPMMemoryComponent::PhotonArenas));
+    peakAcceleratorBytes = std::max<int64_t>(
+        peakAcceleratorBytes, Peak(SPPMMemoryComponent::Accelerator));
+}
+
+}  // namespace pbrt
@@ -0,0 +1,74 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMMEMORY_H
+#define SPPMMEMORY_H
+
+#include <string>
+
+#include "pbrt.h"
+
+namespace pbrt {
+
+enum class SPPMMemoryComponent {
+    Pixels,
+    CameraArenas,
+    VisiblePointList,
+    Accelerator,
+    OccupancyMask,
+    PhotonArenas,
+    Capture,
+    Checkpoint,
+    ShardDeltas
+};
+static const int nSPPMMemoryComponents = 9;
+const char *SPPMMemoryComponentName(SPPMMemoryComponent component);
+
+// Current and peak memory of the parts of an SPPM render.
+//
+// The driver updates each component as it allocates or frees it; the total
+// peak is the largest sum of the components' current bytes, counting a
+// component's own peak (an accelerator's build scratch, for instance) at
+// the time it is reached. With a budget, an update that would take the
+// total past it ends the render with a report of every component.
+class SPPMMemoryTracker {
+  public:
+    // _budget_ is in bytes; 0 means no budget
+    SPPMMemoryTracker(size_t budget = 0) : budget(budget) {}
+
+    // Records that _component_ now uses _current_ bytes and used up to
+    // _peak_ bytes since the last update
+    void Update(SPPMMemoryComponent component, size_t current, size_t peak);
+    void Update(SPPMMemoryComponent component, size_t current) {
+        Update(component, current, current);
+    }
+
+    size_t Current(SPPMMemoryComponent component) const {
+        return current[(int)component];
+    }
+    size_t Peak(SPPMMemoryComponent component) const {
+        return peak[(int)component];
+    }
+    size_t TotalCurrent() const;
+    size_t TotalPeak() const { return totalPeak; }
+
+    // Returns a table of the current and peak megabytes of each component
+    std::string Report() const;
+
+    // Adds the peaks to the "Memory" section of pbrt's statistics
+    void ReportStats() const;
+
+  private:
+    // SPPMMemoryTracker Private Data
+    const size_t budget;
+    size_t current[nSPPMMemoryComponents] = {};
+    size_t peak[nSPPMMemoryComponents] = {};
+    size_t totalPeak = 0;
+};
+
+}  // namespace pbrt
+
+#endif  // SPPMMEMORY_H
@@ -0,0 +1,404 @@
+
+#include "SPPM_Integrators/SPPM_OutOfCore.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "memory.h"
+#include "parallel.h"
+
+namespace pbrt {
+
+// SPPM Out-of-Core Local Definitions
+static const int maxBrickCells = 1 << 22;
+
+void *AllocSPPMScratch(size_t bytes) {
+    size_t length = std::max<size_t>(bytes, 1);
+#ifdef PBRT_HAVE_MMAP
+    const char *tmpdir = getenv("TMPDIR");
+    std::string filename =
+        std::string(tmpdir ? tmpdir : "/tmp") + "/pbrt-sppm-XXXXXX";
+    int fd = mkstemp(&filename[0]);
+    if (fd == -1) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        exit(1);
+    }
+    // The file goes away with the mapping
+    unlink(filename.c_str());
+#ifdef __linux__
+    // Reserve the blocks now, rather than fault on a full disk later
+    int err = posix_fallocate(fd, 0, length);
+#else
+    int err = ftruncate(fd, length) == 0 ? 0 : errno;
+#endif
+    if (err != 0) {
+        Error("%s: can't reserve %zu bytes: %s", filename.c_str(), length,
+              strerror(err));
+        exit(1);
+    }
+    void *ptr =
+        mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        exit(1);
+    }
+    return ptr;
+#else
+    void *ptr = AllocAligned(length);
+    memset(ptr, 0, length);
+    return ptr;
+#endif
+}
+
+void FreeSPPMScratch(void *ptr, size_t bytes) {
+#ifdef PBRT_HAVE_MMAP
+    munmap(ptr, std::max<size_t>(bytes, 1));
+#else
+    FreeAligned(ptr);
+#endif
+}
+
+// SPPMBricks Method Definitions
+SPPMBricks::SPPMBricks(size_t memoryBytes, int pathHits)
+    : memoryBytes(memoryBytes),
+      pathHits(std::max(pathHits, 1)),
+      threadHits(MaxThreadIndex()),
+      full(false),
+      pathTooLong(false),
+      hitsPerPhoton(this->pathHits) {}
+
+SPPMBricks::~SPPMBricks() {}
+
+Point3i SPPMBricks::Cell(const Point3f &p) const {
+    Vector3f o = bounds.Offset(p);
+    Point3i cell;
+    for (int a = 0; a < 3; ++a)
+        cell[a] = Clamp((int)(o[a] * res[a]), 0, res[a] - 1);
+    return cell;
+}
+
+void SPPMBricks::Build(const std::vector<SPPMPixel *> &pixels,
+                       SPPMPixel *base, size_t residentBytes) {
+    this->base = base;
+    this->residentBytes = residentBytes;
+    nPoints = pixels.size();
+    peakBytes = 0;
+    // Size the bricks from what the last iteration's builds used
+    if (measuredBytesPerPoint > 0) bytesPerPoint = measuredBytesPerPoint;
+    measuredBytesPerPoint = 0;
+    brickPoints.reset();
+
+    // Bound the search spheres of the visible points
+    const int chunkSize = 4096;
+    int nChunks = (nPoints + chunkSize - 1) / chunkSize;
+    std::vector<Bounds3f> chunkBounds(nChunks);
+    ParallelFor(
+        [&](int chunk) {
+            int end = std::min(nPoints, (chunk + 1) * chunkSize);
+            for (int i = chunk * chunkSize; i < end; ++i)
+                chunkBounds[chunk] =
+                    Union(chunkBounds[chunk], pixels[i]->WorldBound());
+        },
+        nChunks);
+    bounds = Bounds3f();
+    for (const Bounds3f &b : chunkBounds) bounds = Union(bounds, b);
+
+    // Pick the brick grid: about as many bricks as the budget calls for,
+    // refined while the largest brick holds more than twice its share of
+    // points, as with points on a few surfaces. Bricks still larger than
+    // that are looked up a chunk of points at a time.
+    // The brick index keeps a few words per cell in memory, so there are
+    // no more cells than an eighth of the budget holds
+    int64_t brickBudget =
+        std::max<int64_t>(1, (AvailableBytes() / 2) / bytesPerPoint);
+    int64_t cellLimit =
+        Clamp((int64_t)(AvailableBytes() / (8 * 4 * sizeof(int64_t))),
+              (int64_t)1, (int64_t)maxBrickCells);
+    int64_t nTarget =
+        std::min(cellLimit, std::max<int64_t>(1, nPoints / brickBudget + 1));
+    Vector3f diag = nPoints > 0 ? bounds.Diagonal() : Vector3f(1, 1, 1);
+    Float side = std::max(MaxComponent(diag), (Float)1e-6) /
+                 std::pow((Float)nTarget, (Float)1 / 3);
+    for (int a = 0; a < 3; ++a)
+        res[a] = Clamp((int)std::ceil(diag[a] / side), 1, 1 << 10);
+    int nCells;
+    std::unique_ptr<std::atomic<int64_t>[]> counts;
+    for (int refine = 0;; ++refine) {
+        nCells = res.x * res.y * res.z;
+        counts.reset(new std::atomic<int64_t>[nCells]);
+        for (int i = 0; i < nCells; ++i) counts[i] = 0;
+        ParallelFor(
+            [&](int i) {
+                Point3i c0, c1;
+                CellRange(*pixels[i], &c0, &c1);
+                for (int z = c0.z; z <= c1.z; ++z)
+                    for (int y = c0.y; y <= c1.y; ++y)
+                        for (int x = c0.x; x <= c1.x; ++x)
+                            ++counts[BrickIndex(Point3i(x, y, z))];
+            },
+            nPoints, chunkSize);
+        int64_t maxCount = 0;
+        for (int i = 0; i < nCells; ++i)
+            maxCount = std::max(maxCount, (int64_t)counts[i]);
+        if (maxCount <= 2 * brickBudget || refine == 4 ||
+            8 * (int64_t)nCells > cellLimit)
+            break;
+        for (int a = 0; a < 3; ++a)
+            if (diag[a] > 0) res[a] = std::min(2 * res[a], 1 << 10);
+    }
+
+    // Lay the bricks out one after another in the scratch file; the start
+    // of each brick stays in memory through the photon pass
+    brickStart.resize(nCells + 1);
+    size_t countBytes = nCells * sizeof(std::atomic<int64_t>);
+    this->residentBytes += brickStart.capacity() * sizeof(int64_t);
+    if (this->residentBytes + countBytes > memoryBytes)
+        OverBudget("the brick index",
+                   countBytes + brickStart.capacity() * sizeof(int64_t));
+    peakBytes = countBytes;
+    brickStart[0] = 0;
+    nBricks = 0;
+    for (int i = 0; i < nCells; ++i) {
+        brickStart[i + 1] = brickStart[i] + counts[i];
+        if (counts[i] > 0) ++nBricks;
+        counts[i] = brickStart[i];
+    }
+    brickPoints.reset(new SPPMMappedArray<int>(brickStart[nCells], true));
+    ParallelFor(
+        [&](int i) {
+            int index = pixels[i] - base;
+            Point3i c0, c1;
+            CellRange(*pixels[i], &c0, &c1);
+            for (int z = c0.z; z <= c1.z; ++z)
+                for (int y = c0.y; y <= c1.y; ++y)
+                    for (int x = c0.x; x <= c1.x; ++x) {
+                        int cell = BrickIndex(Point3i(x, y, z));
+                        (*brickPoints)[counts[cell]++] = index;
+                    }
+        },
+        nPoints, chunkSize);
+    // Keep each brick in pixel order, so that builds don't depend on
+    // thread timing
+    ParallelFor(
+        [&](int cell) {
+            std::sort(brickPoints->get() + brickStart[cell],
+                      brickPoints->get() + brickStart[cell + 1]);
+        },
+        nCells);
+    maxBrickPoints = brickBudget;
+
+    // Give every thread an equal share of the hits
+    threadCapacity = HitBudget() / MaxThreadIndex();
+    if (threadCapacity == 0)
+        OverBudget("photon hits", MaxThreadIndex() * sizeof(SPPMPhotonHit));
+}
+
+void SPPMBricks::OverBudget(const char *what, size_t bytes) const {
+    Error("SPPM out-of-core memory budget of %.1f MB is too small: %.1f MB "
+          "of visible points leave no room for %.1f MB of %s",
+          memoryBytes / (1024. * 1024.), residentBytes / (1024. * 1024.),
+          bytes / (1024. * 1024.), what);
+    ParallelCleanup();
+    exit(1);
+}
+
+int64_t SPPMBricks::HitBudget() const {
+    // Each hit is held twice while it's sorted, with its brick index and
+    // its share of the sort offsets; the offsets and the start of each
+    // brick's hits take at least a slot per brick
+    int nCells = res.x * res.y * res.z;
+    int64_t bytes = AvailableBytes() / 2 - 2 * (nCells + 1) * sizeof(int64_t);
+    return std::max<int64_t>(0, bytes) /
+           (2 * sizeof(SPPMPhotonHit) + sizeof(int) + sizeof(int64_t));
+}
+
+int SPPMBricks::NextBatchEnd(int begin, int end) const {
+    int64_t photons = std::max<int64_t>(
+        1024, HitBudget() / std::max(hitsPerPhoton, .01));
+    return std::min<int64_t>(end, begin + photons);
+}
+
+bool SPPMBricks::HasRoom() {
+    if (full.load(std::memory_order_relaxed)) return false;
+    std::vector<SPPMPhotonHit> &hits = threadHits[ThreadIndex];
+    if (hits.capacity() < threadCapacity) hits.reserve(threadCapacity);
+    // An empty buffer takes any path that fits at all
+    if (hits.empty() || hits.size() + pathHits <= threadCapacity) return true;
+    full.store(true, std::memory_order_relaxed);
+    return false;
+}
+
+bool SPPMBricks::AddHit(const Point3f &p, const Vector3f &wi,
+                        const Spectrum &beta) {
+    std::vector<SPPMPhotonHit> &hits = threadHits[ThreadIndex];
+    if (hits.size() == threadCapacity) {
+        full.store(true, std::memory_order_relaxed);
+        return false;
+    }
+    hits.push_back({p, wi, beta});
+    return true;
+}
+
+void SPPMBricks::DiscardPath(size_t start) {
+    if (start == 0) pathTooLong = true;
+    threadHits[ThreadIndex].resize(start);
+}
+
+void SPPMBricks::ProcessHits(
+    SPPMAccelerator *accel, int nPhotons,
+    const std::function<void(const SPPMPhotonHit *, int)> &query) {
+    // The hit buffers keep their capacity from batch to batch
+    size_t bufferBytes = 0;
+    std::vector<int64_t> threadStart(threadHits.size() + 1, 0);
+    for (size_t t = 0; t < threadHits.size(); ++t) {
+        bufferBytes += threadHits[t].capacity() * sizeof(SPPMPhotonHit);
+        threadStart[t + 1] = threadStart[t] + threadHits[t].size();
+    }
+    int64_t nHits = threadStart.back();
+    if (pathTooLong)
+        OverBudget("the hits of one photon path",
+                   MaxThreadIndex() * (threadCapacity + 1) *
+                       sizeof(SPPMPhotonHit));
+    if (nPhotons > 0) hitsPerPhoton = (double)nHits / nPhotons;
+    full = false;
+    if (nPoints == 0 || nHits == 0) {
+        for (std::vector<SPPMPhotonHit> &hits : threadHits) hits.clear();
+        return;
+    }
+
+    // Sort the hits by brick. The hits are cut into parts that are binned
+    // concurrently, each from its own offset into every brick; as the
+    // offsets take a slot per brick and part, there are no more parts than
+    // hits per brick.
+    int nCells = res.x * res.y * res.z;
+    std::vector<int> brickOf(nHits);
+    for (size_t t = 0; t < threadHits.size(); ++t) {
+        const std::vector<SPPMPhotonHit> &hits = threadHits[t];
+        ParallelFor(
+            [&](int i) {
+                brickOf[threadStart[t] + i] = BrickIndex(Cell(hits[i].p));
+            },
+            hits.size(), 4096);
+    }
+    int64_t nParts =
+        Clamp(nHits / nCells, (int64_t)1, 4 * (int64_t)MaxThreadIndex());
+    int64_t partSize = (nHits + nParts - 1) / nParts;
+    std::vector<int64_t> partNext(nParts * nCells, 0);
+    ParallelFor(
+        [&](int64_t part) {
+            int64_t *next = &partNext[part * nCells];
+            int64_t end = std::min(nHits, (part + 1) * partSize);
+            for (int64_t i = part * partSize; i < end; ++i) ++next[brickOf[i]];
+        },
+        nParts);
+    // Bricks follow one another, and within each brick the parts do
+    std::vector<int64_t> hitStart(nCells + 1);
+    int64_t sum = 0;
+    for (int b = 0; b < nCells; ++b) {
+        hitStart[b] = sum;
+        for (int64_t part = 0; part < nParts; ++part) {
+            int64_t count = partNext[part * nCells + b];
+            partNext[part * nCells + b] = sum;
+            sum += count;
+        }
+    }
+    hitStart[nCells] = sum;
+    size_t offsetBytes = hitStart.capacity() * sizeof(int64_t);
+    std::vector<SPPMPhotonHit> sorted(nHits);
+    ParallelFor(
+        [&](int64_t part) {
+            int64_t *next = &partNext[part * nCells];
+            int64_t begin = part * partSize;
+            int64_t end = std::min(nHits, begin + partSize);
+            // Find the thread buffer that holds the part's first hit
+            size_t t = std::upper_bound(threadStart.begin(), threadStart.end(),
+                                        begin) -
+                       threadStart.begin() - 1;
+            for (int64_t i = begin; i < end; ++i) {
+                while (i >= threadStart[t + 1]) ++t;
+                sorted[next[brickOf[i]]++] = threadHits[t][i - threadStart[t]];
+            }
+        },
+        nParts);
+    size_t sortBytes = bufferBytes + nHits * sizeof(SPPMPhotonHit) +
+                       brickOf.capacity() * sizeof(int) +
+                       partNext.capacity() * sizeof(int64_t) + offsetBytes;
+    peakBytes = std::max(peakBytes, sortBytes);
+    for (std::vector<SPPMPhotonHit> &hits : threadHits) hits.clear();
+    std::vector<int>().swap(brickOf);
+    std::vector<int64_t>().swap(partNext);
+    size_t batchBytes =
+        bufferBytes + nHits * sizeof(SPPMPhotonHit) + offsetBytes;
+
+    // Look up each brick's hits in accelerators over its points, at most
+    // _maxBrickPoints_ of them at a time. Each point is in one chunk of the
+    // brick, so each hit still finds it once. A chunk whose accelerator
+    // doesn't fit beside the batch is halved and built again.
+    for (int b = 0; b < nCells; ++b) {
+        int64_t nBrickHits = hitStart[b + 1] - hitStart[b];
+        int64_t nBrickPoints = brickStart[b + 1] - brickStart[b];
+        if (nBrickHits == 0 || nBrickPoints == 0) continue;
+        size_t overBytes = 0;
+        for (int64_t first = 0; first < nBrickPoints;) {
+            int64_t n = std::min(maxBrickPoints, nBrickPoints - first);
+            std::vector<SPPMPixel *> points(n);
+            for (int64_t i = 0; i < n; ++i)
+                points[i] = base + (*brickPoints)[brickStart[b] + first + i];
+            accel->Build(points);
+            size_t brickBytes = accel->PeakBytesUsed() +
+                                points.capacity() * sizeof(SPPMPixel *);
+            measuredBytesPerPoint =
+                std::max(measuredBytesPerPoint, (double)brickBytes / n);
+            if (residentBytes + batchBytes + brickBytes > memoryBytes) {
+                // Give up once smaller chunks no longer need less memory
+                if (n == 1 || (overBytes > 0 && brickBytes >= overBytes))
+                    OverBudget("a photon batch and its accelerator",
+                               batchBytes + brickBytes);
+                overBytes = brickBytes;
+                maxBrickPoints = n / 2;
+                continue;
+            }
+            overBytes = 0;
+            peakBytes = std::max(peakBytes, batchBytes + brickBytes);
+
+            const int runSize = 256;
+            const SPPMPhotonHit *hits = &sorted[hitStart[b]];
+            ParallelFor(
+                [&](int64_t run) {
+                    int64_t start = run * runSize;
+                    query(hits + start,
+                          (int)std::min<int64_t>(runSize, nBrickHits - start));
+                },
+                (nBrickHits + runSize - 1) / runSize);
+            first += n;
+        }
+    }
+}
+
+void SPPMBricks::EndPass() {
+    for (std::vector<SPPMPhotonHit> &hits : threadHits)
+        std::vector<SPPMPhotonHit>().swap(hits);
+}
+
+size_t SPPMBricks::MappedBytes() const {
+    return brickPoints ? brickPoints->size() * sizeof(int) : 0;
+}
+
+std::vector<std::pair<std::string, double>> SPPMBricks::Shape() const {
+    size_t references = brickPoints ? brickPoints->size() : 0;
+    return {{"bricks", (double)nBricks},
+            {"brickDuplication",
+             nPoints > 0 ? (double)references / nPoints : 0.}};
+}
+
+}  // namespace pbrt
@@ -0,0 +1,196 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMOUTOFCORE_H
+#define SPPMOUTOFCORE_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "geometry.h"
+#include "memory.h"
+#include "parallel.h"
+#include "pbrt.h"
+#include "spectrum.h"
+#include "SPPM_Integrators/SPPM_Pixel.h"
+#include "SPPM_Integrators/accelerator.h"
+
+namespace pbrt {
+
+// Returns _bytes_ of zeroed memory backed by a deleted temporary file, so
+// that the operating system can page it out instead of keeping it in RAM.
+// Exits after reporting an error if there's no room for the file. Falls
+// back to ordinary memory where files can't be memory mapped.
+void *AllocSPPMScratch(size_t bytes);
+void FreeSPPMScratch(void *ptr, size_t bytes);
+
+// Array of _n_ default-constructed elements, in memory or, if _mapped_, in
+// a scratch file from AllocSPPMScratch(). The elements are constructed by
+// all threads, so that the pages land on the NUMA nodes of the threads that
+// first touch them rather than all on the main thread's.
+template <typename T>
+class SPPMMappedArray {
+  public:
+    SPPMMappedArray(size_t n, bool mapped) : n(n), mapped(mapped) {
+        ptr = mapped ? (T *)AllocSPPMScratch(n * sizeof(T))
+                     : AllocAligned<T>(n);
+        ParallelFor([&](int64_t i) { new (&ptr[i]) T(); }, n, 4096);
+    }
+    ~SPPMMappedArray() {
+        for (size_t i = 0; i < n; ++i) ptr[i].~T();
+        if (mapped)
+            FreeSPPMScratch(ptr, n * sizeof(T));
+        else
+            FreeAligned(ptr);
+    }
+    SPPMMappedArray(const SPPMMappedArray &) = delete;
+    SPPMMappedArray &operator=(const SPPMMappedArray &) = delete;
+
+    T *get() const { return ptr; }
+    T &operator[](size_t i) const { return ptr[i]; }
+    size_t size() const { return n; }
+
+  private:
+    // SPPMMappedArray Private Data
+    T *ptr;
+    const size_t n;
+    const bool mapped;
+};
+
+// A photon intersection recorded for a later deposit: where, the incident
+// direction toward the light, and the photon's throughput
+struct SPPMPhotonHit {
+    Point3f p;
+    Vector3f wi;
+    Spectrum beta;
+};
+
+// Out-of-core SPPM photon pass, for frames whose visible points and
+// accelerator don't fit in memory at once.
+//
+// Build() sorts the visible points into bricks, cells of a coarse grid
+// sized so that an accelerator over one brick's points fits in the memory
+// budget; a point goes into every brick its search sphere overlaps. The
+// brick lists live in a scratch file. The photon pass then runs in batches
+// whose hit records fit in the budget: AddHit() records them, and
+// ProcessHits() bins them by brick, builds the accelerator over each brick
+// that has hits in turn and looks up that brick's hits. Each hit is in
+// exactly one brick, so it finds every visible point it would with one
+// accelerator over all of them. Bricks whose accelerator would not fit are
+// looked up in chunks of their points.
+//
+// Each thread's hits go into a buffer of fixed capacity. Once one of them
+// is full, AddHit() fails and HasRoom() turns false for every thread; the
+// caller drops the hits of the path that didn't fit with DiscardPath(),
+// flushes the batch early with ProcessHits() and traces that path again.
+// Memory the budget can't provide is reported as an error, so the pass
+// never holds more than the budget.
+class SPPMBricks {
+  public:
+    // SPPMBricks Public Methods
+    // A photon path is expected to record up to _pathHits_ hits; longer
+    // paths are traced again once the buffers are flushed
+    SPPMBricks(size_t memoryBytes, int pathHits);
+    ~SPPMBricks();
+
+    // Sorts _pixels_, the pixels with a visible point in the array starting
+    // at _base_, into bricks. _residentBytes_ is the memory that other
+    // structures hold in RAM through the photon pass; the bricks and the
+    // batches share what's left of the budget.
+    void Build(const std::vector<SPPMPixel *> &pixels, SPPMPixel *base,
+               size_t residentBytes);
+    // End of the batch of photons starting at _begin_, before _end_, whose
+    // hits are expected to fit in memory
+    int NextBatchEnd(int begin, int end) const;
+    // Returns whether the calling thread may trace another photon before
+    // the hits are processed
+    bool HasRoom();
+    // Number of hits in the calling thread's buffer, where its next path's
+    // hits start
+    size_t PathStart() const { return threadHits[ThreadIndex].size(); }
+    // Records a hit; may be called concurrently from several threads.
+    // Returns false, keeping the hit out, once the thread's buffer is full.
+    bool AddHit(const Point3f &p, const Vector3f &wi, const Spectrum &beta);
+    // Drops the calling thread's hits from _start_ on, those of a path
+    // that didn't fit; if even an empty buffer can't hold the path,
+    // ProcessHits() exits with an error
+    void DiscardPath(size_t start);
+    // Rebuilds _accel_ over each brick with hits and calls _query_ with
+    // runs of that brick's hits, concurrently, then forgets the hits of the
+    // _nPhotons_ photons traced since the last call
+    void ProcessHits(
+        SPPMAccelerator *accel, int nPhotons,
+        const std::function<void(const SPPMPhotonHit *, int)> &query);
+    // Frees the hit buffers, which keep their capacity between the batches
+    // of a photon pass
+    void EndPass();
+
+    // Memory held in RAM by the last batch and its largest brick; with the
+    // resident memory given to Build() and the brick index, the peak, which
+    // stays within the budget; and the size of the brick lists in the
+    // scratch file
+    size_t BytesUsed() const { return peakBytes; }
+    size_t PeakBytesUsed() const { return residentBytes + peakBytes; }
+    size_t MappedBytes() const;
+    std::vector<std::pair<std::string, double>> Shape() const;
+
+  private:
+    // SPPMBricks Private Methods
+    // Budget left for the bricks and the batches
+    size_t AvailableBytes() const {
+        return memoryBytes > residentBytes ? memoryBytes - residentBytes : 0;
+    }
+    // Hits the per-thread buffers hold in all
+    int64_t HitBudget() const;
+    // Exits with an error naming what the budget can't hold; only called
+    // from the main thread, which stops the worker threads first
+    void OverBudget(const char *what, size_t bytes) const;
+    int BrickIndex(const Point3i &cell) const {
+        return (cell.z * res.y + cell.y) * res.x + cell.x;
+    }
+    Point3i Cell(const Point3f &p) const;
+    // First and last cells _pixel_'s search sphere overlaps
+    void CellRange(const SPPMPixel &pixel, Point3i *c0, Point3i *c1) const {
+        Bounds3f b = pixel.WorldBound();
+        *c0 = Cell(b.pMin);
+        *c1 = Cell(b.pMax);
+    }
+
+    // SPPMBricks Private Data
+    const size_t memoryBytes;
+    const int pathHits;
+    size_t residentBytes = 0;
+    SPPMPixel *base = nullptr;
+    Bounds3f bounds;
+    Point3i res;
+    // Pixel indices of each brick's points, brick after brick, and the
+    // start of each brick's run
+    std::unique_ptr<SPPMMappedArray<int>> brickPoints;
+    std::vector<int64_t> brickStart;
+    std::vector<std::vector<SPPMPhotonHit>> threadHits;
+    size_t threadCapacity = 0;
+    // Set once a thread's hit buffer is full, until the hits are processed
+    std::atomic<bool> full;
+    // Set once a path didn't fit in an empty buffer
+    std::atomic<bool> pathTooLong;
+    int nPoints = 0, nBricks = 0;
+    // Most points an accelerator is built over at once
+    int64_t maxBrickPoints = 1;
+    // Estimates for sizing bricks and batches, updated from each build and
+    // batch; until the first batch, photons are assumed to record a hit at
+    // every bounce
+    double bytesPerPoint = 64, measuredBytesPerPoint = 0, hitsPerPhoton;
+    size_t peakBytes = 0;
+};
+
+}  // namespace pbrt
+
+#endif  // SPPMOUTOFCORE_H
@@ -0,0 +1,148 @@
+
+#include "SPPM_Integrators/SPPM_PerfCounters.h"
+
+#include <errno.h>
+#include <string.h>
+#include <mutex>
+#include <string>
+
+#include "parallel.h"
+
+#ifdef PBRT_HAVE_PERF_EVENT
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace pbrt {
+
+static const char *eventNames[nSPPMPerfEvents] = {
+    "cycles", "instructions", "llcMisses", "branchMisses", "dtlbMisses"};
+
+const char *SPPMPerfEventName(int event) { return eventNames[event]; }
+
+#ifdef PBRT_HAVE_PERF_EVENT
+
+// Opens _event_ for the calling thread; returns -1 and sets errno on
+// failure
+static int OpenEvent(int event) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    auto cacheMiss = [](uint64_t cache) {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    };
+    switch ((SPPMPerfEvent)event) {
+    case SPPMPerfEvent::Cycles:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case SPPMPerfEvent::Instructions:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case SPPMPerfEvent::LLCMisses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = cacheMiss(PERF_COUNT_HW_CACHE_LL);
+        break;
+    case SPPMPerfEvent::BranchMisses:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    case SPPMPerfEvent::DTLBMisses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = cacheMiss(PERF_COUNT_HW_CACHE_DTLB);
+        break;
+    }
+    // pid 0 and cpu -1: the calling thread, on whichever CPU it runs
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1,
+                   PERF_FLAG_FD_CLOEXEC);
+}
+
+SPPMPerfCounters::SPPMPerfCounters() {
+    int nThreads = MaxThreadIndex();
+    fds.assign(nThreads * nSPPMPerfEvents, -1);
+
+    // Events must be opened by the thread they count. Run one task per
+    // thread and hold every task at a barrier until all have started, so
+    // that no thread can pick up a second one.
+    std::mutex errorMutex;
+    int error[nSPPMPerfEvents] = {};
+    Barrier barrier(nThreads);
+    ParallelFor(
+        [&](int64_t) {
+            for (int e = 0; e < nSPPMPerfEvents; ++e) {
+                int fd = OpenEvent(e);
+                if (fd >= 0)
+                    fds[ThreadIndex * nSPPMPerfEvents + e] = fd;
+                else {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    error[e] = errno;
+                }
+            }
+            barrier.Wait();
+        },
+        nThreads);
+
+    // An event only counts if every thread has it
+    std::string unavailable;
+    for (int e = 0; e < nSPPMPerfEvents; ++e) {
+        valid[e] = error[e] == 0;
+        if (valid[e]) continue;
+        for (int t = 0; t < nThreads; ++t) {
+            int &fd = fds[t * nSPPMPerfEvents + e];
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+        unavailable += std::string(unavailable.empty() ? "" : ", ") +
+                       eventNames[e] + " (" + strerror(error[e]) + ")";
+    }
+    if (!unavailable.empty())
+        Warning("Hardware performance counters unavailable: %s",
+                unavailable.c_str());
+}
+
+SPPMPerfCounters::~SPPMPerfCounters() {
+    for (int fd : fds)
+        if (fd >= 0) close(fd);
+}
+
+SPPMPerfCounts SPPMPerfCounters::Read() const {
+    SPPMPerfCounts counts;
+    for (size_t i = 0; i < fds.size(); ++i) {
+        int e = i % nSPPMPerfEvents;
+        counts.valid[e] = valid[e];
+        if (fds[i] < 0) continue;
+        // value, time enabled, time running
+        uint64_t v[3];
+        if (read(fds[i], v, sizeof(v)) != sizeof(v) || v[2] == 0) continue;
+        counts.count[e] +=
+            v[2] < v[1] ? (int64_t)((double)v[0] * v[1] / v[2]) : v[0];
+    }
+    return counts;
+}
+
+#else
+
+SPPMPerfCounters::SPPMPerfCounters() {
+    Warning("Hardware performance counters are only supported on Linux");
+}
+
+SPPMPerfCounters::~SPPMPerfCounters() {}
+
+SPPMPerfCounts SPPMPerfCounters::Read() const { return SPPMPerfCounts(); }
+
+#endif  // PBRT_HAVE_PERF_EVENT
+
+bool SPPMPerfCounters::Available() const {
+    for (bool v : valid)
+        if (v) return true;
+    return false;
+}
+
+}  // namespace pbrt
@@ -0,0 +1,82 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMPERFCOUNTERS_H
+#define SPPMPERFCOUNTERS_H
+
+#include <vector>
+
+#include "pbrt.h"
+
+namespace pbrt {
+
+enum class SPPMPerfEvent {
+    Cycles,
+    Instructions,
+    LLCMisses,
+    BranchMisses,
+    DTLBMisses
+};
+static const int nSPPMPerfEvents = 5;
+
+// Short name of an event, e.g. "cycles" or "llcMisses"
+const char *SPPMPerfEventName(int event);
+
+// Event counts summed over threads; an event that could not be opened has
+// valid[event] == false and a count of zero
+struct SPPMPerfCounts {
+    int64_t count[nSPPMPerfEvents] = {};
+    bool valid[nSPPMPerfEvents] = {};
+
+    SPPMPerfCounts operator-(const SPPMPerfCounts &c) const {
+        SPPMPerfCounts r = *this;
+        for (int i = 0; i < nSPPMPerfEvents; ++i) r.count[i] -= c.count[i];
+        return r;
+    }
+    SPPMPerfCounts &operator+=(const SPPMPerfCounts &c) {
+        for (int i = 0; i < nSPPMPerfEvents; ++i) {
+            count[i] += c.count[i];
+            valid[i] = valid[i] || c.valid[i];
+        }
+        return *this;
+    }
+};
+
+// Hardware performance counters on every pbrt thread, read through Linux
+// perf_event_open.
+//
+// The constructor opens the counters of each thread started by
+// ParallelInit(), so it has to be called after ParallelInit() and the
+// object destroyed before ParallelCleanup(). Counting starts right away;
+// callers take differences of Read() around the work they measure. Where
+// perf events aren't supported (other platforms, containers, a restrictive
+// kernel.perf_event_paranoid, virtual machines without a PMU) the affected
+// events are reported as unavailable and Read() returns zero counts for
+// them.
+class SPPMPerfCounters {
+  public:
+    SPPMPerfCounters();
+    ~SPPMPerfCounters();
+    SPPMPerfCounters(const SPPMPerfCounters &) = delete;
+    SPPMPerfCounters &operator=(const SPPMPerfCounters &) = delete;
+
+    // True if at least one event could be opened on every thread
+    bool Available() const;
+
+    // Counts since construction, summed over all threads. Multiplexed
+    // events are scaled by the fraction of the time they were scheduled.
+    SPPMPerfCounts Read() const;
+
+  private:
+    // SPPMPerfCounters Private Data
+    // fds[thread * nSPPMPerfEvents + event], -1 where unavailable
+    std::vector<int> fds;
+    bool valid[nSPPMPerfEvents] = {};
+};
+
+}  // namespace pbrt
+
+#endif  // SPPMPERFCOUNTERS_H
@@ -0,0 +1,158 @@
+
+#include "SPPM_Integrators/SPPM_PhotonSampler.h"
+
+#include <algorithm>
+
+#include "lowdiscrepancy.h"
+
+namespace pbrt {
+
+// SPPM Photon Sampler Local Definitions
+// Base-2 radical inverse of _a_, as RadicalInverse() computes it
+static inline Float RadicalInverse2(uint64_t a) {
+    return ReverseBits64(a) * 5.4210108624275222e-20;
+}
+
+// Sobol' sample with the bits _v_ of its generator matrix product, as
+// SobolSample() computes it
+#ifdef PBRT_FLOAT_AS_DOUBLE
+typedef uint64_t SobolBits;
+static inline const uint64_t *SobolColumns(int dimension) {
+    return &SobolMatrices64[dimension * SobolMatrixSize];
+}
+static inline Float SobolValue(uint64_t v) {
+    return std::min(v * (1.0 / (1ULL << SobolMatrixSize)),
+                    DoubleOneMinusEpsilon);
+}
+#else
+typedef uint32_t SobolBits;
+static inline const uint32_t *SobolColumns(int dimension) {
+    return &SobolMatrices32[dimension * SobolMatrixSize];
+}
+static inline Float SobolValue(uint32_t v) {
+    return std::min(v * 2.3283064365386963e-10f /* 1/2^32 */,
+                    FloatOneMinusEpsilon);
+}
+#endif
+
+// SPPMPhotonSampler Method Definitions
+SPPMPhotonSampler::SPPMPhotonSampler(SPPMSampleSequence sequence,
+                                     int nDimensions)
+    : sequence(sequence),
+      nDimensions(std::min(nDimensions,
+                           sequence == SPPMSampleSequence::Halton
+                               ? PrimeTableSize
+                               : NumSobolDimensions)),
+      rows(this->nDimensions * blockSize) {}
+
+void SPPMPhotonSampler::StartBatch(uint64_t first, uint64_t end) {
+    batchFirst = first;
+    batchEnd = end;
+    blockCount = 0;
+}
+
+void SPPMPhotonSampler::StartPhoton(uint64_t index) {
+    this->index = index;
+    if (index >= blockFirst && index < blockFirst + blockCount) return;
+    // Start the block that holds _index_
+    blockFirst = index - (index - batchFirst) % blockSize;
+    blockCount = (int)std::min<uint64_t>(blockSize, batchEnd - blockFirst);
+    nRows = 0;
+}
+
+Float SPPMPhotonSampler::Get(int dimension) {
+    if (dimension >= nDimensions) return Compute(dimension, index);
+    while (nRows <= dimension) GenerateRow(nRows++);
+    return rows[dimension * blockSize + (index - blockFirst)];
+}
+
+Float SPPMPhotonSampler::Compute(int dimension, uint64_t index) const {
+    if (sequence == SPPMSampleSequence::Halton)
+        return RadicalInverse(dimension, index);
+    return SobolSample(index, dimension);
+}
+
+void SPPMPhotonSampler::GenerateRow(int dimension) {
+    Float *row = &rows[dimension * blockSize];
+    if (sequence == SPPMSampleSequence::Sobol)
+        GenerateSobolRow(dimension, row);
+    else if (dimension == 0) {
+        for (int i = 0; i < blockCount; ++i)
+            row[i] = RadicalInverse2(blockFirst + i);
+    } else
+        GenerateHaltonRow(Primes[dimension], row);
+}
+
+void SPPMPhotonSampler::GenerateHaltonRow(int base, Float *row) const {
+    // Powers of the base and of its inverse, the latter multiplied up as
+    // RadicalInverse() does so that the values come out the same
+    const Float invBase = (Float)1 / (Float)base;
+    uint64_t power[64];
+    Float invBaseN[65];
+    invBaseN[0] = 1;
+    for (int i = 0; i < 64; ++i) invBaseN[i + 1] = invBaseN[i] * invBase;
+
+    // Digits of the first index, least significant first, and their
+    // reversal
+    uint16_t digits[64];
+    int nDigits = 0;
+    uint64_t reversed = 0;
+    for (uint64_t a = blockFirst; a; ++nDigits) {
+        uint64_t next = a / base;
+        digits[nDigits] = a - next * base;
+        reversed = reversed * base + digits[nDigits];
+        a = next;
+    }
+    power[0] = 1;
+    for (int i = 1; i < std::max(nDigits, 1); ++i)
+        power[i] = power[i - 1] * base;
+
+    // Step through the block's indices, carrying from the least
+    // significant digit, which is the most significant of the reversal
+    uint64_t reversedDigits[blockSize];
+    uint8_t digitCount[blockSize];
+    for (int i = 0; i < blockCount; ++i) {
+        reversedDigits[i] = reversed;
+        digitCount[i] = nDigits;
+        int d = 0;
+        while (d < nDigits && digits[d] == base - 1) {
+            digits[d] = 0;
+            reversed -= (uint64_t)(base - 1) * power[nDigits - 1 - d];
+            ++d;
+        }
+        if (d == nDigits) {
+            // The index is now a power of the base and gains a digit
+            digits[nDigits] = 1;
+            if (nDigits > 0) power[nDigits] = power[nDigits - 1] * base;
+            ++nDigits;
+            reversed = 1;
+        } else {
+            ++digits[d];
+            reversed += power[nDigits - 1 - d];
+        }
+    }
+    for (int i = 0; i < blockCount; ++i)
+        row[i] = std::min(reversedDigits[i] * invBaseN[digitCount[i]],
+                          OneMinusEpsilon);
+}
+
+void SPPMPhotonSampler::GenerateSobolRow(int dimension, Float *row) const {
+    const SobolBits *columns = SobolColumns(dimension);
+    SobolBits v = 0;
+    int column = 0;
+    for (uint64_t a = blockFirst; a != 0; a >>= 1, ++column)
+        if (a & 1) v ^= columns[column];
+    SobolBits bits[blockSize];
+    for (int i = 0; i < blockCount; ++i) {
+        bits[i] = v;
+        // Flip the columns of the index bits that change
+        uint64_t a = blockFirst + i;
+        column = 0;
+        for (uint64_t flipped = a ^ (a + 1); flipped != 0;
+             flipped >>= 1, ++column)
+            if (flipped & 1) v ^= columns[column];
+    }
+    for (int i = 0; i < blockCount; ++i) row[i] = SobolValue(bits[i]);
+}
+
+}  // namespace pbrt
@@ -0,0 +1,68 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMPHOTONSAMPLER_H
+#define SPPMPHOTONSAMPLER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "pbrt.h"
+
+namespace pbrt {
+
+// Low-discrepancy sequences the SPPM photon pass can draw from
+enum class SPPMSampleSequence { Halton, Sobol };
+
+// Sample values of the SPPM photon paths, with the photon's index in the
+// sequence as its sample index and one dimension per sample value.
+//
+// The values are computed a block of consecutive photons at a time, one
+// dimension after another as the photons of the block ask for them: a
+// Halton row updates the index's digits in place from one photon to the
+// next instead of reversing all of them, and a Sobol' row XORs in the
+// columns of the index bits that change. The rows are contiguous, so the
+// loops that turn the digits into values vectorize. In Halton mode the
+// values are exactly those of RadicalInverse(dimension, index).
+//
+// A sampler isn't thread-safe; each thread uses its own.
+class SPPMPhotonSampler {
+  public:
+    // SPPMPhotonSampler Public Methods
+    // Dimensions from _nDimensions_ on are computed one value at a time
+    SPPMPhotonSampler(SPPMSampleSequence sequence, int nDimensions);
+
+    // Photons [_first_, _end_) of the sequence are about to be traced;
+    // blocks start at multiples of the block size from _first_ and stop at
+    // _end_
+    void StartBatch(uint64_t first, uint64_t end);
+    // Makes the samples of photon _index_, in the current batch, those
+    // that Get() returns
+    void StartPhoton(uint64_t index);
+    Float Get(int dimension);
+
+  private:
+    // SPPMPhotonSampler Private Methods
+    Float Compute(int dimension, uint64_t index) const;
+    void GenerateRow(int dimension);
+    void GenerateHaltonRow(int base, Float *row) const;
+    void GenerateSobolRow(int dimension, Float *row) const;
+
+    // SPPMPhotonSampler Private Data
+    static const int blockSize = 256;
+    const SPPMSampleSequence sequence;
+    const int nDimensions;
+    uint64_t batchFirst = 0, batchEnd = 0;
+    // Photons [blockFirst, blockFirst + blockCount) have rows
+    // [0, nRows) of their values in _rows_
+    uint64_t blockFirst = 0, index = 0;
+    int blockCount = 0, nRows = 0;
+    std::vector<Float> rows;
+};
+
+}  // namespace pbrt
+
+#endif  // SPPMPHOTONSAMPLER_H
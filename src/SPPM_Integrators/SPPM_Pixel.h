@@ -0,0 +1,90 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMPIXEL_H
+#define SPPMPIXEL_H
+
+#include <atomic>
+
+#include "geometry.h"
+#include "parallel.h"
+#include "pbrt.h"
+#include "spectrum.h"
+
+namespace pbrt {
+
+// SPPM Local Definitions
+
+// Per-pixel SPPM state that the photon pass reads or updates at every
+// deposit: the visible point, its search radius and the flux gathered this
+// iteration. The state used once per iteration or at image write lives in
+// a parallel array of SPPMPixelCold, so that the photon pass only streams
+// through these bytes.
+struct SPPMPixel {
+    // SPPMPixel Public Methods
+    SPPMPixel() : M(0) {}
+    Bounds3f WorldBound() const {
+        Bounds3f b(vp.p);
+        b.pMin = vp.p - Vector3f(radius, radius, radius);
+        b.pMax = vp.p + Vector3f(radius, radius, radius);
+        return b;
+    }
+#if defined(PBRT_SAMPLED_SPECTRUM) && defined(PBRT_SPPM_RGB_FLUX)
+    // Gather the flux as RGB rather than with every spectral sample
+    static constexpr int nFluxSamples = 3;
+    void AddFlux(const Spectrum &phi) {
+        Float rgb[3];
+        phi.ToRGB(rgb);
+        for (int i = 0; i < 3; ++i) Phi[i].Add(rgb[i]);
+    }
+    Spectrum Flux() const {
+        Float rgb[3] = {Phi[0], Phi[1], Phi[2]};
+        return Spectrum::FromRGB(rgb, SpectrumType::Illuminant);
+    }
+#else
+    static constexpr int nFluxSamples = Spectrum::nSamples;
+    void AddFlux(const Spectrum &phi) {
+        for (int i = 0; i < nFluxSamples; ++i) Phi[i].Add(phi[i]);
+    }
+    Spectrum Flux() const {
+        Spectrum phi;
+        for (int i = 0; i < nFluxSamples; ++i) phi[i] = Phi[i];
+        return phi;
+    }
+#endif
+    void ResetFlux() {
+        for (AtomicFloat &phi : Phi) phi = 0;
+        M = 0;
+    }
+
+    // SPPMPixel Public Data
+    Float radius = 0;
+    struct VisiblePoint {
+        // VisiblePoint Public Methods
+        VisiblePoint() {}
+        VisiblePoint(const Point3f &p, const Vector3f &wo, const BSDF *bsdf)
+            : p(p), wo(wo), bsdf(bsdf) {}
+        Point3f p;
+        Vector3f wo;
+        const BSDF *bsdf = nullptr;
+    } vp;
+    AtomicFloat Phi[nFluxSamples];
+    std::atomic<int> M;
+};
+
+// Per-pixel SPPM state that only the camera pass and the per-iteration
+// update touch
+struct SPPMPixelCold {
+    Spectrum Ld;
+    // Path throughput at the visible point; black if there is none
+    Spectrum beta;
+    Float N = 0;
+    Spectrum tau;
+};
+
+}  // namespace pbrt
+
+#endif  // SPPMPIXEL_H
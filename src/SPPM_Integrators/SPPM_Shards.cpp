@@ -0,0 +1,310 @@
+
+#include "SPPM_Integrators/SPPM_Shards.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef PBRT_IS_WINDOWS
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace pbrt {
+
+// SPPM Shard Local Definitions
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// A nonzero delta as sent over the socket, with its visible point's index
+struct SPPMSparseDelta {
+    int32_t index;
+    SPPMFluxDelta delta;
+};
+
+#ifndef PBRT_IS_WINDOWS
+static bool SendAll(int fd, const void *data, size_t size) {
+    const char *p = (const char *)data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool ReceiveAll(int fd, void *data, size_t size) {
+    char *p = (char *)data;
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool SendDeltas(int fd, const std::vector<SPPMSparseDelta> &deltas) {
+    uint32_t n = deltas.size();
+    return SendAll(fd, &n, sizeof(n)) &&
+           SendAll(fd, deltas.data(), n * sizeof(SPPMSparseDelta));
+}
+
+static bool ReceiveDeltas(int fd, std::vector<SPPMSparseDelta> *deltas) {
+    uint32_t n;
+    if (!ReceiveAll(fd, &n, sizeof(n))) return false;
+    deltas->resize(n);
+    return ReceiveAll(fd, deltas->data(), n * sizeof(SPPMSparseDelta));
+}
+
+static bool SendCounts(int fd, const std::vector<uint64_t> &counts) {
+    uint32_t n = counts.size();
+    return SendAll(fd, &n, sizeof(n)) &&
+           SendAll(fd, counts.data(), n * sizeof(uint64_t));
+}
+
+static bool ReceiveCounts(int fd, std::vector<uint64_t> *counts) {
+    uint32_t n;
+    if (!ReceiveAll(fd, &n, sizeof(n)) || n != counts->size()) return false;
+    return ReceiveAll(fd, counts->data(), n * sizeof(uint64_t));
+}
+#endif  // !PBRT_IS_WINDOWS
+
+static std::vector<SPPMSparseDelta> Sparse(
+    const std::vector<SPPMFluxDelta> &deltas) {
+    std::vector<SPPMSparseDelta> sparse;
+    for (size_t i = 0; i < deltas.size(); ++i)
+        if (deltas[i].M > 0) sparse.push_back({(int32_t)i, deltas[i]});
+    return sparse;
+}
+
+void SPPMShardRange(int photons, int shard, int nShards, int *begin,
+                    int *end) {
+    *begin = (int64_t)photons * shard / nShards;
+    *end = (int64_t)photons * (shard + 1) / nShards;
+}
+
+// SPPMPhotonShards Method Definitions
+SPPMPhotonShards::SPPMPhotonShards(std::vector<int> workerSockets)
+    : workerSockets(std::move(workerSockets)) {}
+
+SPPMPhotonShards::SPPMPhotonShards(int coordinatorSocket)
+    : coordinatorSocket(coordinatorSocket) {}
+
+SPPMPhotonShards::~SPPMPhotonShards() {
+    Finish();
+#ifndef PBRT_IS_WINDOWS
+    if (coordinatorSocket != -1) close(coordinatorSocket);
+#endif
+}
+
+bool SPPMPhotonShards::ExchangePlan(SPPMShardPlan *plan) {
+#ifndef PBRT_IS_WINDOWS
+    if (IsWorker())
+        return ReceiveAll(coordinatorSocket, plan, sizeof(*plan));
+    int nShards = NumShards();
+    for (size_t i = 0; i < workerSockets.size(); ++i) {
+        SPPMShardPlan workerPlan = *plan;
+        SPPMShardRange(plan->photons, i + 1, nShards, &workerPlan.begin,
+                       &workerPlan.end);
+        if (!SendAll(workerSockets[i], &workerPlan, sizeof(workerPlan)))
+            return false;
+    }
+    SPPMShardRange(plan->photons, 0, nShards, &plan->begin, &plan->end);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool SPPMPhotonShards::Merge(std::vector<SPPMFluxDelta> *deltas) {
+#ifndef PBRT_IS_WINDOWS
+    std::vector<SPPMSparseDelta> sparse;
+    if (IsWorker()) {
+        if (!SendDeltas(coordinatorSocket, Sparse(*deltas)) ||
+            !ReceiveDeltas(coordinatorSocket, &sparse))
+            return false;
+        for (SPPMFluxDelta &d : *deltas) d = SPPMFluxDelta();
+        for (const SPPMSparseDelta &s : sparse) {
+            if (s.index < 0 || s.index >= (int)deltas->size()) return false;
+            (*deltas)[s.index] = s.delta;
+        }
+        return true;
+    }
+
+    // Add the workers' deltas in worker order, so that every render sums
+    // them the same way
+    for (int fd : workerSockets) {
+        if (!ReceiveDeltas(fd, &sparse)) return false;
+        for (const SPPMSparseDelta &s : sparse) {
+            if (s.index < 0 || s.index >= (int)deltas->size()) return false;
+            SPPMFluxDelta &d = (*deltas)[s.index];
+            for (int c = 0; c < SPPMPixel::nFluxSamples; ++c)
+                d.Phi[c] += s.delta.Phi[c];
+            d.M += s.delta.M;
+        }
+    }
+    sparse = Sparse(*deltas);
+    for (int fd : workerSockets)
+        if (!SendDeltas(fd, sparse)) return false;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool SPPMPhotonShards::MergeCounts(std::vector<uint64_t> *counts) {
+#ifndef PBRT_IS_WINDOWS
+    if (IsWorker())
+        return SendCounts(coordinatorSocket, *counts) &&
+               ReceiveCounts(coordinatorSocket, counts);
+    std::vector<uint64_t> workerCounts(counts->size());
+    for (int fd : workerSockets) {
+        if (!ReceiveCounts(fd, &workerCounts)) return false;
+        for (size_t i = 0; i < counts->size(); ++i)
+            (*counts)[i] += workerCounts[i];
+    }
+    for (int fd : workerSockets)
+        if (!SendCounts(fd, *counts)) return false;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void SPPMPhotonShards::Finish() {
+    if (finished || IsWorker()) return;
+    finished = true;
+#ifndef PBRT_IS_WINDOWS
+    SPPMShardPlan done = {-1, 0, 0, 0, 0};
+    for (int fd : workerSockets) {
+        SendAll(fd, &done, sizeof(done));
+        close(fd);
+    }
+    for (int pid : workerPids) {
+        int status;
+        while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+            ;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            Warning("SPPM shard worker %d exited abnormally", pid);
+    }
+#endif
+}
+
+std::unique_ptr<SPPMPhotonShards> StartSPPMShardWorkers(
+    int nShards, const std::vector<std::string> &commandLine, int nThreads) {
+#ifndef PBRT_IS_WINDOWS
+    const char *tmpdir = getenv("TMPDIR");
+    std::string socketPath =
+        StringPrintf("%s/pbrt-sppm-%d.sock", tmpdir ? tmpdir : "/tmp",
+                     (int)getpid());
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        Error("%s: socket path too long", socketPath.c_str());
+        return nullptr;
+    }
+    strcpy(addr.sun_path, socketPath.c_str());
+    unlink(socketPath.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == -1 || bind(listener, (sockaddr *)&addr, sizeof(addr)) ||
+        listen(listener, nShards)) {
+        Error("%s: %s", socketPath.c_str(), strerror(errno));
+        if (listener != -1) close(listener);
+        return nullptr;
+    }
+
+    // Workers run this command line, with the socket to connect to and the
+    // thread count of this process
+    std::vector<std::string> args = commandLine;
+    args.push_back("--sppmworker");
+    args.push_back(socketPath);
+    args.push_back("--nthreads");
+    args.push_back(std::to_string(nThreads));
+    std::vector<char *> argv;
+    for (std::string &arg : args) argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+
+    std::unique_ptr<SPPMPhotonShards> shards(
+        new SPPMPhotonShards(std::vector<int>()));
+    bool ok = true;
+    for (int i = 1; i < nShards && ok; ++i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            execv("/proc/self/exe", argv.data());
+            execvp(argv[0], argv.data());
+            _exit(127);
+        }
+        if (pid == -1) {
+            Error("fork: %s", strerror(errno));
+            ok = false;
+        } else
+            shards->workerPids.push_back(pid);
+    }
+
+    // Wait for every worker to load the scene and connect, giving up if
+    // one exits first
+    while (ok && shards->workerSockets.size() + 1 < (size_t)nShards) {
+        pollfd pfd = {listener, POLLIN, 0};
+        int n = poll(&pfd, 1, 100);
+        if (n > 0) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd != -1) shards->workerSockets.push_back(fd);
+            continue;
+        }
+        for (int pid : shards->workerPids) {
+            int status;
+            if (waitpid(pid, &status, WNOHANG) == pid) {
+                Error("SPPM shard worker %d exited before connecting", pid);
+                ok = false;
+                break;
+            }
+        }
+    }
+    close(listener);
+    unlink(socketPath.c_str());
+    if (!ok) {
+        for (int pid : shards->workerPids) kill(pid, SIGTERM);
+        return nullptr;
+    }
+    return shards;
+#else
+    Error("SPPM photon shards need Unix domain sockets");
+    return nullptr;
+#endif
+}
+
+std::unique_ptr<SPPMPhotonShards> ConnectSPPMShardCoordinator(
+    const std::string &socketPath) {
+#ifndef PBRT_IS_WINDOWS
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        Error("%s: socket path too long", socketPath.c_str());
+        return nullptr;
+    }
+    strcpy(addr.sun_path, socketPath.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (sockaddr *)&addr, sizeof(addr))) {
+        Error("%s: %s", socketPath.c_str(), strerror(errno));
+        if (fd != -1) close(fd);
+        return nullptr;
+    }
+    return std::unique_ptr<SPPMPhotonShards>(new SPPMPhotonShards(fd));
+#else
+    Error("SPPM photon shards need Unix domain sockets");
+    return nullptr;
+#endif
+}
+
+}  // namespace pbrt
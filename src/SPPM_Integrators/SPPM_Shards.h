@@ -0,0 +1,100 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMSHARDS_H
+#define SPPMSHARDS_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "pbrt.h"
+#include "SPPM_Integrators/SPPM_Pixel.h"
+
+namespace pbrt {
+
+// What each process does in one SPPM iteration. _iteration_ is -1 once the
+// render is done.
+struct SPPMShardPlan {
+    int32_t iteration;
+    int32_t photons;
+    // Photons shot by the iterations before this one
+    uint64_t photonsShot;
+    // Photon indices this process traces, in [0, photons)
+    int32_t begin, end;
+};
+
+// The flux and photon count a photon pass added to one visible point
+struct SPPMFluxDelta {
+    Float Phi[SPPMPixel::nFluxSamples];
+    int32_t M;
+};
+
+// Photons [*begin, *end) of _photons_ are traced by shard _shard_
+void SPPMShardRange(int photons, int shard, int nShards, int *begin,
+                    int *end);
+
+// Splits the photon pass of an SPPM render across processes.
+//
+// Every process holds the scene and runs the camera pass, which depends
+// only on the iteration, so all of them have the same visible points.
+// Each traces a disjoint range of photon indices and the coordinator sums
+// the per-pixel flux deltas, in a fixed order, and sends the total back.
+// All processes then run the same radius update on the same numbers, which
+// keeps their pixel state identical.
+//
+// The coordinator starts its workers by running the same command line with
+// --sppmworker and talks to each over a Unix domain socket.
+class SPPMPhotonShards {
+  public:
+    // A coordinator with a connected socket per worker
+    SPPMPhotonShards(std::vector<int> workerSockets);
+    // A worker connected to its coordinator
+    SPPMPhotonShards(int coordinatorSocket);
+    ~SPPMPhotonShards();
+    SPPMPhotonShards(const SPPMPhotonShards &) = delete;
+    SPPMPhotonShards &operator=(const SPPMPhotonShards &) = delete;
+
+    bool IsWorker() const { return coordinatorSocket != -1; }
+    int NumShards() const { return workerSockets.size() + 1; }
+
+    // The coordinator sends the plan for _plan->iteration_ to the workers
+    // and keeps the first photon range; a worker receives its plan. Returns
+    // false on a lost connection.
+    bool ExchangePlan(SPPMShardPlan *plan);
+    // Replaces the deltas of this process' photons with the sum over all
+    // processes. Only nonzero deltas are sent.
+    bool Merge(std::vector<SPPMFluxDelta> *deltas);
+    // Replaces _counts_, which must have the same size in every process,
+    // with their sum over all processes
+    bool MergeCounts(std::vector<uint64_t> *counts);
+    // Tells the workers the render is done and waits for them to exit
+    void Finish();
+
+  private:
+    // SPPMPhotonShards Private Data
+    std::vector<int> workerSockets;
+    int coordinatorSocket = -1;
+    std::vector<int> workerPids;
+    bool finished = false;
+
+    friend std::unique_ptr<SPPMPhotonShards> StartSPPMShardWorkers(
+        int nShards, const std::vector<std::string> &commandLine,
+        int nThreads);
+};
+
+// Starts _nShards_ - 1 worker processes running _commandLine_ and waits for
+// them to connect. Returns nullptr after reporting an error on failure.
+std::unique_ptr<SPPMPhotonShards> StartSPPMShardWorkers(
+    int nShards, const std::vector<std::string> &commandLine, int nThreads);
+// Connects a worker to the coordinator listening at _socketPath_
+std::unique_ptr<SPPMPhotonShards> ConnectSPPMShardCoordinator(
+    const std::string &socketPath);
+
+}  // namespace pbrt
+
+#endif  // SPPMSHARDS_H
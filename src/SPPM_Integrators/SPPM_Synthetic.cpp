@@ -0,0 +1,209 @@
+
+#include "SPPM_Integrators/SPPM_Synthetic.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "parallel.h"
+#include "reflection.h"
+#include "rng.h"
+
+namespace pbrt {
+
+static const Float boxSize = 10;
+
+bool ParseSPPMSyntheticDistribution(const std::string &name,
+                                    SPPMSyntheticDistribution *dist) {
+    if (name == "uniform")
+        *dist = SPPMSyntheticDistribution::Uniform;
+    else if (name == "planar")
+        *dist = SPPMSyntheticDistribution::Planar;
+    else if (name == "clusters")
+        *dist = SPPMSyntheticDistribution::Clusters;
+    else if (name == "radiusvar")
+        *dist = SPPMSyntheticDistribution::RadiusVariance;
+    else if (name == "surfaces")
+        *dist = SPPMSyntheticDistribution::Surfaces;
+    else
+        return false;
+    return true;
+}
+
+// Cluster centers and sizes; cluster _i_ is picked with probability
+// proportional to 1 / (i + 1) and has a spread proportional to its weight
+struct ClusterSet {
+    std::vector<Point3f> centers;
+    std::vector<Float> sigma, cdf;
+};
+
+static ClusterSet MakeClusters(int nClusters, uint64_t seed) {
+    ClusterSet clusters;
+    RNG rng(seed ^ 0x5eed5eedull);
+    Float sum = 0;
+    for (int i = 0; i < nClusters; ++i) {
+        clusters.centers.push_back(Point3f(
+            boxSize * (.1f + .8f * rng.UniformFloat()),
+            boxSize * (.1f + .8f * rng.UniformFloat()),
+            boxSize * (.1f + .8f * rng.UniformFloat())));
+        Float weight = 1.f / (i + 1);
+        clusters.sigma.push_back(boxSize * .01f * std::sqrt(weight));
+        sum += weight;
+        clusters.cdf.push_back(sum);
+    }
+    for (Float &c : clusters.cdf) c /= sum;
+    return clusters;
+}
+
+// Returns a point on the floor, back wall or sphere of the Surfaces layout
+static Point3f SampleSurfaces(RNG &rng) {
+    Float u = rng.UniformFloat();
+    Float s = rng.UniformFloat(), t = rng.UniformFloat();
+    if (u < .5f) return Point3f(s * boxSize, 0, t * boxSize);
+    if (u < .7f) return Point3f(s * boxSize, t * boxSize, boxSize);
+    Float z = 1 - 2 * s, r = std::sqrt(std::max((Float)0, 1 - z * z));
+    Float phi = 2 * Pi * t;
+    return Point3f(5 + 2 * r * std::cos(phi), 3 + 2 * z,
+                   5 + 2 * r * std::sin(phi));
+}
+
+static Point3f SamplePosition(const SPPMSyntheticParams &params,
+                              const ClusterSet &clusters, RNG &rng) {
+    switch (params.distribution) {
+    case SPPMSyntheticDistribution::Uniform:
+        return Point3f(rng.UniformFloat(), rng.UniformFloat(),
+                       rng.UniformFloat()) *
+               boxSize;
+    case SPPMSyntheticDistribution::Planar:
+        return Point3f(rng.UniformFloat() * boxSize,
+                       boxSize * (.5f + params.thickness *
+                                            (rng.UniformFloat() - .5f)),
+                       rng.UniformFloat() * boxSize);
+    case SPPMSyntheticDistribution::Clusters: {
+        Float u = rng.UniformFloat();
+        int c = std::min<int>(std::lower_bound(clusters.cdf.begin(),
+                                               clusters.cdf.end(), u) -
+                                  clusters.cdf.begin(),
+                              clusters.cdf.size() - 1);
+        // The sum of three uniforms is a cheap, bounded bell curve
+        Vector3f d;
+        for (int i = 0; i < 3; ++i)
+            d[i] = rng.UniformFloat() + rng.UniformFloat() +
+                   rng.UniformFloat() - 1.5f;
+        return clusters.centers[c] + 2 * clusters.sigma[c] * d;
+    }
+    default:
+        return SampleSurfaces(rng);
+    }
+}
+
+SPPMCaptureHeader GenerateSPPMSynthetic(const SPPMSyntheticParams &params,
+                                        std::vector<SPPMCapturePoint> *points,
+                                        std::vector<SPPMCaptureHit> *hits) {
+    ClusterSet clusters;
+    if (params.distribution == SPPMSyntheticDistribution::Clusters)
+        clusters = MakeClusters(std::max(params.nClusters, 1), params.seed);
+
+    // Pick a radius that puts a few points in each search sphere
+    Float radius = params.radius;
+    if (radius <= 0) {
+        int64_t n = std::max<int64_t>(params.nPoints, 1);
+        Float spacing;
+        if (params.distribution == SPPMSyntheticDistribution::Uniform)
+            spacing = boxSize / std::cbrt((Float)n);
+        else if (params.distribution == SPPMSyntheticDistribution::Clusters)
+            // Spacing inside the largest cluster
+            spacing = 2 * clusters.sigma[0] / std::cbrt(n * clusters.cdf[0]);
+        else
+            spacing = boxSize / std::sqrt((Float)n);
+        radius = 2 * spacing;
+    }
+    Float logRatio = std::log(std::max(params.radiusRatio, (Float)1));
+
+    // Generate fixed-size chunks, each with its own random sequence, so the
+    // result doesn't depend on the scheduling
+    const int64_t chunkSize = 16384;
+    points->resize(params.nPoints);
+    int64_t nChunks = (params.nPoints + chunkSize - 1) / chunkSize;
+    ParallelFor(
+        [&](int64_t chunk) {
+            RNG rng;
+            rng.SetSequence(params.seed * 0x9e3779b97f4a7c15ull + 2 * chunk);
+            int64_t end = std::min(params.nPoints, (chunk + 1) * chunkSize);
+            for (int64_t i = chunk * chunkSize; i < end; ++i) {
+                SPPMCapturePoint &cp = (*points)[i];
+                Point3f p = SamplePosition(params, clusters, rng);
+                for (int c = 0; c < 3; ++c) cp.p[c] = p[c];
+                cp.radius = radius;
+                if (params.distribution ==
+                    SPPMSyntheticDistribution::RadiusVariance)
+                    cp.radius *=
+                        std::exp(logRatio * (rng.UniformFloat() - .5f));
+                cp.bsdf = BSDF_DIFFUSE | BSDF_REFLECTION;
+            }
+        },
+        nChunks);
+
+    hits->resize(params.nHits);
+    nChunks = (params.nHits + chunkSize - 1) / chunkSize;
+    ParallelFor(
+        [&](int64_t chunk) {
+            RNG rng;
+            rng.SetSequence(params.seed * 0x9e3779b97f4a7c15ull + 2 * chunk +
+                            1);
+            int64_t end = std::min(params.nHits, (chunk + 1) * chunkSize);
+            for (int64_t i = chunk * chunkSize; i < end; ++i) {
+                Point3f p;
+                if (rng.UniformFloat() < params.missFraction)
+                    p = Point3f(rng.UniformFloat(), rng.UniformFloat(),
+                                rng.UniformFloat()) *
+                        boxSize;
+                else
+                    p = SamplePosition(params, clusters, rng);
+                for (int c = 0; c < 3; ++c) (*hits)[i].p[c] = p[c];
+            }
+        },
+        nChunks);
+
+    SPPMCaptureHeader header = {};
+    header.nPoints = points->size();
+    header.nHits = hits->size();
+    header.initialSearchRadius = radius;
+    header.photonsPerIteration = (int32_t)std::min<int64_t>(
+        params.nHits, std::numeric_limits<int32_t>::max());
+    header.nIterations = 1;
+    return header;
+}
+
+std::vector<SPPMSyntheticCase> SPPMSyntheticSuite(Float scale) {
+    auto count = [scale](int64_t n) {
+        return std::max<int64_t>(1, (int64_t)(n * scale));
+    };
+    std::vector<SPPMSyntheticCase> suite;
+    SPPMSyntheticParams params;
+    params.nPoints = count(1000000);
+    params.nHits = count(1000000);
+
+    params.distribution = SPPMSyntheticDistribution::Surfaces;
+    suite.push_back({"surfaces", params});
+    params.distribution = SPPMSyntheticDistribution::Uniform;
+    suite.push_back({"uniform", params});
+    params.distribution = SPPMSyntheticDistribution::Planar;
+    suite.push_back({"planar", params});
+    params.thickness = .001f;
+    suite.push_back({"planar_slab", params});
+    params.thickness = 0;
+    params.distribution = SPPMSyntheticDistribution::Clusters;
+    suite.push_back({"clusters", params});
+    params.distribution = SPPMSyntheticDistribution::RadiusVariance;
+    suite.push_back({"radiusvar", params});
+
+    // Tens of millions of points, for build scaling
+    params.distribution = SPPMSyntheticDistribution::Surfaces;
+    params.nPoints = count(16000000);
+    params.nHits = count(4000000);
+    suite.push_back({"surfaces_large", params});
+    return suite;
+}
+
+}  // namespace pbrt
@@ -0,0 +1,74 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMSYNTHETIC_H
+#define SPPMSYNTHETIC_H
+
+#include <string>
+#include <vector>
+
+#include "SPPM_Integrators/SPPM_Capture.h"
+#include "pbrt.h"
+
+namespace pbrt {
+
+// Visible point layouts that stress the SPPM accelerators. All of them live
+// in the box [0,10]^3.
+enum class SPPMSyntheticDistribution {
+    // Points filling the box
+    Uniform,
+    // Points on the plane y = 5, optionally thickened into a slab; the
+    // degenerate bounds the octree's resize-to-cube step exists for
+    Planar,
+    // Tight clusters of very different sizes in otherwise empty space
+    Clusters,
+    // Surface points with radii spread over several orders of magnitude
+    RadiusVariance,
+    // A floor, a back wall and a sphere, roughly what a scene produces
+    Surfaces
+};
+
+struct SPPMSyntheticParams {
+    SPPMSyntheticDistribution distribution =
+        SPPMSyntheticDistribution::Surfaces;
+    int64_t nPoints = 1000000;
+    int64_t nHits = 1000000;
+    // Search radius; 0 derives it from the average point spacing
+    Float radius = 0;
+    // Ratio of the largest to the smallest radius for RadiusVariance
+    Float radiusRatio = 1000;
+    int nClusters = 32;
+    // Slab thickness for Planar, as a fraction of the box size
+    Float thickness = 0;
+    // Fraction of photon hits placed uniformly in the box instead of on
+    // the points' surfaces
+    Float missFraction = .1f;
+    uint64_t seed = 0;
+};
+
+// Returns false if _name_ isn't one of uniform, planar, clusters,
+// radiusvar or surfaces
+bool ParseSPPMSyntheticDistribution(const std::string &name,
+                                    SPPMSyntheticDistribution *dist);
+
+// Generates the visible points and photon hits of _params_ and returns the
+// capture header describing them. Deterministic for a given seed,
+// independent of the number of threads.
+SPPMCaptureHeader GenerateSPPMSynthetic(const SPPMSyntheticParams &params,
+                                        std::vector<SPPMCapturePoint> *points,
+                                        std::vector<SPPMCaptureHit> *hits);
+
+// The distributions sppm_accel_bench --suite runs, with point counts
+// multiplied by _scale_
+struct SPPMSyntheticCase {
+    std::string name;
+    SPPMSyntheticParams params;
+};
+std::vector<SPPMSyntheticCase> SPPMSyntheticSuite(Float scale);
+
+}  // namespace pbrt
+
+#endif  // SPPMSYNTHETIC_H
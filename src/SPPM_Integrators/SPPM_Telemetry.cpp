@@ -0,0 +1,202 @@
+
+#include "SPPM_Integrators/SPPM_Telemetry.h"
+
+#include <iostream>
+
+#include "stats.h"
+#include "timeline.h"
+
+namespace pbrt {
+
+static const char *phaseNames[] = {"cameraPass", "build", "photonPass",
+                                   "statsUpdate"};
+
+// Hardware counter totals of all SPPM renders, for the statistics report
+static const char *phaseTitles[] = {"Camera pass", "Build", "Photon pass",
+                                    "Stats update"};
+static SPPMPerfCounts perfTotals[4];
+
+static void ReportPerfCounters(StatsAccumulator &accum) {
+    // The totals are global, so only one thread reports them
+    if (ThreadIndex != 0) return;
+    const std::string category = "SPPM hardware counters/";
+    for (int p = 0; p < 4; ++p) {
+        const SPPMPerfCounts &c = perfTotals[p];
+        for (int e = 0; e < nSPPMPerfEvents; ++e)
+            if (c.valid[e])
+                accum.ReportCounter(category + phaseTitles[p] + " " +
+                                        SPPMPerfEventName(e),
+                                    c.count[e]);
+        int cycles = (int)SPPMPerfEvent::Cycles;
+        int instructions = (int)SPPMPerfEvent::Instructions;
+        if (c.valid[cycles] && c.valid[instructions])
+            accum.ReportRatio(
+                category + phaseTitles[p] + " instructions per cycle",
+                c.count[instructions], c.count[cycles]);
+    }
+    for (SPPMPerfCounts &c : perfTotals) c = SPPMPerfCounts();
+}
+
+static StatRegisterer perfRegisterer(ReportPerfCounters);
+
+SPPMTelemetry::SPPMTelemetry(const std::string &integratorName)
+    : integratorName(integratorName),
+      renderStart(Clock::now()),
+      counters(MaxThreadIndex()) {
+    if (PbrtOptions.sppmPerfCounters) {
+        perf.reset(new SPPMPerfCounters);
+        if (!perf->Available()) perf.reset();
+    }
+    const std::string &filename = PbrtOptions.sppmTelemetryFile;
+    if (filename.empty()) return;
+    csv = filename.size() >= 4 &&
+          filename.compare(filename.size() - 4, 4, ".csv") == 0;
+    file = fopen(filename.c_str(), "w");
+    if (!file)
+        Error("%s: unable to open SPPM telemetry file", filename.c_str());
+}
+
+SPPMTelemetry::~SPPMTelemetry() {
+    if (file) fclose(file);
+}
+
+void SPPMTelemetry::BeginIteration(int iter) {
+    iteration = iter;
+    iterationTimelineStart = TimelineEnabled() ? TimelineNow() : -1;
+    for (int i = 0; i < nPhases; ++i) {
+        phaseTime[i] = 0;
+        perfPhase[i] = SPPMPerfCounts();
+    }
+    for (ThreadCounters &c : counters) c = ThreadCounters();
+    structureBytes = 0;
+    structureShape.clear();
+}
+
+void SPPMTelemetry::EndIteration() {
+    for (int i = 0; i < nPhases; ++i) {
+        totalPhaseTime[i] += phaseTime[i];
+        perfTotals[i] += perfPhase[i];
+    }
+    if (file) WriteRecord();
+    if (iterationTimelineStart >= 0)
+        TimelineRecord("SPPM iteration", "sppm", iterationTimelineStart,
+                       "iteration", iteration);
+}
+
+void SPPMTelemetry::BeginPhase(SPPMPhase phase) {
+    if (perf) perfStart[(int)phase] = perf->Read();
+    phaseStart[(int)phase] = Clock::now();
+    phaseTimelineStart[(int)phase] = TimelineEnabled() ? TimelineNow() : -1;
+}
+
+void SPPMTelemetry::EndPhase(SPPMPhase phase) {
+    std::chrono::duration<double> elapsed =
+        Clock::now() - phaseStart[(int)phase];
+    phaseTime[(int)phase] += elapsed.count();
+    if (perf) perfPhase[(int)phase] += perf->Read() - perfStart[(int)phase];
+    if (phaseTimelineStart[(int)phase] >= 0)
+        TimelineRecord(phaseTitles[(int)phase], "sppm",
+                       phaseTimelineStart[(int)phase], "iteration", iteration);
+}
+
+void SPPMTelemetry::SetStructure(
+    size_t bytes, std::vector<std::pair<std::string, double>> shape) {
+    structureBytes = bytes;
+    structureShape = std::move(shape);
+}
+
+void SPPMTelemetry::WriteRecord() {
+    ThreadCounters total;
+    for (const ThreadCounters &c : counters) {
+        total.candidates += c.candidates;
+        total.deposits += c.deposits;
+        total.visiblePoints += c.visiblePoints;
+    }
+
+    if (csv) {
+        if (!wroteHeader) {
+            fprintf(file, "integrator,iteration");
+            for (const char *name : phaseNames) fprintf(file, ",%s", name);
+            fprintf(file, ",visiblePoints,photonsDeposited,"
+                          "candidatesChecked,structureBytes,structure");
+            for (int p = 0; perf && p < nPhases; ++p)
+                for (int e = 0; e < nSPPMPerfEvents; ++e)
+                    fprintf(file, ",%s_%s", phaseNames[p],
+                            SPPMPerfEventName(e));
+            fprintf(file, "\n");
+            wroteHeader = true;
+        }
+        fprintf(file, "%s,%d", integratorName.c_str(), iteration);
+        for (double t : phaseTime) fprintf(file, ",%.6f", t);
+        fprintf(file, ",%lld,%lld,%lld,%zu", (long long)total.visiblePoints,
+                (long long)total.deposits, (long long)total.candidates,
+                structureBytes);
+        // The shape's keys change with the accelerator, so they share one
+        // quoted column rather than each having their own
+        fprintf(file, ",\"");
+        for (size_t i = 0; i < structureShape.size(); ++i)
+            fprintf(file, "%s%s=%g", i > 0 ? ";" : "",
+                    structureShape[i].first.c_str(), structureShape[i].second);
+        fprintf(file, "\"");
+        for (int p = 0; perf && p < nPhases; ++p)
+            for (int e = 0; e < nSPPMPerfEvents; ++e) {
+                if (perfPhase[p].valid[e])
+                    fprintf(file, ",%lld", (long long)perfPhase[p].count[e]);
+                else
+                    fprintf(file, ",");
+            }
+        fprintf(file, "\n");
+    } else {
+        fprintf(file, "{\"integrator\": \"%s\", \"iteration\": %d",
+                integratorName.c_str(), iteration);
+        for (int i = 0; i < nPhases; ++i)
+            fprintf(file, ", \"%s\": %.6f", phaseNames[i], phaseTime[i]);
+        fprintf(file,
+                ", \"visiblePoints\": %lld, \"photonsDeposited\": %lld, "
+                "\"candidatesChecked\": %lld, \"structureBytes\": %zu, "
+                "\"structure\": {",
+                (long long)total.visiblePoints, (long long)total.deposits,
+                (long long)total.candidates, structureBytes);
+        for (size_t i = 0; i < structureShape.size(); ++i)
+            fprintf(file, "%s\"%s\": %g", i > 0 ? ", " : "",
+                    structureShape[i].first.c_str(), structureShape[i].second);
+        fprintf(file, "}");
+        if (perf) {
+            fprintf(file, ", \"perf\": {");
+            for (int p = 0; p < nPhases; ++p) {
+                fprintf(file, "%s\"%s\": {", p > 0 ? ", " : "",
+                        phaseNames[p]);
+                bool first = true;
+                for (int e = 0; e < nSPPMPerfEvents; ++e) {
+                    if (!perfPhase[p].valid[e]) continue;
+                    fprintf(file, "%s\"%s\": %lld", first ? "" : ", ",
+                            SPPMPerfEventName(e),
+                            (long long)perfPhase[p].count[e]);
+                    first = false;
+                }
+                fprintf(file, "}");
+            }
+            fprintf(file, "}");
+        }
+        fprintf(file, "}\n");
+    }
+    fflush(file);
+}
+
+void SPPMTelemetry::PrintSummary(int nPixels, int photonsPerIteration,
+                                 int nIterations) const {
+    std::chrono::duration<double> renderTime = Clock::now() - renderStart;
+    std::cout << std::fixed;
+    std::cout << std::endl << "pixels: " << nPixels << std::endl;
+    std::cout << "photons per pass: " << photonsPerIteration << std::endl;
+    std::cout << "iterations: " << nIterations << std::endl;
+    std::cout << "build time: "
+              << (float)totalPhaseTime[(int)SPPMPhase::Build] << std::endl;
+    std::cout << "trace time: "
+              << (float)totalPhaseTime[(int)SPPMPhase::PhotonPass]
+              << std::endl;
+    std::cout << "render time: " << (float)renderTime.count() << std::endl;
+    std::cout << "End" << std::endl;
+}
+
+}  // namespace pbrt
@@ -0,0 +1,109 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMTELEMETRY_H
+#define SPPMTELEMETRY_H
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "SPPM_Integrators/SPPM_PerfCounters.h"
+#include "parallel.h"
+#include "pbrt.h"
+
+namespace pbrt {
+
+enum class SPPMPhase { CameraPass, Build, PhotonPass, StatsUpdate };
+
+// Per-iteration timings and counters of an SPPM integrator.
+//
+// Each iteration becomes one record, written to the file given with
+// --sppmtelemetry as a JSON object per line, or as CSV if the file name
+// ends in ".csv". In CSV the accelerator's shape, whose keys vary from one
+// iteration to the next, is a single quoted "key=value;..." column. The
+// totals also feed the timing summary printed at the end of the render.
+//
+// With --sppmperf each phase also counts hardware events on all threads
+// (see SPPMPerfCounters); they are added to the records and summed into
+// the "SPPM hardware counters" section of the statistics.
+//
+// With --trace the iterations and phases are also recorded on the timeline.
+class SPPMTelemetry {
+  public:
+    // Counters bumped from the parallel loops; one per thread, padded to a
+    // cache line so threads don't share them
+    struct alignas(64) ThreadCounters {
+        int64_t candidates = 0;
+        int64_t deposits = 0;
+        int64_t visiblePoints = 0;
+    };
+
+    SPPMTelemetry(const std::string &integratorName);
+    ~SPPMTelemetry();
+
+    void BeginIteration(int iteration);
+    void EndIteration();
+    void BeginPhase(SPPMPhase phase);
+    void EndPhase(SPPMPhase phase);
+    ThreadCounters &Counters() { return counters[ThreadIndex]; }
+    // Seconds spent in _phase_ so far this iteration
+    double PhaseSeconds(SPPMPhase phase) const {
+        return phaseTime[(int)phase];
+    }
+
+    // Records the memory used by this iteration's accelerator and named
+    // metrics describing its shape (cells, nodes, depth, ...)
+    void SetStructure(size_t bytes,
+                      std::vector<std::pair<std::string, double>> shape);
+
+    // Prints the totals the SPPM integrators have always printed
+    void PrintSummary(int nPixels, int photonsPerIteration,
+                      int nIterations) const;
+
+  private:
+    // SPPMTelemetry Private Methods
+    void WriteRecord();
+
+    // SPPMTelemetry Private Data
+    typedef std::chrono::steady_clock Clock;
+    static const int nPhases = 4;
+    const std::string integratorName;
+    const Clock::time_point renderStart;
+    FILE *file = nullptr;
+    bool csv = false, wroteHeader = false;
+    std::vector<ThreadCounters> counters;
+    Clock::time_point phaseStart[nPhases];
+    // Start times of the iteration and its phases on the --trace timeline
+    int64_t iterationTimelineStart = -1, phaseTimelineStart[nPhases];
+    double phaseTime[nPhases], totalPhaseTime[nPhases] = {};
+    int iteration = 0;
+    size_t structureBytes = 0;
+    std::vector<std::pair<std::string, double>> structureShape;
+    std::unique_ptr<SPPMPerfCounters> perf;
+    SPPMPerfCounts perfStart[nPhases], perfPhase[nPhases];
+};
+
+// Times an SPPM phase for the lifetime of the object, like _ProfilePhase_
+class SPPMPhaseTimer {
+  public:
+    SPPMPhaseTimer(SPPMTelemetry &telemetry, SPPMPhase phase)
+        : telemetry(telemetry), phase(phase) {
+        telemetry.BeginPhase(phase);
+    }
+    ~SPPMPhaseTimer() { telemetry.EndPhase(phase); }
+
+  private:
+    SPPMTelemetry &telemetry;
+    const SPPMPhase phase;
+};
+
+}  // namespace pbrt
+
+#endif  // SPPMTELEMETRY_H
@@ -0,0 +1,44 @@
+
+#include "SPPM_Integrators/SPPM_TimeBudget.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace pbrt {
+
+// SPPMTimeBudget Method Definitions
+SPPMTimeBudget::SPPMTimeBudget(double seconds, int photonsPerIteration)
+    : seconds(seconds), photonsPerIteration(photonsPerIteration) {}
+
+void SPPMTimeBudget::Record(int photons, double photonSeconds,
+                            double otherSeconds) {
+    double perPhoton = photons > 0 ? photonSeconds / photons : 0;
+    // Older iterations count half as much at each new one
+    if (iterations == 0) {
+        secondsPerPhoton = perPhoton;
+        this->otherSeconds = otherSeconds;
+    } else {
+        secondsPerPhoton = .5 * (secondsPerPhoton + perPhoton);
+        this->otherSeconds = .5 * (this->otherSeconds + otherSeconds);
+    }
+    ++iterations;
+}
+
+int SPPMTimeBudget::NextPhotons(double elapsed) {
+    if (final) return 0;
+    // Nothing to estimate from before the first iteration
+    if (iterations == 0) return photonsPerIteration;
+    double remaining = (seconds - elapsed) / safety;
+    double nominal = otherSeconds + photonsPerIteration * secondsPerPhoton;
+    if (remaining >= 2 * nominal) return photonsPerIteration;
+
+    final = true;
+    double photons = secondsPerPhoton > 0
+                         ? (remaining - otherSeconds) / secondsPerPhoton
+                         : photonsPerIteration;
+    // A final iteration with few photons isn't worth its camera pass
+    if (photons < .1 * photonsPerIteration) return 0;
+    return (int)std::min(photons, (double)std::numeric_limits<int>::max());
+}
+
+}  // namespace pbrt
@@ -0,0 +1,52 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMTIMEBUDGET_H
+#define SPPMTIMEBUDGET_H
+
+#include "pbrt.h"
+
+namespace pbrt {
+
+// Plans the iterations of an SPPM render with a wall-clock time limit.
+//
+// Iterations shoot the nominal _photonsPerIteration_ while at least two
+// more of them fit in the remaining time. The next iteration is then the
+// last one: it shoots as many photons as the remaining time allows, which
+// may be more or fewer than the nominal count, so that it finishes before
+// the deadline. The estimates come from the measured photon pass
+// throughput and the time each iteration spends outside its photon pass
+// (camera pass, build and pixel update).
+class SPPMTimeBudget {
+  public:
+    // SPPMTimeBudget Public Methods
+    SPPMTimeBudget(double seconds, int photonsPerIteration);
+
+    // Records an iteration that shot _photons_ photons in _photonSeconds_
+    // and spent _otherSeconds_ on everything else
+    void Record(int photons, double photonSeconds, double otherSeconds);
+
+    // Photons for the iteration after the ones recorded, _elapsed_ seconds
+    // into the render, or 0 if no worthwhile iteration fits anymore
+    int NextPhotons(double elapsed);
+    // Whether the iteration NextPhotons() last planned is the final one
+    bool Final() const { return final; }
+
+  private:
+    // SPPMTimeBudget Private Data
+    // Planned time is this much larger than the estimates, for noise and
+    // the final image write
+    static constexpr double safety = 1.1;
+    const double seconds;
+    const int photonsPerIteration;
+    double secondsPerPhoton = 0, otherSeconds = 0;
+    int iterations = 0;
+    bool final = false;
+};
+
+}  // namespace pbrt
+
+#endif  // SPPMTIMEBUDGET_H
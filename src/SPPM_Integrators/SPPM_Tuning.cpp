@@ -0,0 +1,90 @@
+
+#include "SPPM_Integrators/SPPM_Tuning.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "paramset.h"
+
+namespace pbrt {
+
+std::string SPPMTuningFilename(const std::string &sceneFilename) {
+    return sceneFilename + ".sppmtune";
+}
+
+bool WriteSPPMTuning(const std::string &filename, const std::string &comment,
+                     const std::vector<SPPMTunedParam> &params) {
+    FILE *f = fopen(filename.c_str(), "w");
+    if (!f) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        return false;
+    }
+    size_t start = 0;
+    while (start < comment.size()) {
+        size_t end = comment.find('\n', start);
+        if (end == std::string::npos) end = comment.size();
+        fprintf(f, "# %s\n", comment.substr(start, end - start).c_str());
+        start = end + 1;
+    }
+    for (const SPPMTunedParam &p : params) {
+        if (p.isInt)
+            fprintf(f, "%s \"integer %s\" %d\n", p.accelerator.c_str(),
+                    p.name.c_str(), (int)p.value);
+        else
+            fprintf(f, "%s \"float %s\" %.9g\n", p.accelerator.c_str(),
+                    p.name.c_str(), (double)p.value);
+    }
+    bool ok = !ferror(f);
+    if (fclose(f) != 0) ok = false;
+    if (!ok) Error("%s: error writing SPPM tuning", filename.c_str());
+    return ok;
+}
+
+bool ReadSPPMTuning(const std::string &filename,
+                    std::vector<SPPMTunedParam> *params) {
+    FILE *f = fopen(filename.c_str(), "r");
+    if (!f) return false;
+    char line[1024];
+    for (int lineNum = 1; fgets(line, sizeof(line), f); ++lineNum) {
+        const char *s = line + strspn(line, " \t");
+        if (*s == '#' || *s == '\n' || *s == '\0') continue;
+        char accel[128], type[16], name[128];
+        double value;
+        if (sscanf(s, "%127s \"%15s %127[^\"]\" %lf", accel, type, name,
+                   &value) != 4 ||
+            (strcmp(type, "integer") && strcmp(type, "float"))) {
+            Warning("%s:%d: ignoring malformed SPPM tuning line",
+                    filename.c_str(), lineNum);
+            continue;
+        }
+        params->push_back(
+            {accel, name, strcmp(type, "integer") == 0, (Float)value});
+    }
+    fclose(f);
+    return true;
+}
+
+int ApplySPPMTuning(const std::vector<SPPMTunedParam> &tuned,
+                    const std::string &accelName, ParamSet *params) {
+    int added = 0;
+    for (const SPPMTunedParam &p : tuned) {
+        if (p.accelerator != accelName) continue;
+        int n;
+        if (params->FindInt(p.name, &n) || params->FindFloat(p.name, &n))
+            continue;
+        if (p.isInt) {
+            std::unique_ptr<int[]> v(new int[1]);
+            v[0] = (int)p.value;
+            params->AddInt(p.name, std::move(v), 1);
+        } else {
+            std::unique_ptr<Float[]> v(new Float[1]);
+            v[0] = p.value;
+            params->AddFloat(p.name, std::move(v), 1);
+        }
+        ++added;
+    }
+    return added;
+}
+
+}  // namespace pbrt
@@ -0,0 +1,46 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef SPPMTUNING_H
+#define SPPMTUNING_H
+
+#include <string>
+#include <vector>
+
+#include "pbrt.h"
+
+namespace pbrt {
+
+// An accelerator build parameter chosen by sppm_tune for one scene
+struct SPPMTunedParam {
+    std::string accelerator, name;
+    bool isInt;
+    Float value;
+};
+
+// Sidecar file that holds the tuned parameters of the scene
+// _sceneFilename_; accelerated SPPM renders of the scene read it
+std::string SPPMTuningFilename(const std::string &sceneFilename);
+
+// Writes one line per parameter, in the form
+//     <accelerator> "integer|float <name>" <value>
+// after _comment_, which may span several lines
+bool WriteSPPMTuning(const std::string &filename, const std::string &comment,
+                     const std::vector<SPPMTunedParam> &params);
+
+// Returns false if _filename_ can't be opened. Malformed lines are reported
+// and skipped.
+bool ReadSPPMTuning(const std::string &filename,
+                    std::vector<SPPMTunedParam> *params);
+
+// Adds the parameters tuned for _accelName_ that _params_ doesn't set, so
+// that the scene file's own settings win, and returns how many it added
+int ApplySPPMTuning(const std::vector<SPPMTunedParam> &tuned,
+                    const std::string &accelName, ParamSet *params);
+
+}  // namespace pbrt
+
+#endif  // SPPMTUNING_H
@@ -0,0 +1,211 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+// integrators/sppm.cpp*
+#include "SPPM_Integrators/Single_Cell_Grid.h"
+#include "SPPM_Integrators/SPPM_Pixel.h"
+#include "parallel.h"
+#include "paramset.h"
+#include "stats.h"
+
+namespace pbrt {
+
+STAT_INT_DISTRIBUTION(
+    "Stochastic Progressive Photon Mapping/Grid cells searched per photon "
+    "intersection",
+    gridCellsSearched);
+
+static bool ToGrid(const Point3f &p, const Bounds3f &bounds,
+                   const int gridRes[3], Point3i *pi) {
+    bool inBounds = true;
+    Vector3f pg = bounds.Offset(p);
+    for (int i = 0; i < 3; ++i) {
+        (*pi)[i] = (int)(gridRes[i] * pg[i]);
+        inBounds &= ((*pi)[i] >= 0 && (*pi)[i] < gridRes[i]);
+        (*pi)[i] = Clamp((*pi)[i], 0, gridRes[i] - 1);
+    }
+    return inBounds;
+}
+
+inline unsigned int hash(const Point3i &p, int hashSize) {
+    return (unsigned int)((p.x * 73856093) ^ (p.y * 19349663) ^
+                          (p.z * 83492791)) %
+           hashSize;
+}
+
+// SingleCellGridAccelerator Method Definitions
+void SingleCellGridAccelerator::Build(const std::vector<SPPMPixel *> &pixels) {
+    int nPixels = pixels.size();
+    gridBounds = Bounds3f();
+    maxRadius = 0;
+    hashSize = 0;
+    if (nPixels == 0) return;
+
+    // Each visible point is stored once, so the bucket offsets and point
+    // list are sized by the number of visible points; the arrays only grow
+    hashSize = nPixels;
+    if (hashSize > cursorCapacity) {
+        bucketCursor.reset(new std::atomic<int>[hashSize]);
+        cursorCapacity = hashSize;
+    }
+    bucketStart.resize(hashSize + 1);
+    pixelBucket.resize(nPixels);
+    bucketPixels.resize(nPixels);
+
+    // Compute grid bounds for SPPM visible points
+    for (const SPPMPixel *pixel : pixels) {
+        Bounds3f vpBound = Expand(Bounds3f(pixel->vp.p), pixel->radius);
+        gridBounds = Union(gridBounds, vpBound);
+        maxRadius = std::max(maxRadius, pixel->radius);
+    }
+
+    // Compute resolution of SPPM grid in each dimension; cells are at least
+    // _maxRadius_ wide, so a photon only reaches visible points stored in its
+    // own cell and the 26 around it
+    Vector3f diag = gridBounds.Diagonal();
+    Float maxDiag = MaxComponent(diag);
+    CHECK_GT(maxRadius, 0);
+    int baseGridRes = std::max((int)(maxDiag / (cellScale * maxRadius)), 1);
+    for (int i = 0; i < 3; ++i) {
+        gridRes[i] = std::max((int)(baseGridRes * diag[i] / maxDiag), 1);
+        cellWidth[i] = diag[i] / gridRes[i];
+    }
+
+    // Count the visible points hashed to each bucket
+    for (int h = 0; h < hashSize; ++h) bucketCursor[h] = 0;
+    ParallelFor(
+        [&](int i) {
+            // Add pixel's visible point to the cell of its center only
+            Point3i pi;
+            ToGrid(pixels[i]->vp.p, gridBounds, gridRes, &pi);
+            int h = hash(pi, hashSize);
+            pixelBucket[i] = h;
+            bucketCursor[h].fetch_add(1, std::memory_order_relaxed);
+        },
+        nPixels, 4096);
+
+    // Compute bucket offsets and scatter visible points into them
+    bucketStart[0] = 0;
+    for (int h = 0; h < hashSize; ++h) {
+        bucketStart[h + 1] = bucketStart[h] + bucketCursor[h];
+        bucketCursor[h] = bucketStart[h];
+    }
+    ParallelFor(
+        [&](int i) {
+            int h = pixelBucket[i];
+            int offset =
+                bucketCursor[h].fetch_add(1, std::memory_order_relaxed);
+            bucketPixels[offset] = pixels[i];
+        },
+        nPixels, 4096);
+}
+
+int SingleCellGridAccelerator::Query(
+    const Point3f &p, SPPMPixelVisitor func) const {
+    // Find the neighboring cells within _maxRadius_ of the photon along each
+    // axis
+    Point3i photonGridIndex;
+    if (hashSize == 0 || !ToGrid(p, gridBounds, gridRes, &photonGridIndex))
+        return 0;
+    Vector3f pg = gridBounds.Offset(p);
+    Point3i pMin = photonGridIndex, pMax = photonGridIndex;
+    for (int i = 0; i < 3; ++i) {
+        Float inCell = (pg[i] * gridRes[i] - photonGridIndex[i]) * cellWidth[i];
+        if (inCell <= maxRadius) pMin[i] = std::max(pMin[i] - 1, 0);
+        if (cellWidth[i] - inCell <= maxRadius)
+            pMax[i] = std::min(pMax[i] + 1, gridRes[i] - 1);
+    }
+
+    // Collect the distinct buckets of those cells; cells may share a bucket
+    // and each visible point must be visited only once
+    int buckets[27], nBuckets = 0;
+    for (int z = pMin.z; z <= pMax.z; ++z)
+        for (int y = pMin.y; y <= pMax.y; ++y)
+            for (int x = pMin.x; x <= pMax.x; ++x) {
+                int h = hash(Point3i(x, y, z), hashSize);
+                bool seen = false;
+                for (int j = 0; j < nBuckets; ++j) seen |= (buckets[j] == h);
+                if (!seen) buckets[nBuckets++] = h;
+            }
+    ReportValue(gridCellsSearched, (1 + pMax.x - pMin.x) *
+                                       (1 + pMax.y - pMin.y) *
+                                       (1 + pMax.z - pMin.z));
+
+    // Test the visible points in those buckets
+    int tested = 0;
+    for (int b = 0; b < nBuckets; ++b) {
+        int h = buckets[b];
+        for (int j = bucketStart[h]; j < bucketStart[h + 1]; ++j) {
+            ++tested;
+            SPPMPixel *pixel = bucketPixels[j];
+            Float radius = pixel->radius;
+            if (DistanceSquared(pixel->vp.p, p) <= radius * radius)
+                func(pixel);
+        }
+    }
+    return tested;
+}
+
+size_t SingleCellGridAccelerator::BytesUsed() const {
+    return cursorCapacity * sizeof(std::atomic<int>) +
+           bucketStart.capacity() * sizeof(int) +
+           pixelBucket.capacity() * sizeof(int) +
+           bucketPixels.capacity() * sizeof(SPPMPixel *);
+}
+
+std::vector<std::pair<std::string, double>> SingleCellGridAccelerator::Shape()
+    const {
+    return {{"gridResX", (double)gridRes[0]},
+            {"gridResY", (double)gridRes[1]},
+            {"gridResZ", (double)gridRes[2]},
+            {"points", (double)(hashSize ? bucketStart[hashSize] : 0)}};
+}
+
+void SingleCellGridAccelerator::VisitNodes(
+    const std::function<void(const SPPMAcceleratorNode &)> &func) const {
+    // Buckets don't keep their cell, so they are reported without bounds
+    for (int h = 0; h < hashSize; ++h) {
+        SPPMAcceleratorNode node;
+        node.nPoints = bucketStart[h + 1] - bucketStart[h];
+        if (node.nPoints > 0) func(node);
+    }
+}
+
+SPPMAccelerator *CreateSingleCellGridAccelerator(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings) {
+    // Cell width in units of the largest search radius; 1 gathers from up to
+    // 3x3x3 cells, 2 from at most 2x2x2 cells but with longer lists
+    Float cellScale = std::max((Float)1, params.FindOneFloat("cellscale", 1.f));
+    return new SingleCellGridAccelerator(cellScale);
+}
+
+}  // namespace pbrt
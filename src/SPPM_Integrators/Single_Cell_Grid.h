@@ -35,48 +35,51 @@
 #pragma once
 #endif
 
-#ifndef GRIDPAR_H
-#define GRIDPAR_H
+#ifndef SINGLECELLGRID_H
+#define SINGLECELLGRID_H
 
-// integrators/sppm.h*
-#include "camera.h"
-#include "film.h"
-#include "integrator.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "SPPM_Integrators/accelerator.h"
 #include "pbrt.h"
 
 namespace pbrt {
 
-// SPPM Declarations
-class GridParSPPMIntegrator : public Integrator {
+// Hashed grid that stores every visible point only in the cell of its
+// center. Cells are at least as wide as the largest search radius, so a
+// photon gathers from its own cell and whichever neighbours lie within that
+// radius. The buckets are filled with a counting sort into flat arrays that
+// are reused from one build to the next.
+class SingleCellGridAccelerator : public SPPMAccelerator {
   public:
-    // SPPMIntegrator Public Methods
-    GridParSPPMIntegrator(std::shared_ptr<const Camera> &camera,
-                          int nIterations,
-                   int photonsPerIteration, int maxDepth,
-                   Float initialSearchRadius, int writeFrequency)
-        : camera(camera),
-          initialSearchRadius(initialSearchRadius),
-          nIterations(nIterations),
-          maxDepth(maxDepth),
-          photonsPerIteration(photonsPerIteration > 0
-                                  ? photonsPerIteration
-                                  : camera->film->croppedPixelBounds.Area()),
-          writeFrequency(writeFrequency) {}
-    void Render(const Scene &scene);
+    // SingleCellGridAccelerator Public Methods
+    SingleCellGridAccelerator(Float cellScale) : cellScale(cellScale) {}
+    void Build(const std::vector<SPPMPixel *> &pixels);
+    int Query(const Point3f &p, SPPMPixelVisitor func) const;
+    size_t BytesUsed() const;
+    std::vector<std::pair<std::string, double>> Shape() const;
+    void VisitNodes(
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
 
   private:
-    // SPPMIntegrator Private Data
-    std::shared_ptr<const Camera> camera;
-    const Float initialSearchRadius;
-    const int nIterations;
-    const int maxDepth;
-    const int photonsPerIteration;
-    const int writeFrequency;
+    // SingleCellGridAccelerator Private Data
+    const Float cellScale;
+    int gridRes[3] = {0, 0, 0};
+    Bounds3f gridBounds;
+    Vector3f cellWidth;
+    Float maxRadius = 0;
+    int hashSize = 0, cursorCapacity = 0;
+    std::unique_ptr<std::atomic<int>[]> bucketCursor;
+    std::vector<int> bucketStart;
+    std::vector<int> pixelBucket;
+    std::vector<SPPMPixel *> bucketPixels;
 };
 
-Integrator *CreateGridParSPPMIntegrator(const ParamSet &params,
-                                 std::shared_ptr<const Camera> camera);
+SPPMAccelerator *CreateSingleCellGridAccelerator(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings);
 
 }  // namespace pbrt
 
-#endif  // PBRT_INTEGRATORS_SPPM_H
+#endif  // SINGLECELLGRID_H
@@ -4,13 +4,13 @@
 #pragma once
 #endif
 
-#ifndef SPLITNESTEDKDSPPMINTEGRATOR_H
-#define SPLITNESTEDKDSPPMINTEGRATOR_H
+#ifndef SPLITMIDDLENESTEDKD_H
+#define SPLITMIDDLENESTEDKD_H
 
+#include <memory>
+#include <vector>
 
-#include "camera.h"
-#include "film.h"
-#include "integrator.h"
+#include "SPPM_Integrators/accelerator.h"
 #include "pbrt.h"
 
 namespace pbrt {
@@ -19,50 +19,46 @@ struct KdAccelNode;
 struct BoundEdge;
 
 // SPPM Declarations
-class SplitNestedKDSPPMIntegrator : public Integrator {
+class SplitNestedKDAccelerator : public SPPMAccelerator {
   public:
-    // SPPMIntegrator Public Methods
-    SplitNestedKDSPPMIntegrator(std::shared_ptr<const Camera> &camera,
-                              int nIterations, int photonsPerIteration,
-                              int maxDepth, Float initialSearchRadius,
-                              int writeFrequency)
-        : camera(camera),
-          initialSearchRadius(initialSearchRadius),
-          nIterations(nIterations),
-          maxDepth(maxDepth),
-          photonsPerIteration(photonsPerIteration > 0
-                                  ? photonsPerIteration
-                                  : camera->film->croppedPixelBounds.Area()),
-          writeFrequency(writeFrequency) {}
-    void Render(const Scene &scene);
+    // SplitNestedKDAccelerator Public Methods
+    SplitNestedKDAccelerator(int maxLeafPoints, int maxTreeDepth)
+        : maxLeafPoints(maxLeafPoints), maxTreeDepth(maxTreeDepth) {}
+    ~SplitNestedKDAccelerator();
+    void Build(const std::vector<SPPMPixel *> &pixels);
+    int Query(const Point3f &p, SPPMPixelVisitor func) const;
+    size_t BytesUsed() const;
+    size_t PeakBytesUsed() const;
+    std::vector<std::pair<std::string, double>> Shape() const;
+    void VisitNodes(
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const;
 
   private:
-    // SPPMIntegrator Private Data
-    std::shared_ptr<const Camera> camera;
-    const Float initialSearchRadius;
-    const int nIterations;
-    const int maxDepth;
-    const int photonsPerIteration;
-    const int writeFrequency;
-    // KDtree
-
-    int nextFreeNode;
-    int nAllocedNodes;
-    int maxvis = 1;
-    int maxD;
-    std::vector<int> visPointsIndices;
-    Bounds3f bounds;
-
+    // SplitNestedKDAccelerator Private Methods
     void buildTree(int nodeNum, const Bounds3f &bounds,
                    const std::vector<Bounds3f> &primBounds, int *primNums,
                    int nprims, int depth,
                    const std::unique_ptr<BoundEdge[]> edges[3], int *prims0,
                    int *prims1, KdAccelNode *&nodes, int all_prim_num,
                    int badRefines = 0);
+
+    // SplitNestedKDAccelerator Private Data
+    // A negative _maxTreeDepth_ derives the depth from the point count
+    const int maxLeafPoints, maxTreeDepth;
+    std::vector<SPPMPixel *> kdPixels;
+    KdAccelNode *nodes = nullptr;
+    int nextFreeNode = 0;
+    int nAllocedNodes = 0;
+    int maxvis = 1;
+    int maxD = 0;
+    Bounds3f bounds;
+    std::vector<int> visPointsIndices;
+    // Bounds, edges and index lists freed at the end of Build()
+    size_t buildScratchBytes = 0;
 };
 
-Integrator *CreateSplitNestedKDSPPMIntegrator(
-    const ParamSet &params, std::shared_ptr<const Camera> camera);
+SPPMAccelerator *CreateSplitNestedKDAccelerator(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings);
 
 }  // namespace pbrt
 #endif
\ No newline at end of file
@@ -0,0 +1,220 @@
+
+#include "SPPM_Integrators/accelerator.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "SPPM_Integrators/Auto_Accelerator.h"
+#include "SPPM_Integrators/Bvh_Embree.h"
+#include "SPPM_Integrators/Grid.h"
+#include "SPPM_Integrators/Hierarchical_Grid.h"
+#include "SPPM_Integrators/LBVH.h"
+#include "SPPM_Integrators/Nested_Grid.h"
+#include "SPPM_Integrators/Nested_Grid_par.h"
+#include "SPPM_Integrators/Octree.h"
+#include "SPPM_Integrators/Octree_par.h"
+#include "SPPM_Integrators/SAH_InPlace_KD_par.h"
+#include "SPPM_Integrators/SAH_Nested_KD.h"
+#include "SPPM_Integrators/SAH_Nested_KD_parSort.h"
+#include "SPPM_Integrators/Single_Cell_Grid.h"
+#include "SPPM_Integrators/SplitMiddle_Nested_KD.h"
+#include "paramset.h"
+#include "stats.h"
+
+namespace pbrt {
+
+STAT_INT_DISTRIBUTION("SPPM accelerator/Nodes per build", accelNodes);
+STAT_INT_DISTRIBUTION("SPPM accelerator/Leaves per build", accelLeaves);
+STAT_PERCENT("SPPM accelerator/Empty leaves", accelEmptyLeaves,
+             accelAllLeaves);
+STAT_INT_DISTRIBUTION("SPPM accelerator/Maximum depth per build",
+                      accelMaxDepth);
+STAT_INT_DISTRIBUTION("SPPM accelerator/Leaf depth", accelLeafDepth);
+STAT_INT_DISTRIBUTION("SPPM accelerator/Visible points per leaf",
+                      accelLeafPoints);
+STAT_RATIO("SPPM accelerator/Leaf references per visible point",
+           accelReferences, accelPoints);
+STAT_FLOAT_DISTRIBUTION("SPPM accelerator/Memory per build (MB)",
+                        accelMegabytes);
+STAT_FLOAT_DISTRIBUTION("SPPM accelerator/SAH cost per build", accelSAHCost);
+
+// Leaves by visible point count: 0, 1, 2-3, 4-7, ...
+static PBRT_THREAD_LOCAL int64_t leafHistogram[32];
+
+static void ReportLeafHistogram(StatsAccumulator &accum) {
+    int64_t total = 0;
+    for (int64_t n : leafHistogram) total += n;
+    for (int i = 0; i < 32; ++i) {
+        if (leafHistogram[i] == 0) continue;
+        // Pad the counts so the rows sort in order in the report
+        char title[64];
+        if (i < 2)
+            snprintf(title, sizeof(title),
+                     "SPPM accelerator/Leaves with %7d points", i);
+        else
+            snprintf(title, sizeof(title),
+                     "SPPM accelerator/Leaves with %7d-%d points",
+                     1 << (i - 1), (1 << i) - 1);
+        accum.ReportPercentage(title, leafHistogram[i], total);
+    }
+    for (int64_t &n : leafHistogram) n = 0;
+}
+
+static StatRegisterer leafHistogramRegisterer(ReportLeafHistogram);
+
+typedef SPPMAccelerator *(*SPPMAcceleratorFactory)(
+    const ParamSet &params, const SPPMAcceleratorSettings &settings);
+
+struct SPPMAcceleratorEntry {
+    const char *name;
+    SPPMAcceleratorFactory create;
+    std::vector<SPPMTunableParam> tunables;
+};
+
+// Tunable build parameters, each with its factory's default
+static const std::vector<SPPMTunableParam> gridTunables = {
+    {"loadfactor", false, .5f, {.25f, .5f, 1, 2}}};
+static const std::vector<SPPMTunableParam> singleCellGridTunables = {
+    {"cellscale", false, 1, {1, 1.5f, 2, 3}}};
+static const std::vector<SPPMTunableParam> nestedGridTunables = {
+    {"topgridres", true, 5, {3, 4, 5, 6, 8}},
+    {"gridres", true, 3, {2, 3, 4}},
+    {"maxleafpoints", true, 50, {25, 50, 100, 200}},
+    {"maxtreedepth", true, 7, {3, 5, 7, 9}}};
+static const std::vector<SPPMTunableParam> octreeTunables = {
+    {"maxleafpoints", true, 50, {16, 32, 50, 100, 200}},
+    {"maxtreedepth", true, 7, {5, 7, 9, 11}}};
+static const std::vector<SPPMTunableParam> sahKdTunables = {
+    {"intersectcost", true, 80, {20, 40, 80, 160}},
+    {"traversalcost", true, 1, {1, 5, 20}},
+    {"emptybonus", false, .5f, {0, .25f, .5f, .75f}},
+    {"maxleafpoints", true, 100, {25, 50, 100, 200}},
+    {"maxtreedepth", true, -1, {-1, 12, 16, 20}}};
+static const std::vector<SPPMTunableParam> inPlaceKdTunables = {
+    {"intersectcost", true, 15, {10, 15, 30, 60}},
+    {"traversalcost", true, 20, {5, 10, 20, 40}},
+    {"emptybonus", false, 0, {0, .25f, .5f}},
+    {"maxleafpoints", true, 100, {25, 50, 100, 200}},
+    {"maxtreedepth", true, -1, {-1, 12, 16}}};
+static const std::vector<SPPMTunableParam> splitKdTunables = {
+    {"maxleafpoints", true, 100, {25, 50, 100, 200}},
+    {"maxtreedepth", true, -1, {-1, 12, 16, 20}}};
+
+// The integrator "<name>_sppm" renders with the accelerator _name_
+static const SPPMAcceleratorEntry accelerators[] = {
+    {"bvh", CreateBVHAccelerator, {}},
+    {"lbvh", CreateLBVHAccelerator, {}},
+    {"nested_grid_par", CreateNestedGridParAccelerator, nestedGridTunables},
+    {"octree", CreateOctreeAccelerator, octreeTunables},
+    {"nested_grid", CreateNestedGridAccelerator, nestedGridTunables},
+    {"octree_par", CreateOctreeParAccelerator, octreeTunables},
+    {"sah_nested_kd", CreateSAHNestedKDAccelerator, sahKdTunables},
+    {"sah_nested_kd_parsort", CreateSAHNestedKDParAccelerator, sahKdTunables},
+    {"splitmiddle_nested_kd", CreateSplitNestedKDAccelerator, splitKdTunables},
+    {"sah_inplace_kd_par", CreateSAHInPlaceKDParAccelerator,
+     inPlaceKdTunables},
+    {"grid_par", CreateGridParAccelerator, gridTunables},
+    {"grid", CreateGridAccelerator, gridTunables},
+    {"hierarchical_grid", CreateHierarchicalGridAccelerator, gridTunables},
+    {"single_cell_grid", CreateSingleCellGridAccelerator,
+     singleCellGridTunables},
+    {"auto", CreateAutoAccelerator, {}},
+};
+
+std::unique_ptr<SPPMAccelerator> CreateSPPMAccelerator(
+    const std::string &name, const ParamSet &params,
+    const SPPMAcceleratorSettings &settings) {
+    for (const SPPMAcceleratorEntry &entry : accelerators)
+        if (name == entry.name)
+            return std::unique_ptr<SPPMAccelerator>(
+                entry.create(params, settings));
+    return nullptr;
+}
+
+SPPMAcceleratorStats ReportSPPMAcceleratorStats(const SPPMAccelerator &accel,
+                                                int nPoints) {
+    SPPMAcceleratorStats stats;
+    stats.bytes = accel.BytesUsed();
+    Float rootArea = 0;
+    double interiorArea = 0, leafCost = 0, depthSum = 0;
+    accel.VisitNodes([&](const SPPMAcceleratorNode &node) {
+        // The first node visited is the root of a hierarchy
+        bool haveBounds = node.bounds.pMin.x <= node.bounds.pMax.x;
+        Float area = haveBounds ? node.bounds.SurfaceArea() : 0;
+        if (stats.nodes == 0) rootArea = area;
+        ++stats.nodes;
+        stats.maxDepth = std::max(stats.maxDepth, node.depth);
+        if (!node.leaf) {
+            interiorArea += area;
+            return;
+        }
+        ++stats.leaves;
+        if (node.nPoints == 0) ++stats.emptyLeaves;
+        stats.references += node.nPoints;
+        stats.maxLeafPoints = std::max(stats.maxLeafPoints, node.nPoints);
+        depthSum += node.depth;
+        leafCost += (double)area * node.nPoints;
+
+        ReportValue(accelLeafDepth, node.depth);
+        ReportValue(accelLeafPoints, node.nPoints);
+        ++leafHistogram[node.nPoints == 0
+                            ? 0
+                            : std::min(1 + Log2Int((uint32_t)node.nPoints),
+                                       31)];
+    });
+    if (stats.leaves > 0) stats.meanDepth = depthSum / stats.leaves;
+    if (nPoints > 0) stats.duplication = (double)stats.references / nPoints;
+    // Expected traversal steps and point tests of a query, weighting each
+    // node by the probability of reaching it, its surface area relative to
+    // the root's
+    if (stats.nodes > stats.leaves && rootArea > 0)
+        stats.sahCost = (interiorArea + leafCost) / rootArea;
+
+    if (stats.nodes > 0) {
+        ReportValue(accelNodes, stats.nodes);
+        ReportValue(accelLeaves, stats.leaves);
+        ReportValue(accelMaxDepth, stats.maxDepth);
+        accelEmptyLeaves += stats.emptyLeaves;
+        accelAllLeaves += stats.leaves;
+        accelReferences += stats.references;
+        accelPoints += nPoints;
+        if (stats.sahCost >= 0) ReportValue(accelSAHCost, stats.sahCost);
+    }
+    ReportValue(accelMegabytes, stats.bytes / (1024. * 1024.));
+    return stats;
+}
+
+SPPMKdTreeParams FindSPPMKdTreeParams(const ParamSet &params,
+                                      const SPPMKdTreeParams &defaults) {
+    SPPMKdTreeParams kd;
+    kd.intersectCost =
+        std::max(1, params.FindOneInt("intersectcost", defaults.intersectCost));
+    kd.traversalCost =
+        std::max(0, params.FindOneInt("traversalcost", defaults.traversalCost));
+    kd.emptyBonus = Clamp(
+        params.FindOneFloat("emptybonus", defaults.emptyBonus), 0, 1);
+    kd.maxLeafPoints =
+        std::max(1, params.FindOneInt("maxleafpoints", defaults.maxLeafPoints));
+    kd.maxTreeDepth = params.FindOneInt("maxtreedepth", defaults.maxTreeDepth);
+    return kd;
+}
+
+const std::vector<std::string> &SPPMAcceleratorNames() {
+    static const std::vector<std::string> names = [] {
+        std::vector<std::string> n;
+        for (const SPPMAcceleratorEntry &entry : accelerators)
+            n.push_back(entry.name);
+        return n;
+    }();
+    return names;
+}
+
+const std::vector<SPPMTunableParam> &SPPMAcceleratorTunables(
+    const std::string &name) {
+    static const std::vector<SPPMTunableParam> none;
+    for (const SPPMAcceleratorEntry &entry : accelerators)
+        if (name == entry.name) return entry.tunables;
+    return none;
+}
+
+}  // namespace pbrt
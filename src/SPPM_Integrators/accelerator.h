@@ -1,4 +1,4 @@
-/*
+
 #if defined(_MSC_VER)
 #define NOMINMAX
 #pragma once
@@ -7,21 +7,151 @@
 #ifndef SPPMACCELERATOR_H
 #define SPPMACCELERATOR_H
 
-#include "pbrt.h"
-#include "SPPM_Integrators/SAH_InPlace_KD_par.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
 #include "geometry.h"
-//#include "integrators/kdsppm.cpp"
+#include "pbrt.h"
 
 namespace pbrt {
 
-// Integrator Declarations
+struct SPPMPixel;
+
+// A node of an accelerator, as passed to SPPMAccelerator::VisitNodes()
+struct SPPMAcceleratorNode {
+    // Region the node covers; empty for hash buckets, which have none
+    Bounds3f bounds;
+    int depth = 0;
+    bool leaf = true;
+    // Visible point references stored in the leaf
+    int nPoints = 0;
+};
+
+// Shape and quality of one build, computed from VisitNodes()
+struct SPPMAcceleratorStats {
+    int64_t nodes = 0, leaves = 0, emptyLeaves = 0;
+    int maxDepth = 0;
+    double meanDepth = 0;
+    int maxLeafPoints = 0;
+    // Leaf references, and references per visible point
+    int64_t references = 0;
+    double duplication = 0;
+    size_t bytes = 0;
+    // Surface area heuristic cost with unit traversal and point test costs;
+    // negative for structures without interior nodes
+    double sahCost = -1;
+};
+
+// Render settings that some accelerators derive their build parameters from
+struct SPPMAcceleratorSettings {
+    Float initialSearchRadius = 1;
+    int photonsPerIteration = 1;
+    int nIterations = 1;
+};
+
+// Build parameters shared by the kd-tree accelerators. A negative
+// _maxTreeDepth_ lets the accelerator derive the depth from the point,
+// photon or iteration counts.
+struct SPPMKdTreeParams {
+    int intersectCost = 80, traversalCost = 1;
+    Float emptyBonus = .5f;
+    int maxLeafPoints = 100, maxTreeDepth = -1;
+};
+
+// A build parameter that sppm_tune searches over: its ParamSet name, its
+// default and the values tried
+struct SPPMTunableParam {
+    const char *name;
+    bool isInt;
+    Float defaultValue;
+    std::vector<Float> values;
+};
+
+// Non-owning reference to a callable taking an SPPMPixel *, passed to
+// SPPMAccelerator::Query(). Unlike std::function it never allocates, so
+// callers may wrap a lambda per photon; the callable must outlive the call.
+class SPPMPixelVisitor {
+  public:
+    template <typename F,
+              typename = typename std::enable_if<!std::is_same<
+                  typename std::decay<F>::type, SPPMPixelVisitor>::value>::type>
+    SPPMPixelVisitor(F &&f)
+        : callable((void *)std::addressof(f)),
+          call(&Call<typename std::remove_reference<F>::type>) {}
+    void operator()(SPPMPixel *pixel) const { call(callable, pixel); }
+
+  private:
+    template <typename F>
+    static void Call(void *f, SPPMPixel *pixel) {
+        (*(F *)f)(pixel);
+    }
+    void *callable;
+    void (*call)(void *, SPPMPixel *);
+};
+
+// Spatial index over the visible points of one SPPM iteration. The driver
+// rebuilds it after every camera pass and queries it at every photon
+// intersection.
 class SPPMAccelerator {
   public:
-    // Integrator Interface
-    //virtual ~SPPMAccelerator();
-    virtual void build() = 0;
-    virtual std::vector<int>* trace(Point3f p) = 0;
+    // SPPMAccelerator Interface
+    virtual ~SPPMAccelerator() {}
+
+    // Builds the structure over _pixels_, the pixels that hold a visible
+    // point. The pointers must stay valid until the next call.
+    virtual void Build(const std::vector<SPPMPixel *> &pixels) = 0;
+
+    // Calls _func_ for every visible point whose search sphere contains _p_
+    // and returns the number of visible points tested. May be called
+    // concurrently from several threads.
+    virtual int Query(const Point3f &p, SPPMPixelVisitor func) const = 0;
+
+    // Memory used by the last build and name/value pairs describing it
+    virtual size_t BytesUsed() const = 0;
+    // Most memory held during the last build, with the scratch space and
+    // allocator slack that BytesUsed() leaves out
+    virtual size_t PeakBytesUsed() const { return BytesUsed(); }
+    virtual std::vector<std::pair<std::string, double>> Shape() const {
+        return {};
+    }
+
+    // Calls _func_ for every node of the last build, parents before their
+    // children. Flat structures report their occupied cells or buckets as
+    // leaves at depth 0; structures that can't enumerate their nodes report
+    // nothing.
+    virtual void VisitNodes(
+        const std::function<void(const SPPMAcceleratorNode &)> &func) const {}
 };
+
+// Returns the accelerator registered as _name_, or nullptr if there is none
+std::unique_ptr<SPPMAccelerator> CreateSPPMAccelerator(
+    const std::string &name, const ParamSet &params,
+    const SPPMAcceleratorSettings &settings);
+
+// Reads the "intersectcost", "traversalcost", "emptybonus",
+// "maxleafpoints" and "maxtreedepth" parameters, using _defaults_ for the
+// ones _params_ doesn't set
+SPPMKdTreeParams FindSPPMKdTreeParams(const ParamSet &params,
+                                      const SPPMKdTreeParams &defaults);
+
+// Names accepted by CreateSPPMAccelerator(), in registration order
+const std::vector<std::string> &SPPMAcceleratorNames();
+
+// Build parameters of the accelerator _name_ worth tuning per scene; empty
+// for accelerators without any
+const std::vector<SPPMTunableParam> &SPPMAcceleratorTunables(
+    const std::string &name);
+
+// Computes the statistics of _accel_'s last build over _nPoints_ visible
+// points and adds them to the "SPPM accelerator" section of pbrt's
+// statistics
+SPPMAcceleratorStats ReportSPPMAcceleratorStats(const SPPMAccelerator &accel,
+                                                int nPoints);
+
 }  // namespace pbrt
 
-#endif*/
\ No newline at end of file
+#endif  // SPPMACCELERATOR_H
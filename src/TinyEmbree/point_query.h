@@ -2,8 +2,10 @@
 
 #include <embree3/rtcore.h>
 
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <functional>
 #include <iostream>
 
@@ -85,10 +87,27 @@ class PointQuery {
     RTCDevice device;
     RTCScene scene;
     bool isInit;
+    // Bytes Embree holds for the device, and the most it held since the
+    // last SetPoints()
+    std::atomic<int64_t> deviceBytes{0};
+    std::atomic<int64_t> peakDeviceBytes{0};
+
+    // Called by Embree before every allocation and after every free, with
+    // a negative size for frees
+    static bool MemoryMonitor(void* userPtr, ssize_t bytes, bool post) {
+        PointQuery* query = (PointQuery*)userPtr;
+        int64_t now = query->deviceBytes.fetch_add(bytes) + bytes;
+        int64_t peak = query->peakDeviceBytes.load();
+        while (now > peak &&
+               !query->peakDeviceBytes.compare_exchange_weak(peak, now)) {
+        }
+        return true;
+    }
 
   public:
     PointQuery() {
         device = initializeDevice();
+        rtcSetDeviceMemoryMonitorFunction(device, MemoryMonitor, this);
         isInit = false;
     }
 
@@ -99,6 +118,9 @@ class PointQuery {
         rtcReleaseDevice(device);
     }
 
+    size_t DeviceBytes() const { return (size_t)deviceBytes.load(); }
+    size_t PeakDeviceBytes() const { return (size_t)peakDeviceBytes.load(); }
+
     void KnnQuery(const Point* pos, float radius, KNNResult* result) {
         RTCPointQuery query;
         query.x = pos->x;
@@ -116,6 +138,7 @@ class PointQuery {
     void SetPoints(Point* data, unsigned int num_points) {
         
         if (isInit) rtcReleaseScene(scene);
+        peakDeviceBytes = deviceBytes.load();
 
         scene = rtcNewScene(device);
         isInit = true;
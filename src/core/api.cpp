@@ -39,6 +39,7 @@
 #include "film.h"
 #include "medium.h"
 #include "stats.h"
+#include "timeline.h"
 
 // API Additional Headers
 #include "accelerators/bvh.h"
@@ -60,17 +61,7 @@
 #include "integrators/sppm.h"
 #include "integrators/volpath.h"
 #include "integrators/whitted.h"
-#include "SPPM_Integrators/BVH_Embree.h"
-#include "SPPM_Integrators/Nested_Grid_Par.h"
-#include "SPPM_Integrators/Nested_Grid.h"
-#include "SPPM_Integrators/Octree.h"
-#include "SPPM_Integrators/Octree_Par.h"
-#include "SPPM_Integrators/SAH_Nested_KD.h"
-#include "SPPM_Integrators/SAH_Nested_KD_parSort.h"
-#include "SPPM_Integrators/SplitMiddle_Nested_KD.h"
-#include "SPPM_Integrators/SAH_InPlace_KD_par.h"
-#include "SPPM_Integrators/Grid_par.h"
-#include "SPPM_Integrators/Grid.h"
+#include "SPPM_Integrators/SPPM_Driver.h"
 #include "lights/diffuse.h"
 #include "lights/distant.h"
 #include "lights/goniometric.h"
@@ -894,6 +885,8 @@ void pbrtInit(const Options &opt) {
     ParallelInit();  // Threads must be launched before the profiler is
                      // initialized.
     InitProfiler();
+    if (!PbrtOptions.timelineFile.empty())
+        TimelineInit(PbrtOptions.timelineFile);
 }
 
 void pbrtCleanup() {
@@ -905,6 +898,7 @@ void pbrtCleanup() {
     currentApiState = APIState::Uninitialized;
     ParallelCleanup();
     CleanupProfiler();
+    TimelineCleanup();
 }
 
 void pbrtIdentity() {
@@ -1671,6 +1665,10 @@ Scene *RenderOptions::MakeScene() {
 }
 
 Integrator *RenderOptions::MakeIntegrator() const {
+    // --integrator replaces the scene's integrator but keeps its parameters
+    const std::string IntegratorName = PbrtOptions.integratorName.empty()
+                                           ? this->IntegratorName
+                                           : PbrtOptions.integratorName;
     std::shared_ptr<const Camera> camera(MakeCamera());
     if (!camera) {
         Error("Unable to create camera");
@@ -1702,32 +1700,17 @@ Integrator *RenderOptions::MakeIntegrator() const {
         integrator = CreateAOIntegrator(IntegratorParams, sampler, camera);
     } else if (IntegratorName == "sppm") {
         integrator = CreateSPPMIntegrator(IntegratorParams, camera);
-    } else if (IntegratorName == "bvh_sppm") {
-        integrator = CreateBVHSPPMIntegrator(IntegratorParams, camera);
-    } else if (IntegratorName == "nested_grid_par_sppm") {
-        integrator =
-            CreateNestedGridParSPPMIntegrator(IntegratorParams, camera);
-    } else if (IntegratorName == "octree_sppm") {
-        integrator =
-            CreateOctreeSPPMIntegrator(IntegratorParams, camera);
-    } else if (IntegratorName == "nested_grid_sppm") {
-        integrator = CreateNestedGridSPPMIntegrator(IntegratorParams, camera);
-    } else if (IntegratorName == "octree_par_sppm") {
-        integrator = CreateOctreeParSPPMIntegrator(IntegratorParams, camera);
-    } else if (IntegratorName == "sah_nested_kd_sppm") {
-        integrator = CreateSAHNestedKDSPPMIntegrator(IntegratorParams, camera);
-    } else if (IntegratorName == "sah_nested_kd_parsort_sppm") {
-        integrator = CreateSAHNestedKDParSPPMIntegrator(IntegratorParams, camera);
-    } else if (IntegratorName == "splitmiddle_nested_kd_sppm") {
-        integrator =
-            CreateSplitNestedKDSPPMIntegrator(IntegratorParams, camera);
-    } else if (IntegratorName == "sah_inplace_kd_par_sppm") {
-        integrator =
-            CreateSAHInPlaceKDParSPPMIntegrator(IntegratorParams, camera);
-    } else if (IntegratorName == "grid_par_sppm") {
-        integrator = CreateGridParSPPMIntegrator(IntegratorParams, camera);
-    } else if (IntegratorName == "grid_sppm") {
-        integrator = CreateGridSPPMIntegrator(IntegratorParams, camera);
+    } else if (IntegratorName.size() > 5 &&
+               IntegratorName.compare(IntegratorName.size() - 5, 5,
+                                      "_sppm") == 0) {
+        // "<accelerator>_sppm" renders SPPM with the named accelerator
+        integrator = CreateAcceleratedSPPMIntegrator(
+            IntegratorName.substr(0, IntegratorName.size() - 5),
+            IntegratorParams, camera);
+        if (!integrator) {
+            Error("Integrator \"%s\" unknown.", IntegratorName.c_str());
+            return nullptr;
+        }
     } else {
         Error("Integrator \"%s\" unknown.", IntegratorName.c_str());
         return nullptr;
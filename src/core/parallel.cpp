@@ -35,9 +35,19 @@
 #include "parallel.h"
 #include "memory.h"
 #include "stats.h"
+#include "stringprint.h"
+#include "timeline.h"
+#include <algorithm>
+#include <fstream>
 #include <list>
 #include <thread>
 #include <condition_variable>
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#endif
 
 namespace pbrt {
 
@@ -58,6 +68,98 @@ static std::atomic<int> reporterCount;
 static std::condition_variable reportDoneCondition;
 static std::mutex reportDoneMutex;
 
+// With --pinthreads, thread _i_ runs on CPU _threadCpus[i]_, which is on
+// NUMA node _threadCpuNodes[i]_
+static std::vector<int> threadCpus, threadCpuNodes;
+static int nNumaNodes = 1;
+static PBRT_THREAD_LOCAL int threadNumaNode;
+// Inside RunOnNumaNode(), the node whose threads run the calling thread's
+// parallel loops; -1 otherwise
+static PBRT_THREAD_LOCAL int loopNumaNode = -1;
+#ifdef __linux__
+static cpu_set_t mainThreadCpus;
+
+// Parses a sysfs CPU list such as "0-7,16-23"
+static std::vector<int> ParseCpuList(const std::string &list) {
+    std::vector<int> cpus;
+    size_t start = 0;
+    while (start < list.size()) {
+        int first, last;
+        int n = sscanf(list.c_str() + start, "%d-%d", &first, &last);
+        if (n < 1) break;
+        if (n == 1) last = first;
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return cpus;
+}
+
+// Lists the CPUs the process may run on, taking one from each NUMA node in
+// turn, so that fewer threads than CPUs still use every node's memory
+// bandwidth
+static void ComputeThreadPlacement() {
+    threadCpus.clear();
+    threadCpuNodes.clear();
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+    std::vector<std::vector<int>> nodeCpus;
+    if (DIR *dir = opendir("/sys/devices/system/node")) {
+        std::vector<int> nodes;
+        while (dirent *entry = readdir(dir)) {
+            int node;
+            if (sscanf(entry->d_name, "node%d", &node) == 1)
+                nodes.push_back(node);
+        }
+        closedir(dir);
+        std::sort(nodes.begin(), nodes.end());
+        for (int node : nodes) {
+            std::ifstream in(StringPrintf(
+                "/sys/devices/system/node/node%d/cpulist", node));
+            std::string list;
+            std::getline(in, list);
+            std::vector<int> cpus;
+            for (int cpu : ParseCpuList(list))
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                    cpus.push_back(cpu);
+            if (!cpus.empty()) nodeCpus.push_back(cpus);
+        }
+    }
+    if (nodeCpus.empty()) {
+        // No topology to go by; all CPUs are on one node
+        nodeCpus.resize(1);
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &allowed)) nodeCpus[0].push_back(cpu);
+    }
+    nNumaNodes = nodeCpus.size();
+    for (size_t i = 0;; ++i) {
+        bool any = false;
+        for (int node = 0; node < nNumaNodes; ++node)
+            if (i < nodeCpus[node].size()) {
+                threadCpus.push_back(nodeCpus[node][i]);
+                threadCpuNodes.push_back(node);
+                any = true;
+            }
+        if (!any) break;
+    }
+}
+
+static void PinThread(int tIndex) {
+    if (threadCpus.empty()) return;
+    int i = tIndex % threadCpus.size();
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(threadCpus[i], &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0)
+        threadNumaNode = threadCpuNodes[i];
+    else
+        LOG(WARNING) << "Couldn't pin thread " << tIndex << " to CPU "
+                     << threadCpus[i];
+}
+#endif  // __linux__
+
 class ParallelForLoop {
   public:
     // ParallelForLoop Public Methods
@@ -87,6 +189,8 @@ class ParallelForLoop {
     int activeWorkers = 0;
     ParallelForLoop *next = nullptr;
     int nX = -1;
+    // NUMA node whose threads run the loop, or -1 for all threads
+    int numaNode = loopNumaNode;
 
     // ParallelForLoop Private Methods
     bool Finished() const {
@@ -112,6 +216,9 @@ static std::condition_variable workListCondition;
 static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
     LOG(INFO) << "Started execution in worker thread " << tIndex;
     ThreadIndex = tIndex;
+#ifdef __linux__
+    if (PbrtOptions.pinThreads) PinThread(tIndex);
+#endif
 
     // Give the profiler a chance to do per-thread initialization for
     // the worker thread before the profiling system actually stops running.
@@ -136,8 +243,9 @@ static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
                 reportDoneCondition.notify_one();
             // Now sleep again.
             workListCondition.wait(lock);
-        } else if (!workList) {
-            // Sleep until there are more tasks to run
+        } else if (!workList || (workList->numaNode >= 0 &&
+                                 workList->numaNode != threadNumaNode)) {
+            // Sleep until there are more tasks to run on this thread's node
             workListCondition.wait(lock);
         } else {
             // Get work from _workList_ and run loop iterations
@@ -157,6 +265,7 @@ static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
 
             // Run loop indices in _[indexStart, indexEnd)_
             lock.unlock();
+            int64_t chunkStart = TimelineEnabled() ? TimelineNow() : -1;
             for (int64_t index = indexStart; index < indexEnd; ++index) {
                 uint64_t oldState = ProfilerState;
                 ProfilerState = loop.profilerState;
@@ -170,6 +279,9 @@ static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
                 }
                 ProfilerState = oldState;
             }
+            if (chunkStart >= 0)
+                TimelineRecord("ParallelFor chunk", "parallel", chunkStart,
+                               "first", indexStart);
             lock.lock();
 
             // Update _loop_ to reflect completion of iterations
@@ -192,6 +304,7 @@ void ParallelFor(std::function<void(int64_t)> func, int64_t count,
     }
 
     // Create and enqueue _ParallelForLoop_ for this loop
+    TimelineScope _("ParallelFor", "parallel", "count", count);
     ParallelForLoop loop(std::move(func), count, chunkSize,
                          CurrentProfilerState());
     workListMutex.lock();
@@ -218,6 +331,8 @@ void ParallelFor(std::function<void(int64_t)> func, int64_t count,
 
         // Run loop indices in _[indexStart, indexEnd)_
         lock.unlock();
+        int64_t chunkStart =
+            TimelineEnabled() && indexEnd > indexStart ? TimelineNow() : -1;
         for (int64_t index = indexStart; index < indexEnd; ++index) {
             uint64_t oldState = ProfilerState;
             ProfilerState = loop.profilerState;
@@ -231,6 +346,9 @@ void ParallelFor(std::function<void(int64_t)> func, int64_t count,
             }
             ProfilerState = oldState;
         }
+        if (chunkStart >= 0)
+            TimelineRecord("ParallelFor chunk", "parallel", chunkStart,
+                           "first", indexStart);
         lock.lock();
 
         // Update _loop_ to reflect completion of iterations
@@ -253,6 +371,7 @@ void ParallelFor2D(std::function<void(Point2i)> func, const Point2i &count) {
         return;
     }
 
+    TimelineScope _("ParallelFor2D", "parallel", "count", count.x * count.y);
     ParallelForLoop loop(std::move(func), count, CurrentProfilerState());
     {
         std::lock_guard<std::mutex> lock(workListMutex);
@@ -278,6 +397,8 @@ void ParallelFor2D(std::function<void(Point2i)> func, const Point2i &count) {
 
         // Run loop indices in _[indexStart, indexEnd)_
         lock.unlock();
+        int64_t chunkStart =
+            TimelineEnabled() && indexEnd > indexStart ? TimelineNow() : -1;
         for (int64_t index = indexStart; index < indexEnd; ++index) {
             uint64_t oldState = ProfilerState;
             ProfilerState = loop.profilerState;
@@ -291,6 +412,9 @@ void ParallelFor2D(std::function<void(Point2i)> func, const Point2i &count) {
             }
             ProfilerState = oldState;
         }
+        if (chunkStart >= 0)
+            TimelineRecord("ParallelFor chunk", "parallel", chunkStart,
+                           "first", indexStart);
         lock.lock();
 
         // Update _loop_ to reflect completion of iterations
@@ -302,10 +426,46 @@ int NumSystemCores() {
     return std::max(1u, std::thread::hardware_concurrency());
 }
 
+int NumaNodeCount() { return nNumaNodes; }
+
+int ThreadNumaNode() { return threadNumaNode; }
+
+void RunOnNumaNode(int node, const std::function<void()> &func) {
+#ifdef __linux__
+    if (node >= 0 && node < nNumaNodes && !threadCpus.empty()) {
+        cpu_set_t saved, cpus;
+        CPU_ZERO(&cpus);
+        for (size_t i = 0; i < threadCpus.size(); ++i)
+            if (threadCpuNodes[i] == node) CPU_SET(threadCpus[i], &cpus);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) ==
+                0 &&
+            pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) ==
+                0) {
+            int savedNode = threadNumaNode, savedLoopNode = loopNumaNode;
+            threadNumaNode = loopNumaNode = node;
+            func();
+            threadNumaNode = savedNode;
+            loopNumaNode = savedLoopNode;
+            pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+            return;
+        }
+    }
+#endif
+    func();
+}
+
 void ParallelInit() {
     CHECK_EQ(threads.size(), 0);
     int nThreads = MaxThreadIndex();
     ThreadIndex = 0;
+#ifdef __linux__
+    // Pin the main thread too; it helps with every parallel loop
+    if (PbrtOptions.pinThreads &&
+        sched_getaffinity(0, sizeof(mainThreadCpus), &mainThreadCpus) == 0) {
+        ComputeThreadPlacement();
+        PinThread(0);
+    }
+#endif
 
     // Create a barrier so that we can be sure all worker threads get past
     // their call to ProfilerWorkerThreadInit() before we return from this
@@ -322,6 +482,16 @@ void ParallelInit() {
 }
 
 void ParallelCleanup() {
+    // Give the main thread back the CPUs it had before ParallelInit()
+#ifdef __linux__
+    if (!threadCpus.empty())
+        pthread_setaffinity_np(pthread_self(), sizeof(mainThreadCpus),
+                               &mainThreadCpus);
+#endif
+    threadCpus.clear();
+    threadCpuNodes.clear();
+    nNumaNodes = 1;
+    threadNumaNode = 0;
     if (threads.empty()) return;
 
     {
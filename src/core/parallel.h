@@ -105,6 +105,17 @@ void ParallelFor2D(std::function<void(Point2i)> func, const Point2i &count);
 int MaxThreadIndex();
 int NumSystemCores();
 
+// NUMA nodes that the rendering threads run on; 1 unless the threads are
+// pinned with --pinthreads on a machine with several
+int NumaNodeCount();
+// NUMA node of the calling thread's CPU, or 0 if it isn't pinned
+int ThreadNumaNode();
+// Runs _func_ in the calling thread while it's pinned to the CPUs of NUMA
+// node _node_, then restores its pinning. Parallel loops that _func_ starts
+// run on that node's threads only, so that all the memory it first touches
+// is local to the node.
+void RunOnNumaNode(int node, const std::function<void()> &func);
+
 void ParallelInit();
 void ParallelCleanup();
 void MergeWorkerThreadStats();
@@ -176,10 +176,33 @@ struct Options {
         cropWindow[1][1] = 1;
     }
     int nThreads = 0;
+    // Pin each thread to a CPU, spreading them across NUMA nodes
+    bool pinThreads = false;
     bool quickRender = false;
     bool quiet = false;
     bool cat = false, toPly = false;
     std::string imageFile;
+    // Replaces the scene's integrator, keeping its parameters
+    std::string integratorName;
+    std::string sppmTelemetryFile;
+    // SPPM iteration to capture; -1 captures the last one
+    std::string sppmCaptureFile;
+    int sppmCaptureIteration = -1;
+    bool sppmPerfCounters = false;
+    // Print SPPM memory use every iteration; abort above the budget, in MB
+    bool sppmMemory = false;
+    int sppmMemoryBudgetMB = 0;
+    std::string sppmCheckpointFile;
+    int sppmCheckpointInterval = 16;
+    bool sppmResume = false;
+    // Split each SPPM photon pass across this many processes; workers run
+    // the same command line with the coordinator's socket
+    int sppmShards = 1;
+    std::string sppmWorkerSocket;
+    std::vector<std::string> commandLine;
+    // Give every NUMA node its own copy of the SPPM accelerator
+    bool sppmNumaReplicas = false;
+    std::string timelineFile;
     // x0, x1, y0, y1
     Float cropWindow[2][2];
 };
@@ -399,6 +422,24 @@ inline int CountTrailingZeros(uint32_t v) {
 #endif
 }
 
+inline int CountLeadingZeros(uint64_t v) {
+    if (v == 0) return 64;
+#if defined(PBRT_IS_MSVC)
+    unsigned long index;
+#if defined(_WIN64)
+    _BitScanReverse64(&index, v);
+#else
+    if (_BitScanReverse(&index, v >> 32))
+        index += 32;
+    else
+        _BitScanReverse(&index, v & 0xffffffff);
+#endif  // _WIN64
+    return 63 - index;
+#else
+    return __builtin_clzll(v);
+#endif
+}
+
 template <typename Predicate>
 int FindInterval(int size, const Predicate &pred) {
     int first = 0, len = size;
@@ -0,0 +1,151 @@
+
+// core/timeline.cpp*
+#include "timeline.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "parallel.h"
+
+namespace pbrt {
+
+// Timeline Local Definitions
+struct TimelineEvent {
+    const char *name, *category, *argName;
+    int64_t start, duration, arg;
+};
+
+struct TimelineBuffer {
+    TimelineBuffer(int capacity, int tid, int threadIndex)
+        : events(new TimelineEvent[capacity]),
+          tid(tid),
+          threadIndex(threadIndex) {}
+    std::unique_ptr<TimelineEvent[]> events;
+    // Events recorded so far; only the last _capacity_ are kept
+    int64_t count = 0;
+    const int tid, threadIndex;
+};
+
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<TimelineBuffer>> buffers;
+static std::string timelineFile;
+static int timelineCapacity;
+static std::chrono::steady_clock::time_point timelineStart;
+// Bumped by every TimelineInit() so threads drop buffers of earlier traces
+static int timelineGeneration;
+static PBRT_THREAD_LOCAL TimelineBuffer *threadBuffer;
+static PBRT_THREAD_LOCAL int threadGeneration;
+
+static TimelineBuffer *ThreadBuffer() {
+    if (threadBuffer && threadGeneration == timelineGeneration)
+        return threadBuffer;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    buffers.push_back(std::unique_ptr<TimelineBuffer>(new TimelineBuffer(
+        timelineCapacity, (int)buffers.size(), ThreadIndex)));
+    threadBuffer = buffers.back().get();
+    threadGeneration = timelineGeneration;
+    return threadBuffer;
+}
+
+// Timeline Definitions
+bool timelineEnabled = false;
+
+void TimelineInit(const std::string &filename, int eventsPerThread) {
+    CHECK_GT(eventsPerThread, 0);
+    timelineFile = filename;
+    timelineCapacity = eventsPerThread;
+    buffers.clear();
+    ++timelineGeneration;
+    timelineStart = std::chrono::steady_clock::now();
+    timelineEnabled = true;
+    // Give the calling thread the first track
+    ThreadBuffer();
+}
+
+int64_t TimelineNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - timelineStart)
+        .count();
+}
+
+void TimelineRecord(const char *name, const char *category, int64_t start,
+                    const char *argName, int64_t arg) {
+    if (!timelineEnabled) return;
+    int64_t end = TimelineNow();
+    TimelineBuffer *buffer = ThreadBuffer();
+    TimelineEvent &e = buffer->events[buffer->count++ % timelineCapacity];
+    e.name = name;
+    e.category = category;
+    e.argName = argName;
+    e.start = start;
+    e.duration = end - start;
+    e.arg = arg;
+}
+
+void TimelineCleanup() {
+    if (!timelineEnabled) return;
+    timelineEnabled = false;
+
+    FILE *f = fopen(timelineFile.c_str(), "w");
+    if (!f) {
+        Error("%s: unable to open timeline file", timelineFile.c_str());
+        buffers.clear();
+        return;
+    }
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    int64_t dropped = 0;
+    bool first = true;
+    for (const std::unique_ptr<TimelineBuffer> &buffer : buffers) {
+        // Name the thread's track; threads outside pbrt's pool (TBB's, for
+        // instance) don't have a thread index of their own
+        char threadName[64];
+        if (buffer->tid == 0)
+            snprintf(threadName, sizeof(threadName), "main");
+        else if (buffer->threadIndex > 0)
+            snprintf(threadName, sizeof(threadName), "worker %d",
+                     buffer->threadIndex);
+        else
+            snprintf(threadName, sizeof(threadName), "other %d",
+                     buffer->tid);
+        fprintf(f,
+                "%s{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 0, "
+                "\"tid\": %d, \"args\": {\"name\": \"%s\"}},\n"
+                "{\"ph\": \"M\", \"name\": \"thread_sort_index\", "
+                "\"pid\": 0, \"tid\": %d, \"args\": {\"sort_index\": %d}}",
+                first ? "" : ",\n", buffer->tid, threadName, buffer->tid,
+                buffer->tid);
+        first = false;
+
+        int64_t n = std::min<int64_t>(buffer->count, timelineCapacity);
+        dropped += buffer->count - n;
+        for (int64_t i = buffer->count - n; i < buffer->count; ++i) {
+            const TimelineEvent &e = buffer->events[i % timelineCapacity];
+            // Timestamps are in microseconds
+            fprintf(f,
+                    ",\n{\"ph\": \"X\", \"name\": \"%s\", \"cat\": \"%s\", "
+                    "\"pid\": 0, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+                    e.name, e.category, buffer->tid, e.start * 1e-3,
+                    e.duration * 1e-3);
+            if (e.argName)
+                fprintf(f, ", \"args\": {\"%s\": %lld}", e.argName,
+                        (long long)e.arg);
+            fprintf(f, "}");
+        }
+    }
+    fprintf(f, "\n], \"otherData\": {\"droppedEvents\": %lld}}\n",
+            (long long)dropped);
+    if (fclose(f) != 0)
+        Error("%s: error writing timeline file", timelineFile.c_str());
+    else if (dropped > 0)
+        Warning("Timeline: dropped the %lld oldest events; the ring buffers "
+                "hold %d events per thread", (long long)dropped,
+                timelineCapacity);
+    buffers.clear();
+}
+
+}  // namespace pbrt
@@ -0,0 +1,63 @@
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_CORE_TIMELINE_H
+#define PBRT_CORE_TIMELINE_H
+
+#include <string>
+
+#include "pbrt.h"
+
+namespace pbrt {
+
+// Timeline tracing, enabled with --trace.
+//
+// Every thread that records an event gets a fixed-size ring buffer, so a
+// long render keeps its most recent events at a bounded cost; the oldest
+// are overwritten first. Events are recorded when they end, as a start
+// time and a duration, and written at pbrtCleanup() in the Chrome
+// trace-event format, which chrome://tracing and ui.perfetto.dev can open.
+//
+// Names, categories and argument names must be string literals or other
+// strings that outlive the trace.
+
+// Starts recording; _eventsPerThread_ is the size of each ring buffer
+void TimelineInit(const std::string &filename, int eventsPerThread = 65536);
+// Writes the recorded events and stops recording
+void TimelineCleanup();
+
+extern bool timelineEnabled;
+inline bool TimelineEnabled() { return timelineEnabled; }
+
+// Nanoseconds since TimelineInit()
+int64_t TimelineNow();
+
+// Records an event that started at _start_, a value returned by
+// TimelineNow(), and ends now. _argName_, if given, labels _arg_ in the
+// event's arguments.
+void TimelineRecord(const char *name, const char *category, int64_t start,
+                    const char *argName = nullptr, int64_t arg = 0);
+
+// Records an event for the lifetime of the object, like _ProfilePhase_
+class TimelineScope {
+  public:
+    TimelineScope(const char *name, const char *category,
+                  const char *argName = nullptr, int64_t arg = 0)
+        : name(name), category(category), argName(argName), arg(arg) {
+        start = TimelineEnabled() ? TimelineNow() : -1;
+    }
+    ~TimelineScope() {
+        if (start >= 0) TimelineRecord(name, category, start, argName, arg);
+    }
+
+  private:
+    const char *name, *category, *argName;
+    int64_t arg, start;
+};
+
+}  // namespace pbrt
+
+#endif  // PBRT_CORE_TIMELINE_H
@@ -48,11 +48,39 @@ static void usage(const char *msg = nullptr) {
 Rendering options:
   --cropwindow <x0,x1,y0,y1> Specify an image crop window.
   --help               Print this help text.
+  --integrator <name>  Render with the given integrator instead of the
+                       scene's, keeping its parameters.
   --nthreads <num>     Use specified number of threads for rendering.
   --outfile <filename> Write the final image to the given filename.
+  --pinthreads         Pin each thread to a CPU, spreading the threads
+                       across NUMA nodes (Linux only).
   --quick              Automatically reduce a number of quality settings to
                        render more quickly.
   --quiet              Suppress all text output other than error messages.
+  --sppmtelemetry <filename> Write per-iteration SPPM timings and counters
+                       to the given file (JSON lines, or CSV for *.csv).
+  --sppmcapture <filename> Write the visible points and photon hits of one
+                       SPPM iteration to the given file, for sppm_accel_bench.
+  --sppmcaptureiter <num> Iteration to capture. Default: the last one.
+  --sppmperf           Count cycles, instructions and cache, branch and TLB
+                       misses in each SPPM phase (Linux only).
+  --sppmmemory         Print the current and peak memory of each part of
+                       the SPPM integrator after every iteration.
+  --sppmmembudget <MB> Stop rendering with an error once the SPPM
+                       integrator would use more than the given memory.
+  --sppmcheckpoint <filename> Save the SPPM per-pixel state to the given file
+                       every few iterations, in the background.
+  --sppmcheckpointiter <num> Iterations between checkpoints. Default: 16.
+  --resume             Continue an SPPM render from its --sppmcheckpoint
+                       file, if there is one.
+  --sppmshards <num>   Trace each SPPM photon pass in the given number of
+                       processes on this machine, which split the threads.
+  --sppmnuma           Give each NUMA node its own copy of the SPPM
+                       accelerator, built and queried by its threads.
+                       Implies --pinthreads.
+  --trace <filename>   Record parallel loop chunks, SPPM phases and
+                       accelerator builds and write them to the given file
+                       in Chrome trace-event format.
 
 Logging options:
   --logdir <dir>       Specify directory that log files should be written to.
@@ -100,6 +128,87 @@ int main(int argc, char *argv[]) {
             options.cropWindow[1][1] = atof(argv[++i]);
         } else if (!strncmp(argv[i], "--outfile=", 10)) {
             options.imageFile = &argv[i][10];
+        } else if (!strcmp(argv[i], "--integrator") ||
+                   !strcmp(argv[i], "-integrator")) {
+            if (i + 1 == argc)
+                usage("missing value after --integrator argument");
+            options.integratorName = argv[++i];
+        } else if (!strncmp(argv[i], "--integrator=", 13)) {
+            options.integratorName = &argv[i][13];
+        } else if (!strcmp(argv[i], "--sppmtelemetry") ||
+                   !strcmp(argv[i], "-sppmtelemetry")) {
+            if (i + 1 == argc)
+                usage("missing value after --sppmtelemetry argument");
+            options.sppmTelemetryFile = argv[++i];
+        } else if (!strncmp(argv[i], "--sppmtelemetry=", 16)) {
+            options.sppmTelemetryFile = &argv[i][16];
+        } else if (!strcmp(argv[i], "--sppmcapture") ||
+                   !strcmp(argv[i], "-sppmcapture")) {
+            if (i + 1 == argc)
+                usage("missing value after --sppmcapture argument");
+            options.sppmCaptureFile = argv[++i];
+        } else if (!strncmp(argv[i], "--sppmcapture=", 14)) {
+            options.sppmCaptureFile = &argv[i][14];
+        } else if (!strcmp(argv[i], "--sppmcaptureiter") ||
+                   !strcmp(argv[i], "-sppmcaptureiter")) {
+            if (i + 1 == argc)
+                usage("missing value after --sppmcaptureiter argument");
+            options.sppmCaptureIteration = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--sppmcaptureiter=", 18)) {
+            options.sppmCaptureIteration = atoi(&argv[i][18]);
+        } else if (!strcmp(argv[i], "--sppmperf") ||
+                   !strcmp(argv[i], "-sppmperf")) {
+            options.sppmPerfCounters = true;
+        } else if (!strcmp(argv[i], "--sppmmemory") ||
+                   !strcmp(argv[i], "-sppmmemory")) {
+            options.sppmMemory = true;
+        } else if (!strcmp(argv[i], "--sppmmembudget") ||
+                   !strcmp(argv[i], "-sppmmembudget")) {
+            if (i + 1 == argc)
+                usage("missing value after --sppmmembudget argument");
+            options.sppmMemoryBudgetMB = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--sppmmembudget=", 16)) {
+            options.sppmMemoryBudgetMB = atoi(&argv[i][16]);
+        } else if (!strcmp(argv[i], "--sppmcheckpoint") ||
+                   !strcmp(argv[i], "-sppmcheckpoint")) {
+            if (i + 1 == argc)
+                usage("missing value after --sppmcheckpoint argument");
+            options.sppmCheckpointFile = argv[++i];
+        } else if (!strncmp(argv[i], "--sppmcheckpoint=", 17)) {
+            options.sppmCheckpointFile = &argv[i][17];
+        } else if (!strcmp(argv[i], "--sppmcheckpointiter") ||
+                   !strcmp(argv[i], "-sppmcheckpointiter")) {
+            if (i + 1 == argc)
+                usage("missing value after --sppmcheckpointiter argument");
+            options.sppmCheckpointInterval = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--sppmcheckpointiter=", 21)) {
+            options.sppmCheckpointInterval = atoi(&argv[i][21]);
+        } else if (!strcmp(argv[i], "--resume") ||
+                   !strcmp(argv[i], "-resume")) {
+            options.sppmResume = true;
+        } else if (!strcmp(argv[i], "--sppmshards") ||
+                   !strcmp(argv[i], "-sppmshards")) {
+            if (i + 1 == argc)
+                usage("missing value after --sppmshards argument");
+            options.sppmShards = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--sppmshards=", 13)) {
+            options.sppmShards = atoi(&argv[i][13]);
+        } else if (!strcmp(argv[i], "--sppmnuma") ||
+                   !strcmp(argv[i], "-sppmnuma")) {
+            options.sppmNumaReplicas = true;
+            options.pinThreads = true;
+        } else if (!strcmp(argv[i], "--sppmworker")) {
+            // Internal: run as a photon shard of another pbrt process
+            if (i + 1 == argc)
+                usage("missing value after --sppmworker argument");
+            options.sppmWorkerSocket = argv[++i];
+        } else if (!strcmp(argv[i], "--trace") ||
+                   !strcmp(argv[i], "-trace")) {
+            if (i + 1 == argc)
+                usage("missing value after --trace argument");
+            options.timelineFile = argv[++i];
+        } else if (!strncmp(argv[i], "--trace=", 8)) {
+            options.timelineFile = &argv[i][8];
         } else if (!strcmp(argv[i], "--logdir") || !strcmp(argv[i], "-logdir")) {
             if (i + 1 == argc)
                 usage("missing value after --logdir argument");
@@ -113,6 +222,9 @@ int main(int argc, char *argv[]) {
             FLAGS_minloglevel = atoi(argv[++i]);
         } else if (!strncmp(argv[i], "--minloglevel=", 14)) {
             FLAGS_minloglevel = atoi(&argv[i][14]);
+        } else if (!strcmp(argv[i], "--pinthreads") ||
+                   !strcmp(argv[i], "-pinthreads")) {
+            options.pinThreads = true;
         } else if (!strcmp(argv[i], "--quick") || !strcmp(argv[i], "-quick")) {
             options.quickRender = true;
         } else if (!strcmp(argv[i], "--quiet") || !strcmp(argv[i], "-quiet")) {
@@ -138,6 +250,29 @@ int main(int argc, char *argv[]) {
             filenames.push_back(argv[i]);
     }
 
+    if (!options.sppmWorkerSocket.empty()) {
+        // Shard workers only trace photons; the coordinator writes the
+        // image and reports the render
+        options.sppmShards = 1;
+        options.quiet = true;
+        options.sppmTelemetryFile.clear();
+        options.sppmCaptureFile.clear();
+        options.sppmPerfCounters = false;
+        options.sppmMemory = false;
+        options.timelineFile.clear();
+    } else if (options.sppmShards > 1) {
+        if (filenames.empty())
+            usage("--sppmshards needs the scene's filenames");
+        if (options.pinThreads)
+            usage("--sppmshards can't be combined with --pinthreads or "
+                  "--sppmnuma");
+        // Split the cores between the processes
+        if (options.nThreads == 0)
+            options.nThreads =
+                std::max(1, NumSystemCores() / options.sppmShards);
+        options.commandLine.assign(argv, argv + argc);
+    }
+
     // Print welcome banner
     if (!options.quiet && !options.cat && !options.toPly) {
         if (sizeof(void *) == 4)
@@ -49,6 +49,15 @@ TEST(CountTrailing, Basics) {
     }
 }
 
+TEST(CountLeading, Basics) {
+    EXPECT_EQ(64, CountLeadingZeros(0));
+    for (int i = 0; i < 64; ++i) {
+        uint64_t v = 1ull << i;
+        EXPECT_EQ(63 - i, CountLeadingZeros(v));
+        EXPECT_EQ(63 - i, CountLeadingZeros(v | (v - 1)));
+    }
+}
+
 TEST(RoundUpPow2, Basics) {
     EXPECT_EQ(RoundUpPow2(7), 8);
     for (int i = 1; i < (1 << 24); ++i)
@@ -0,0 +1,65 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "parallel.h"
+#include "SPPM_Integrators/Cell_Hash_Table.h"
+
+#include <set>
+
+using namespace pbrt;
+
+TEST(CellHashTable, ConcurrentInsert) {
+    ParallelInit();
+
+    // Every cell is inserted by several iterations, possibly concurrently
+    const int res = 20;
+    CellHashTable table(.75f);
+    table.Reset(res * res * res);
+    std::vector<std::atomic<int>> slotOwner(table.Capacity());
+    for (auto &o : slotOwner) o = -1;
+    ParallelFor(
+        [&](int64_t i) {
+            int c = i % (res * res * res);
+            Point3i cell(c % res, (c / res) % res, c / (res * res));
+            int slot = table.Insert(cell);
+            ASSERT_TRUE(slot >= 0 && slot < table.Capacity());
+            int expected = -1;
+            if (!slotOwner[slot].compare_exchange_strong(expected, c)) {
+                EXPECT_EQ(c, expected);
+            }
+        },
+        4 * res * res * res, 256);
+
+    // Distinct cells get distinct slots and are found again
+    std::set<int> slots;
+    for (int c = 0; c < res * res * res; ++c) {
+        Point3i cell(c % res, (c / res) % res, c / (res * res));
+        int slot = table.Find(cell);
+        EXPECT_EQ(c, slotOwner[slot]);
+        slots.insert(slot);
+    }
+    EXPECT_EQ(res * res * res, slots.size());
+    EXPECT_EQ(-1, table.Find(Point3i(res, 0, 0)));
+    EXPECT_EQ(-1, table.Find(Point3i(0, 0, 1 << 20)));
+
+    ParallelCleanup();
+}
+
+TEST(CellHashTable, Reset) {
+    CellHashTable table;
+    table.Reset(100);
+    EXPECT_EQ(256, table.Capacity());
+    table.Insert(Point3i(1, 2, 3));
+    EXPECT_GE(table.Find(Point3i(1, 2, 3)), 0);
+    table.Reset(100);
+    EXPECT_EQ(-1, table.Find(Point3i(1, 2, 3)));
+    table.Reset(0);
+    EXPECT_EQ(1, table.Capacity());
+    EXPECT_GE(table.Insert(Point3i(0, 0, 0)), 0);
+
+    // Tables too large to allocate are refused rather than aborting
+    EXPECT_FALSE(table.Reset(CellHashTable::MaxCapacity + 1));
+    EXPECT_EQ(0, table.Capacity());
+    EXPECT_EQ(-1, table.Find(Point3i(0, 0, 0)));
+    EXPECT_TRUE(table.Reset(100));
+}
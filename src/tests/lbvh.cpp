@@ -0,0 +1,62 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "parallel.h"
+#include "rng.h"
+#include "SPPM_Integrators/LBVH.h"
+
+#include <algorithm>
+
+using namespace pbrt;
+
+static void CheckAgainstBruteForce(const std::vector<Point3f> &p,
+                                   const std::vector<Float> &r, RNG &rng) {
+    LBVH lbvh;
+    lbvh.Build(p.size(), p.data(), r.data());
+    EXPECT_EQ(std::max((int)p.size() - 1, 0), lbvh.NodeCount());
+
+    for (int q = 0; q < 1000; ++q) {
+        Point3f pq(rng.UniformFloat() * 12 - 1, rng.UniformFloat() * 12 - 1,
+                   rng.UniformFloat() * 12 - 1);
+        std::vector<int> found, expected;
+        int tested = lbvh.Query(pq, [&](int i) { found.push_back(i); });
+        for (size_t i = 0; i < p.size(); ++i)
+            if (DistanceSquared(p[i], pq) <= r[i] * r[i])
+                expected.push_back(i);
+        std::sort(found.begin(), found.end());
+        EXPECT_EQ(expected, found);
+        EXPECT_GE(tested, (int)found.size());
+    }
+}
+
+TEST(LBVH, MatchesBruteForce) {
+    ParallelInit();
+    RNG rng;
+    for (int n : {0, 1, 2, 3, 17, 1000, 20000}) {
+        std::vector<Point3f> p;
+        std::vector<Float> r;
+        for (int i = 0; i < n; ++i) {
+            p.push_back(Point3f(rng.UniformFloat() * 10,
+                                rng.UniformFloat() * 10,
+                                rng.UniformFloat() * 10));
+            r.push_back(0.05f + rng.UniformFloat());
+        }
+        CheckAgainstBruteForce(p, r, rng);
+    }
+    ParallelCleanup();
+}
+
+TEST(LBVH, DuplicatePoints) {
+    ParallelInit();
+    // Identical Morton codes and a flat distribution along one axis
+    RNG rng;
+    std::vector<Point3f> p;
+    std::vector<Float> r;
+    for (int i = 0; i < 5000; ++i) {
+        p.push_back(i < 2500 ? Point3f(5, 5, 5)
+                             : Point3f(rng.UniformFloat() * 10, 5, 5));
+        r.push_back(0.5f);
+    }
+    CheckAgainstBruteForce(p, r, rng);
+    ParallelCleanup();
+}
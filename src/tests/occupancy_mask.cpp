@@ -0,0 +1,64 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "parallel.h"
+#include "rng.h"
+#include "SPPM_Integrators/Occupancy_Mask.h"
+
+using namespace pbrt;
+
+TEST(OccupancyMask, Conservative) {
+    ParallelInit();
+
+    RNG rng;
+    std::vector<Point3f> p;
+    std::vector<Float> r;
+    for (int i = 0; i < 2000; ++i) {
+        // Two tight clusters far apart, so most of the bounds are empty
+        Float offset = (i & 1) ? 100 : -100;
+        p.push_back(Point3f(offset + rng.UniformFloat(), rng.UniformFloat(),
+                            rng.UniformFloat()));
+        r.push_back(0.01f + 0.1f * rng.UniformFloat());
+    }
+
+    OccupancyMask mask;
+    mask.Build(p.size(), [&](int i) {
+        return Bounds3f(p[i] - Vector3f(r[i], r[i], r[i]),
+                        p[i] + Vector3f(r[i], r[i], r[i]));
+    });
+
+    // Every point inside a search sphere must pass the mask
+    for (size_t i = 0; i < p.size(); ++i) {
+        for (int j = 0; j < 16; ++j) {
+            Vector3f d(rng.UniformFloat() - .5f, rng.UniformFloat() - .5f,
+                       rng.UniformFloat() - .5f);
+            Point3f q = p[i] + d * r[i];
+            EXPECT_TRUE(mask.Occupied(q)) << q;
+        }
+    }
+
+    // Points between the clusters or outside the bounds are rejected
+    EXPECT_FALSE(mask.Occupied(Point3f(0, .5f, .5f)));
+    EXPECT_FALSE(mask.Occupied(Point3f(1000, 0, 0)));
+    EXPECT_FALSE(mask.Occupied(Point3f(0, 0, -50)));
+
+    ParallelCleanup();
+}
+
+TEST(OccupancyMask, EmptyAndSkipped) {
+    ParallelInit();
+
+    OccupancyMask mask(20);
+    EXPECT_EQ(24, mask.Resolution());
+    mask.Build(100, [](int) { return Bounds3f(); });
+    EXPECT_FALSE(mask.Occupied(Point3f(0, 0, 0)));
+
+    mask.Build(100, [](int i) {
+        return i == 7 ? Bounds3f(Point3f(0, 0, 0), Point3f(1, 1, 1))
+                      : Bounds3f();
+    });
+    EXPECT_TRUE(mask.Occupied(Point3f(.5f, .5f, .5f)));
+    EXPECT_FALSE(mask.Occupied(Point3f(1.5f, .5f, .5f)));
+
+    ParallelCleanup();
+}
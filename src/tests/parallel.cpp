@@ -37,3 +37,27 @@ TEST(Parallel, DoNothing) {
 
     ParallelCleanup();
 }
+
+TEST(Parallel, NumaNodeLoops) {
+    // Loops started inside RunOnNumaNode() only run on that node's threads
+    int nThreads = PbrtOptions.nThreads;
+    bool pinThreads = PbrtOptions.pinThreads;
+    PbrtOptions.nThreads = 4;
+    PbrtOptions.pinThreads = true;
+    ParallelInit();
+
+    for (int node = 0; node < NumaNodeCount(); ++node)
+        RunOnNumaNode(node, [&]() {
+            std::atomic<int> otherNode{0};
+            ParallelFor(
+                [&](int64_t) {
+                    if (ThreadNumaNode() != node) ++otherNode;
+                },
+                1000, 1);
+            EXPECT_EQ(0, otherNode) << "node " << node;
+        });
+
+    ParallelCleanup();
+    PbrtOptions.nThreads = nThreads;
+    PbrtOptions.pinThreads = pinThreads;
+}
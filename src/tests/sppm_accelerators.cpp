@@ -0,0 +1,223 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "parallel.h"
+#include "paramset.h"
+#include "rng.h"
+#include "SPPM_Integrators/Auto_Accelerator.h"
+#include "SPPM_Integrators/Cell_Hash_Table.h"
+#include "SPPM_Integrators/SPPM_Pixel.h"
+#include "SPPM_Integrators/accelerator.h"
+
+#include <algorithm>
+
+using namespace pbrt;
+
+// Every registered accelerator must report exactly the visible points whose
+// search sphere contains the query point, each of them once; a point
+// reported twice would receive the photon's flux twice.
+TEST(SPPMAccelerator, MatchesBruteForce) {
+    ParallelInit();
+    RNG rng;
+    const int nPoints = 3000;
+    std::unique_ptr<SPPMPixel[]> pixels(new SPPMPixel[nPoints]);
+    std::vector<SPPMPixel *> active;
+    for (int i = 0; i < nPoints; ++i) {
+        // A thin slab plus a few scattered points, with varying radii
+        Float y = (i % 10) ? rng.UniformFloat() * .1f : rng.UniformFloat() * 10;
+        pixels[i].vp.p =
+            Point3f(rng.UniformFloat() * 10, y, rng.UniformFloat() * 10);
+        pixels[i].radius = .05f + .3f * rng.UniformFloat();
+        active.push_back(&pixels[i]);
+    }
+
+    SPPMAcceleratorSettings settings;
+    settings.initialSearchRadius = .35f;
+    settings.photonsPerIteration = 100000;
+    settings.nIterations = 16;
+    ParamSet params;
+    for (const std::string &name : SPPMAcceleratorNames()) {
+        std::unique_ptr<SPPMAccelerator> accel =
+            CreateSPPMAccelerator(name, params, settings);
+        ASSERT_TRUE(accel != nullptr) << name;
+        // Rebuilding must not keep state from the previous build
+        accel->Build(std::vector<SPPMPixel *>(active.begin() + nPoints / 2,
+                                              active.end()));
+        accel->Build(active);
+
+        for (int q = 0; q < 2000; ++q) {
+            Point3f p(rng.UniformFloat() * 10, rng.UniformFloat() * .2f,
+                      rng.UniformFloat() * 10);
+            std::vector<SPPMPixel *> found, expected;
+            int tested = accel->Query(
+                p, [&](SPPMPixel *pixel) { found.push_back(pixel); });
+            for (SPPMPixel *pixel : active)
+                if (DistanceSquared(pixel->vp.p, p) <=
+                    pixel->radius * pixel->radius)
+                    expected.push_back(pixel);
+            std::sort(found.begin(), found.end());
+            EXPECT_TRUE(std::adjacent_find(found.begin(), found.end()) ==
+                        found.end())
+                << name << " reported a point twice at " << p;
+            EXPECT_EQ(expected, found) << name << " at " << p;
+            EXPECT_GE(tested, (int)found.size()) << name;
+        }
+        EXPECT_GT(accel->BytesUsed(), 0u) << name;
+
+        accel->Build(std::vector<SPPMPixel *>());
+        int tested = accel->Query(Point3f(5, 0, 5), [&](SPPMPixel *) {
+            ADD_FAILURE() << name << " found a point after an empty build";
+        });
+        EXPECT_EQ(0, tested) << name;
+    }
+    ParallelCleanup();
+}
+
+// Grids over a scene many millions of search radii wide must coarsen until
+// their cell keys stay distinct, rather than overflow them.
+TEST(SPPMAccelerator, WideScenes) {
+    ParallelInit();
+    RNG rng;
+    const int nPoints = 500;
+    std::unique_ptr<SPPMPixel[]> pixels(new SPPMPixel[nPoints + 1]);
+    std::vector<SPPMPixel *> active;
+    for (int i = 0; i < nPoints; ++i) {
+        pixels[i].vp.p = Point3f(rng.UniformFloat(), rng.UniformFloat(),
+                                 rng.UniformFloat());
+        pixels[i].radius = 1e-4f * (1 + rng.UniformFloat());
+        active.push_back(&pixels[i]);
+    }
+    // A lone point far away stretches the grid bounds
+    pixels[nPoints].vp.p = Point3f(1e3f, 0, 0);
+    pixels[nPoints].radius = 1e-4f;
+    active.push_back(&pixels[nPoints]);
+
+    SPPMAcceleratorSettings settings;
+    settings.initialSearchRadius = 2e-4f;
+    ParamSet params;
+    for (const std::string name :
+         {"grid", "grid_par", "hierarchical_grid"}) {
+        std::unique_ptr<SPPMAccelerator> accel =
+            CreateSPPMAccelerator(name, params, settings);
+        ASSERT_TRUE(accel != nullptr) << name;
+        accel->Build(active);
+        for (const std::pair<std::string, double> &value : accel->Shape()) {
+            if (value.first == "gridResX") {
+                EXPECT_LT(value.second, CellHashTable::MaxResolution) << name;
+            }
+        }
+        for (int i = 0; i < nPoints; ++i) {
+            Point3f p = pixels[i].vp.p + 1e-4f * Vector3f(rng.UniformFloat(),
+                                                       rng.UniformFloat(),
+                                                       rng.UniformFloat());
+            std::vector<SPPMPixel *> found, expected;
+            accel->Query(p, [&](SPPMPixel *px) { found.push_back(px); });
+            for (SPPMPixel *px : active)
+                if (DistanceSquared(px->vp.p, p) <= px->radius * px->radius)
+                    expected.push_back(px);
+            std::sort(found.begin(), found.end());
+            EXPECT_EQ(expected, found) << name << " at " << p;
+        }
+    }
+    ParallelCleanup();
+}
+
+// Every visible point must be referenced by at least one leaf, and
+// hierarchies must report their root first.
+TEST(SPPMAccelerator, NodeStatistics) {
+    ParallelInit();
+    RNG rng;
+    const int nPoints = 2000;
+    std::unique_ptr<SPPMPixel[]> pixels(new SPPMPixel[nPoints]);
+    std::vector<SPPMPixel *> active;
+    for (int i = 0; i < nPoints; ++i) {
+        pixels[i].vp.p = Point3f(rng.UniformFloat() * 10,
+                                 rng.UniformFloat() * 10, 0);
+        pixels[i].radius = .1f;
+        active.push_back(&pixels[i]);
+    }
+
+    SPPMAcceleratorSettings settings;
+    settings.initialSearchRadius = .1f;
+    settings.photonsPerIteration = 100000;
+    ParamSet params;
+    for (const std::string &name : SPPMAcceleratorNames()) {
+        std::unique_ptr<SPPMAccelerator> accel =
+            CreateSPPMAccelerator(name, params, settings);
+        ASSERT_TRUE(accel != nullptr) << name;
+        accel->Build(active);
+        int firstDepth = -1;
+        accel->VisitNodes([&](const SPPMAcceleratorNode &node) {
+            if (firstDepth < 0) firstDepth = node.depth;
+            EXPECT_GE(node.nPoints, 0) << name;
+            if (!node.leaf) {
+                EXPECT_EQ(0, node.nPoints) << name;
+            }
+        });
+        SPPMAcceleratorStats stats =
+            ReportSPPMAcceleratorStats(*accel, nPoints);
+        if (stats.nodes == 0) continue;
+        EXPECT_EQ(0, firstDepth) << name;
+        EXPECT_GE(stats.references, nPoints) << name;
+        EXPECT_GE(stats.duplication, 1.) << name;
+        EXPECT_LE(stats.emptyLeaves, stats.leaves) << name;
+        if (stats.nodes > stats.leaves) {
+            EXPECT_GT(stats.sahCost, 0) << name;
+        }
+    }
+    ParallelCleanup();
+}
+
+// The auto accelerator measures each candidate in turn, then predicts a
+// cost for every one and keeps answering queries correctly as it switches.
+TEST(SPPMAccelerator, AutoMeasuresCandidates) {
+    ParallelInit();
+    RNG rng;
+    const int nPoints = 2000;
+    std::unique_ptr<SPPMPixel[]> pixels(new SPPMPixel[nPoints]);
+    std::vector<SPPMPixel *> active;
+    for (int i = 0; i < nPoints; ++i) {
+        pixels[i].vp.p = Point3f(rng.UniformFloat() * 10,
+                                 rng.UniformFloat() * 10, rng.UniformFloat());
+        pixels[i].radius = .1f + .2f * rng.UniformFloat();
+        active.push_back(&pixels[i]);
+    }
+
+    SPPMAcceleratorSettings settings;
+    settings.photonsPerIteration = 1000;
+    ParamSet params;
+    std::unique_ptr<std::string[]> names(
+        new std::string[3]{"sah_nested_kd", "no_such_accelerator", "lbvh"});
+    params.AddString("autocandidates", std::move(names), 3);
+    std::unique_ptr<int[]> explore(new int[1]{2});
+    params.AddInt("autoexplore", std::move(explore), 1);
+    std::unique_ptr<AutoAccelerator> accel(static_cast<AutoAccelerator *>(
+        CreateAutoAccelerator(params, settings)));
+    ASSERT_TRUE(accel != nullptr);
+
+    for (int iter = 0; iter < 8; ++iter) {
+        accel->Build(active);
+        // Two iterations of each candidate, then whichever is predicted faster
+        if (iter < 4) {
+            EXPECT_EQ(iter / 2, accel->ActiveCandidate());
+        }
+        if (iter >= 4) {
+            EXPECT_LT(accel->PredictedMs(0), Infinity);
+            EXPECT_LT(accel->PredictedMs(1), Infinity);
+        }
+        for (int q = 0; q < 1000; ++q) {
+            Point3f p(rng.UniformFloat() * 10, rng.UniformFloat() * 10,
+                      rng.UniformFloat());
+            int found = 0, expected = 0;
+            accel->Query(p, [&](SPPMPixel *) { ++found; });
+            for (SPPMPixel *pixel : active)
+                if (DistanceSquared(pixel->vp.p, p) <=
+                    pixel->radius * pixel->radius)
+                    ++expected;
+            EXPECT_EQ(expected, found);
+        }
+        // Shrink the radii as SPPM does
+        for (SPPMPixel *pixel : active) pixel->radius *= .8f;
+    }
+    ParallelCleanup();
+}
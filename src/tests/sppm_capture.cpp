@@ -0,0 +1,58 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "SPPM_Integrators/SPPM_Capture.h"
+
+#include <stdio.h>
+
+using namespace pbrt;
+
+TEST(SPPMCapture, RoundTrip) {
+    std::vector<SPPMCapturePoint> points(100);
+    for (int i = 0; i < 100; ++i)
+        points[i] = {{float(i), float(2 * i), float(-i)}, .5f + i, 9u};
+    std::vector<SPPMCaptureHit> hits(1000);
+    for (int i = 0; i < 1000; ++i) hits[i] = {{float(i), 1.f, float(i) / 7}};
+
+    SPPMCaptureHeader header;
+    header.iteration = 3;
+    header.initialSearchRadius = .25f;
+    header.photonsPerIteration = 12345;
+    header.nIterations = 64;
+    std::string filename = "sppm_capture_test.bin";
+    ASSERT_TRUE(WriteSPPMCapture(filename, header, points, hits));
+
+    {
+        SPPMCapture capture;
+        ASSERT_TRUE(capture.Open(filename));
+        const SPPMCaptureHeader &h = capture.Header();
+        EXPECT_EQ(3, h.iteration);
+        EXPECT_EQ(100u, h.nPoints);
+        EXPECT_EQ(1000u, h.nHits);
+        EXPECT_EQ(.25f, h.initialSearchRadius);
+        EXPECT_EQ(12345, h.photonsPerIteration);
+        EXPECT_EQ(64, h.nIterations);
+        for (int i = 0; i < 100; ++i) {
+            EXPECT_EQ(points[i].p[1], capture.Points()[i].p[1]);
+            EXPECT_EQ(points[i].radius, capture.Points()[i].radius);
+            EXPECT_EQ(9u, capture.Points()[i].bsdf);
+        }
+        for (int i = 0; i < 1000; ++i)
+            EXPECT_EQ(hits[i].p[2], capture.Hits()[i].p[2]);
+    }
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
+
+TEST(SPPMCapture, RejectsOtherFiles) {
+    std::string filename = "sppm_capture_test.txt";
+    FILE *f = fopen(filename.c_str(), "w");
+    ASSERT_TRUE(f != nullptr);
+    fprintf(f, "this is not a capture file, but it is long enough to hold "
+               "a capture header\n");
+    fclose(f);
+
+    SPPMCapture capture;
+    EXPECT_FALSE(capture.Open(filename));
+    EXPECT_EQ(0, remove(filename.c_str()));
+    EXPECT_FALSE(capture.Open("nonexistent_sppm_capture.bin"));
+}
@@ -0,0 +1,90 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "SPPM_Integrators/SPPM_Checkpoint.h"
+
+#include <stdio.h>
+
+using namespace pbrt;
+
+static SPPMCheckpointHeader TestHeader(int iterations) {
+    SPPMCheckpointHeader header;
+    header.pixelBounds[0] = 2;
+    header.pixelBounds[1] = 12;
+    header.pixelBounds[2] = 0;
+    header.pixelBounds[3] = 5;
+    header.photonsPerIteration = 1000;
+    header.nIterations = 64;
+    header.iterations = iterations;
+    header.photonsShot = (uint64_t)iterations * 1000;
+    return header;
+}
+
+TEST(SPPMCheckpoint, RoundTrip) {
+    std::vector<SPPMCheckpointPixel> pixels(50);
+    for (int i = 0; i < 50; ++i) {
+        pixels[i].radius = .5f + i;
+        pixels[i].N = 2 * i;
+        for (int c = 0; c < Spectrum::nSamples; ++c) {
+            pixels[i].Ld[c] = i + c;
+            pixels[i].tau[c] = -i - c;
+        }
+    }
+    std::vector<uint64_t> emissionCounts = {7, 0, 1ull << 40, 3};
+    std::string filename = "sppm_checkpoint_test.bin";
+    {
+        // Later writes replace earlier ones
+        SPPMCheckpointWriter writer(filename);
+        writer.Write(TestHeader(8), pixels);
+        writer.Write(TestHeader(16), pixels, emissionCounts);
+    }
+
+    {
+        SPPMCheckpoint checkpoint;
+        ASSERT_TRUE(checkpoint.Open(filename));
+        const SPPMCheckpointHeader &h = checkpoint.Header();
+        EXPECT_EQ(12, h.pixelBounds[1]);
+        EXPECT_EQ(5, h.pixelBounds[3]);
+        EXPECT_EQ(1000, h.photonsPerIteration);
+        EXPECT_EQ(64, h.nIterations);
+        EXPECT_EQ(16, h.iterations);
+        EXPECT_EQ(16000u, h.photonsShot);
+        for (int i = 0; i < 50; ++i) {
+            const SPPMCheckpointPixel &p = checkpoint.Pixels()[i];
+            EXPECT_EQ(pixels[i].radius, p.radius);
+            EXPECT_EQ(pixels[i].N, p.N);
+            EXPECT_EQ(pixels[i].Ld[0], p.Ld[0]);
+            EXPECT_EQ(pixels[i].tau[Spectrum::nSamples - 1],
+                      p.tau[Spectrum::nSamples - 1]);
+        }
+        EXPECT_EQ(emissionCounts, checkpoint.EmissionCounts());
+    }
+
+    // Renders without an emission guide store no counts
+    ASSERT_TRUE(WriteSPPMCheckpoint(filename, TestHeader(8), pixels));
+    SPPMCheckpoint unguided;
+    ASSERT_TRUE(unguided.Open(filename));
+    EXPECT_TRUE(unguided.EmissionCounts().empty());
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
+
+TEST(SPPMCheckpoint, RejectsOtherFiles) {
+    std::string filename = "sppm_checkpoint_test.txt";
+    FILE *f = fopen(filename.c_str(), "w");
+    ASSERT_TRUE(f != nullptr);
+    fprintf(f, "this is not a checkpoint file, but it is long enough to "
+               "hold a checkpoint header\n");
+    fclose(f);
+
+    SPPMCheckpoint checkpoint;
+    EXPECT_FALSE(checkpoint.Open(filename));
+    EXPECT_EQ(0, remove(filename.c_str()));
+
+    // A checkpoint cut short, as by a full disk, is rejected
+    std::vector<SPPMCheckpointPixel> pixels(10);
+    ASSERT_TRUE(WriteSPPMCheckpoint(filename, TestHeader(8), pixels));
+    SPPMCheckpoint truncated;
+    EXPECT_FALSE(truncated.Open(filename));
+    EXPECT_EQ(0, remove(filename.c_str()));
+    EXPECT_FALSE(checkpoint.Open("nonexistent_sppm_checkpoint.bin"));
+}
@@ -0,0 +1,112 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "lowdiscrepancy.h"
+#include "parallel.h"
+#include "SPPM_Integrators/SPPM_Emission.h"
+
+using namespace pbrt;
+
+TEST(SPPMEmission, UnguidedUntilUpdate) {
+    Float power[3] = {1, 2, 5};
+    Distribution1D lights(power, 3);
+    SPPMEmissionGuide guide(lights);
+    for (Float u : {0.f, .1f, .3f, .6f, .99f}) {
+        Float pdf, guidePdf;
+        EXPECT_EQ(lights.SampleDiscrete(u, &pdf),
+                  guide.SampleLight(u, &guidePdf));
+        EXPECT_EQ(pdf, guidePdf);
+        int bin;
+        Point2f w = guide.SampleEmission(2, 1, Point2f(u, .5f), &bin, &pdf);
+        EXPECT_EQ(Point2f(u, .5f), w);
+        EXPECT_EQ(1, pdf);
+    }
+}
+
+TEST(SPPMEmission, SteersTowardUsefulPhotonsWithoutBias) {
+    Float power[2] = {1, 1};
+    Distribution1D lights(power, 2);
+    SPPMEmissionGuide guide(lights);
+
+    // Only photons of light 1 whose first emission sample has x < .25
+    // reach a visible point
+    auto isUseful = [](int light, const Point2f &u) {
+        return light == 1 && u.x < .25f;
+    };
+    // Samples photon _i_'s light and emission samples, returning the light
+    auto sample = [&](int i, Float *pdf, int bins[2], Point2f *u0) {
+        Float lightPdf, pdf0, pdf1;
+        int light = guide.SampleLight(RadicalInverse(0, i), &lightPdf);
+        Point2f u(RadicalInverse(1, i), RadicalInverse(2, i));
+        *u0 = guide.SampleEmission(light, 0, u, &bins[0], &pdf0);
+        u = Point2f(RadicalInverse(3, i), RadicalInverse(4, i));
+        guide.SampleEmission(light, 1, u, &bins[1], &pdf1);
+        *pdf = lightPdf * pdf0 * pdf1;
+        return light;
+    };
+    const int n = 1 << 14;
+    for (int i = 0; i < n; ++i) {
+        Float pdf;
+        int bins[2];
+        Point2f u0;
+        int light = sample(i, &pdf, bins, &u0);
+        guide.Record(light, bins, isUseful(light, u0));
+    }
+    guide.Update();
+
+    // Most photons are now useful, and weighting them by their densities
+    // still estimates the useful share of the unguided photons, 1/8
+    int nUseful = 0;
+    double estimate = 0;
+    for (int i = 0; i < n; ++i) {
+        Float pdf;
+        int bins[2];
+        Point2f u0;
+        int light = sample(i, &pdf, bins, &u0);
+        if (isUseful(light, u0)) {
+            ++nUseful;
+            estimate += .5 / pdf;
+        }
+    }
+    EXPECT_GT(nUseful, n / 2);
+    EXPECT_NEAR(.125, estimate / n, .002);
+}
+
+TEST(SPPMEmission, RestoresCountsFromAllThreads) {
+    ParallelInit();
+    Float power[3] = {1, 2, 5};
+    Distribution1D lights(power, 3);
+    SPPMEmissionGuide guide(lights);
+
+    // Photons recorded by all threads add up to the same guide as one
+    // restored from its counts
+    const int n = 1 << 14;
+    ParallelFor(
+        [&](int64_t i) {
+            int bins[2] = {int(i % 7), int(i % 5)};
+            guide.Record(i % 3, bins, i % 11 < 2 + i % 3);
+        },
+        n, 256);
+    std::vector<uint64_t> newCounts = guide.NewCounts();
+    uint64_t nShot = 0;
+    for (int light = 0; light < 3; ++light) nShot += newCounts[light];
+    EXPECT_EQ((uint64_t)n, nShot);
+    guide.Update(newCounts);
+
+    SPPMEmissionGuide restored(lights);
+    EXPECT_FALSE(restored.Restore(std::vector<uint64_t>(3)));
+    ASSERT_TRUE(restored.Restore(guide.Counts()));
+    for (Float u : {0.f, .1f, .3f, .6f, .99f}) {
+        Float pdf, restoredPdf;
+        EXPECT_EQ(guide.SampleLight(u, &pdf),
+                  restored.SampleLight(u, &restoredPdf));
+        EXPECT_EQ(pdf, restoredPdf);
+        int bin, restoredBin;
+        Point2f w = guide.SampleEmission(2, 0, Point2f(u, .5f), &bin, &pdf);
+        EXPECT_EQ(w, restored.SampleEmission(2, 0, Point2f(u, .5f),
+                                             &restoredBin, &restoredPdf));
+        EXPECT_EQ(bin, restoredBin);
+        EXPECT_EQ(pdf, restoredPdf);
+    }
+    ParallelCleanup();
+}
@@ -0,0 +1,36 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "SPPM_Integrators/SPPM_Memory.h"
+
+using namespace pbrt;
+
+TEST(SPPMMemory, CurrentAndPeak) {
+    SPPMMemoryTracker memory;
+    memory.Update(SPPMMemoryComponent::Pixels, 1000);
+    memory.Update(SPPMMemoryComponent::CameraArenas, 500);
+    // The accelerator's build scratch is freed once the build is done
+    memory.Update(SPPMMemoryComponent::Accelerator, 200, 700);
+    EXPECT_EQ(1700u, memory.TotalCurrent());
+    EXPECT_EQ(2200u, memory.TotalPeak());
+    EXPECT_EQ(700u, memory.Peak(SPPMMemoryComponent::Accelerator));
+
+    // A smaller rebuild keeps the component's peak
+    memory.Update(SPPMMemoryComponent::Accelerator, 100);
+    EXPECT_EQ(100u, memory.Current(SPPMMemoryComponent::Accelerator));
+    EXPECT_EQ(700u, memory.Peak(SPPMMemoryComponent::Accelerator));
+
+    // Memory freed before the update counts toward the peak alone
+    memory.Update(SPPMMemoryComponent::PhotonArenas, 0, 900);
+    EXPECT_EQ(1600u, memory.TotalCurrent());
+    EXPECT_EQ(2500u, memory.TotalPeak());
+    EXPECT_NE(std::string::npos, memory.Report().find("photon arenas"));
+}
+
+TEST(SPPMMemory, Budget) {
+    SPPMMemoryTracker memory(2000);
+    memory.Update(SPPMMemoryComponent::Pixels, 1500);
+    memory.Update(SPPMMemoryComponent::Accelerator, 100, 500);
+    EXPECT_EXIT(memory.Update(SPPMMemoryComponent::Accelerator, 100, 501),
+                ::testing::ExitedWithCode(1), "memory budget");
+}
@@ -0,0 +1,127 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "parallel.h"
+#include "paramset.h"
+#include "rng.h"
+#include "SPPM_Integrators/SPPM_OutOfCore.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+using namespace pbrt;
+
+TEST(SPPMOutOfCore, MappedArray) {
+    ParallelInit();
+    for (bool mapped : {true, false}) {
+        // Large enough for the construction to be split across threads
+        SPPMMappedArray<SPPMPixel> pixels(100000, mapped);
+        EXPECT_EQ(100000u, pixels.size());
+        for (int i = 0; i < 100000; ++i) {
+            EXPECT_EQ(0, pixels[i].M);
+            EXPECT_EQ(0, pixels[i].radius);
+            pixels[i].radius = i;
+        }
+        EXPECT_EQ(99999, pixels.get()[99999].radius);
+    }
+    ParallelCleanup();
+}
+
+// Looking the hits up brick by brick must find the same visible points as
+// one accelerator over all of them, however small the budget
+TEST(SPPMOutOfCore, BricksMatchBruteForce) {
+    ParallelInit();
+    RNG rng;
+    const int nPoints = 20000, nHits = 5000;
+    std::vector<SPPMPixel> pixels(nPoints);
+    std::vector<SPPMPixel *> active;
+    for (int i = 0; i < nPoints; ++i) {
+        // A floor and a wall
+        Float u = rng.UniformFloat() * 10, v = rng.UniformFloat() * 10;
+        pixels[i].vp.p = (i % 2) ? Point3f(u, 0, v) : Point3f(u, v, 0);
+        pixels[i].radius = .05f + .2f * rng.UniformFloat();
+        if (i % 7) active.push_back(&pixels[i]);
+    }
+
+    SPPMAcceleratorSettings settings;
+    settings.initialSearchRadius = .25f;
+    std::unique_ptr<SPPMAccelerator> accel =
+        CreateSPPMAccelerator("lbvh", ParamSet(), settings);
+    ASSERT_TRUE(accel != nullptr);
+    const size_t budget = 64 * 1024;
+    SPPMBricks bricks(budget, 5);
+    bricks.Build(active, pixels.data(), 0);
+    std::vector<std::pair<std::string, double>> shape = bricks.Shape();
+    EXPECT_GT(shape[0].second, 4) << "too few bricks to test anything";
+
+    std::vector<Point3f> hitPoints(nHits);
+    for (int i = 0; i < nHits; ++i) {
+        Float u = rng.UniformFloat() * 10, v = rng.UniformFloat() * 10;
+        hitPoints[i] = (i % 2) ? Point3f(u, .01f, v) : Point3f(u, v, .01f);
+    }
+    // A small budget still traces a useful batch
+    EXPECT_EQ(1024, bricks.NextBatchEnd(0, nHits));
+    EXPECT_EQ(nHits, bricks.NextBatchEnd(nHits - 10, nHits));
+
+    // Record the hits from all threads, one photon path each, as the
+    // integrator does: a hit that doesn't fit is recorded again after the
+    // hits so far are looked up. The hit's index travels in its throughput.
+    std::mutex mutex;
+    std::vector<std::pair<int, int>> found, expected;
+    auto query = [&](const SPPMPhotonHit *hits, int n) {
+        for (int i = 0; i < n; ++i)
+            accel->Query(hits[i].p, [&](SPPMPixel *pixel) {
+                std::lock_guard<std::mutex> lock(mutex);
+                found.push_back(
+                    {(int)hits[i].beta[0], int(pixel - pixels.data())});
+            });
+    };
+    std::vector<int> pending(nHits);
+    for (int i = 0; i < nHits; ++i) pending[i] = i;
+    int nBatches = 0;
+    while (!pending.empty()) {
+        std::vector<std::vector<int>> deferred(MaxThreadIndex());
+        ParallelFor(
+            [&](int j) {
+                int i = pending[j];
+                if (bricks.HasRoom()) {
+                    size_t start = bricks.PathStart();
+                    if (bricks.AddHit(hitPoints[i], Vector3f(0, 1, 0),
+                                      Spectrum(i)))
+                        return;
+                    bricks.DiscardPath(start);
+                }
+                deferred[ThreadIndex].push_back(i);
+            },
+            pending.size(), 64);
+        int nTraced = pending.size();
+        pending.clear();
+        for (const std::vector<int> &d : deferred)
+            pending.insert(pending.end(), d.begin(), d.end());
+        // Once a buffer is full, no thread may trace more photons
+        if (!pending.empty()) {
+            std::atomic<int> withRoom(0);
+            ParallelFor([&](int) { withRoom += bricks.HasRoom(); }, 64, 1);
+            EXPECT_EQ(0, withRoom);
+        }
+        bricks.ProcessHits(accel.get(), nTraced - pending.size(), query);
+        EXPECT_TRUE(bricks.HasRoom());
+        ++nBatches;
+    }
+    EXPECT_GT(nBatches, 1);
+    EXPECT_LE(bricks.PeakBytesUsed(), budget);
+
+    for (int i = 0; i < nHits; ++i)
+        for (SPPMPixel *pixel : active)
+            if (DistanceSquared(pixel->vp.p, hitPoints[i]) <=
+                pixel->radius * pixel->radius)
+                expected.push_back({i, int(pixel - pixels.data())});
+    std::sort(found.begin(), found.end());
+    EXPECT_TRUE(std::adjacent_find(found.begin(), found.end()) == found.end());
+    std::sort(expected.begin(), expected.end());
+    EXPECT_FALSE(expected.empty());
+    EXPECT_EQ(expected, found);
+    EXPECT_GT(bricks.BytesUsed(), 0u);
+    ParallelCleanup();
+}
@@ -0,0 +1,56 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "lowdiscrepancy.h"
+#include "SPPM_Integrators/SPPM_PhotonSampler.h"
+
+using namespace pbrt;
+
+// Batches that start at zero, cross powers of the small bases and start
+// at large indices
+static const uint64_t batchStarts[] = {0, 3, 240, 6561 - 300, 1000003,
+                                       (1ull << 40) - 5};
+
+TEST(SPPMPhotonSampler, MatchesRadicalInverse) {
+    const int nDimensions = 24;
+    SPPMPhotonSampler sampler(SPPMSampleSequence::Halton, nDimensions);
+    for (uint64_t first : batchStarts) {
+        uint64_t end = first + 1000;
+        sampler.StartBatch(first, end);
+        for (uint64_t index = first; index < end; ++index) {
+            sampler.StartPhoton(index);
+            // Past the sampler's dimensions too
+            for (int dim = 0; dim < nDimensions + 2; ++dim)
+                EXPECT_EQ(RadicalInverse(dim, index), sampler.Get(dim))
+                    << "index " << index << ", dimension " << dim;
+        }
+    }
+}
+
+TEST(SPPMPhotonSampler, MatchesSobolSample) {
+    const int nDimensions = 24;
+    SPPMPhotonSampler sampler(SPPMSampleSequence::Sobol, nDimensions);
+    for (uint64_t first : batchStarts) {
+        uint64_t end = first + 1000;
+        sampler.StartBatch(first, end);
+        for (uint64_t index = first; index < end; ++index) {
+            sampler.StartPhoton(index);
+            for (int dim = 0; dim < nDimensions + 2; ++dim)
+                EXPECT_EQ(SobolSample(index, dim), sampler.Get(dim))
+                    << "index " << index << ", dimension " << dim;
+        }
+    }
+}
+
+TEST(SPPMPhotonSampler, OutOfOrderPhotons) {
+    // Photons of a batch may come in any order, as when threads steal
+    // chunks of the photon loop
+    SPPMPhotonSampler sampler(SPPMSampleSequence::Halton, 8);
+    sampler.StartBatch(100, 2100);
+    for (uint64_t index : {1900, 100, 355, 356, 101, 2099, 1000}) {
+        sampler.StartPhoton(index);
+        // Ask for the later dimensions first
+        for (int dim = 7; dim >= 0; --dim)
+            EXPECT_EQ(RadicalInverse(dim, index), sampler.Get(dim));
+    }
+}
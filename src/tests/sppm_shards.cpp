@@ -0,0 +1,82 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "SPPM_Integrators/SPPM_Shards.h"
+
+#ifndef PBRT_IS_WINDOWS
+#include <sys/socket.h>
+#endif
+#include <thread>
+
+using namespace pbrt;
+
+TEST(SPPMShards, RangesPartitionPhotons) {
+    for (int nShards : {1, 2, 3, 7}) {
+        int next = 0;
+        for (int shard = 0; shard < nShards; ++shard) {
+            int begin, end;
+            SPPMShardRange(1000003, shard, nShards, &begin, &end);
+            EXPECT_EQ(next, begin);
+            EXPECT_LE(end - begin, 1000003 / nShards + 1);
+            next = end;
+        }
+        EXPECT_EQ(1000003, next);
+    }
+}
+
+#ifndef PBRT_IS_WINDOWS
+TEST(SPPMShards, MergeSumsWorkerDeltas) {
+    // A coordinator and two workers, each in a thread of this process
+    const int nPoints = 100;
+    int sockets[2][2];
+    for (int w = 0; w < 2; ++w)
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets[w]));
+    auto deltasOf = [&](int shard) {
+        // Shard _s_ deposits on every (s + 2)-th point
+        std::vector<SPPMFluxDelta> deltas(nPoints);
+        for (int i = 0; i < nPoints; i += shard + 2) {
+            for (int c = 0; c < SPPMPixel::nFluxSamples; ++c)
+                deltas[i].Phi[c] = shard + 1;
+            deltas[i].M = shard + 1;
+        }
+        return deltas;
+    };
+
+    std::vector<SPPMFluxDelta> merged[3];
+    SPPMShardPlan plans[3];
+    std::vector<std::thread> workers;
+    for (int w = 0; w < 2; ++w)
+        workers.push_back(std::thread([&, w]() {
+            SPPMPhotonShards shards(sockets[w][1]);
+            EXPECT_TRUE(shards.IsWorker());
+            EXPECT_TRUE(shards.ExchangePlan(&plans[w + 1]));
+            merged[w + 1] = deltasOf(w + 1);
+            EXPECT_TRUE(shards.Merge(&merged[w + 1]));
+            EXPECT_TRUE(shards.ExchangePlan(&plans[w + 1]));
+        }));
+    {
+        SPPMPhotonShards shards({sockets[0][0], sockets[1][0]});
+        EXPECT_EQ(3, shards.NumShards());
+        plans[0] = {5, 3000, 15000, 0, 0};
+        EXPECT_TRUE(shards.ExchangePlan(&plans[0]));
+        merged[0] = deltasOf(0);
+        EXPECT_TRUE(shards.Merge(&merged[0]));
+        shards.Finish();
+    }
+    for (std::thread &t : workers) t.join();
+
+    for (int s = 0; s < 3; ++s) {
+        // The second plan a worker receives ends the render
+        EXPECT_EQ(s == 0 ? 5 : -1, plans[s].iteration);
+        for (int i = 0; i < nPoints; ++i) {
+            int M = 0;
+            for (int shard = 0; shard < 3; ++shard)
+                if (i % (shard + 2) == 0) M += shard + 1;
+            EXPECT_EQ(M, merged[s][i].M);
+            EXPECT_EQ((Float)M, merged[s][i].Phi[0]);
+        }
+    }
+    EXPECT_EQ(0, plans[0].begin);
+    EXPECT_EQ(1000, plans[0].end);
+}
+#endif  // !PBRT_IS_WINDOWS
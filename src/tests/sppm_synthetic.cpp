@@ -0,0 +1,42 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "parallel.h"
+#include "SPPM_Integrators/SPPM_Synthetic.h"
+
+using namespace pbrt;
+
+TEST(SPPMSynthetic, DeterministicAndBounded) {
+    ParallelInit();
+
+    for (const SPPMSyntheticCase &c : SPPMSyntheticSuite(.002f)) {
+        std::vector<SPPMCapturePoint> points[2];
+        std::vector<SPPMCaptureHit> hits[2];
+        SPPMCaptureHeader header;
+        for (int run = 0; run < 2; ++run)
+            header = GenerateSPPMSynthetic(c.params, &points[run], &hits[run]);
+
+        ASSERT_EQ(c.params.nPoints, (int64_t)points[0].size()) << c.name;
+        ASSERT_EQ(c.params.nHits, (int64_t)hits[0].size()) << c.name;
+        EXPECT_EQ(points[0].size(), header.nPoints);
+        EXPECT_GT(header.initialSearchRadius, 0);
+
+        // The same parameters give the same data, whatever the scheduling
+        EXPECT_EQ(0, memcmp(points[0].data(), points[1].data(),
+                            points[0].size() * sizeof(SPPMCapturePoint)))
+            << c.name;
+        EXPECT_EQ(0, memcmp(hits[0].data(), hits[1].data(),
+                            hits[0].size() * sizeof(SPPMCaptureHit)))
+            << c.name;
+
+        for (const SPPMCapturePoint &p : points[0]) {
+            for (int i = 0; i < 3; ++i) {
+                EXPECT_GE(p.p[i], 0) << c.name;
+                EXPECT_LE(p.p[i], 10) << c.name;
+            }
+            EXPECT_GT(p.radius, 0) << c.name;
+        }
+    }
+
+    ParallelCleanup();
+}
@@ -0,0 +1,31 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "SPPM_Integrators/SPPM_TimeBudget.h"
+
+using namespace pbrt;
+
+TEST(SPPMTimeBudget, FinalIterationFitsDeadline) {
+    SPPMTimeBudget budget(10, 1000);
+    // Nothing is measured before the first iteration
+    EXPECT_EQ(1000, budget.NextPhotons(0));
+
+    // 1ms per photon plus .5s per iteration for everything else
+    budget.Record(1000, 1, .5);
+    EXPECT_EQ(1000, budget.NextPhotons(1.5));
+    EXPECT_FALSE(budget.Final());
+
+    // Less than two nominal iterations left: the last one gets the rest
+    budget.Record(1000, 1, .5);
+    int photons = budget.NextPhotons(7);
+    EXPECT_TRUE(budget.Final());
+    EXPECT_GT(photons, 1000);
+    EXPECT_LE(.5 + photons * .001, 3.);
+    EXPECT_EQ(0, budget.NextPhotons(9.8));
+}
+
+TEST(SPPMTimeBudget, SkipsTinyFinalIteration) {
+    SPPMTimeBudget budget(10, 1000);
+    budget.Record(1000, 1, .5);
+    EXPECT_EQ(0, budget.NextPhotons(9.4));
+}
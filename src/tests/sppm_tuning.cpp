@@ -0,0 +1,78 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "paramset.h"
+#include "SPPM_Integrators/SPPM_Tuning.h"
+#include "SPPM_Integrators/accelerator.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+using namespace pbrt;
+
+TEST(SPPMTuning, RoundTrip) {
+    std::vector<SPPMTunedParam> params = {
+        {"octree", "maxleafpoints", true, 32},
+        {"sah_nested_kd", "emptybonus", false, .25f},
+        {"sah_nested_kd", "maxtreedepth", true, -1}};
+    std::string filename = SPPMTuningFilename("sppm_tuning_test.pbrt");
+    EXPECT_EQ("sppm_tuning_test.pbrt.sppmtune", filename);
+    ASSERT_TRUE(WriteSPPMTuning(filename, "first line\nsecond line", params));
+
+    std::vector<SPPMTunedParam> read;
+    ASSERT_TRUE(ReadSPPMTuning(filename, &read));
+    EXPECT_EQ(0, remove(filename.c_str()));
+    ASSERT_EQ(params.size(), read.size());
+    for (size_t i = 0; i < params.size(); ++i) {
+        EXPECT_EQ(params[i].accelerator, read[i].accelerator);
+        EXPECT_EQ(params[i].name, read[i].name);
+        EXPECT_EQ(params[i].isInt, read[i].isInt);
+        EXPECT_EQ(params[i].value, read[i].value);
+    }
+    EXPECT_FALSE(ReadSPPMTuning("nonexistent.sppmtune", &read));
+}
+
+TEST(SPPMTuning, SceneSettingsWin) {
+    std::vector<SPPMTunedParam> tuned = {
+        {"octree", "maxleafpoints", true, 32},
+        {"octree", "maxtreedepth", true, 9},
+        {"grid", "loadfactor", false, 2}};
+    ParamSet params;
+    std::unique_ptr<int[]> depth(new int[1]);
+    depth[0] = 5;
+    params.AddInt("maxtreedepth", std::move(depth), 1);
+
+    EXPECT_EQ(1, ApplySPPMTuning(tuned, "octree", &params));
+    EXPECT_EQ(32, params.FindOneInt("maxleafpoints", 0));
+    EXPECT_EQ(5, params.FindOneInt("maxtreedepth", 0));
+    EXPECT_EQ(0, params.FindOneFloat("loadfactor", 0));
+}
+
+TEST(SPPMTuning, TunablesIncludeDefaults) {
+    // The search starts from the defaults, so each must be one of the
+    // values tried, and every value must build a usable accelerator
+    SPPMAcceleratorSettings settings;
+    for (const std::string &name : SPPMAcceleratorNames()) {
+        for (const SPPMTunableParam &t : SPPMAcceleratorTunables(name)) {
+            EXPECT_NE(t.values.end(), std::find(t.values.begin(),
+                                                t.values.end(),
+                                                t.defaultValue))
+                << name << " " << t.name;
+            for (Float v : t.values) {
+                ParamSet params;
+                if (t.isInt) {
+                    std::unique_ptr<int[]> iv(new int[1]);
+                    iv[0] = (int)v;
+                    params.AddInt(t.name, std::move(iv), 1);
+                } else {
+                    std::unique_ptr<Float[]> fv(new Float[1]);
+                    fv[0] = v;
+                    params.AddFloat(t.name, std::move(fv), 1);
+                }
+                EXPECT_TRUE(CreateSPPMAccelerator(name, params, settings) !=
+                            nullptr)
+                    << name << " " << t.name << " " << v;
+            }
+        }
+    }
+}
@@ -0,0 +1,73 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "parallel.h"
+#include "timeline.h"
+
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+
+using namespace pbrt;
+
+static std::string ReadAll(const std::string &filename) {
+    std::ifstream in(filename);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+static int Count(const std::string &s, const std::string &what) {
+    int n = 0;
+    for (size_t pos = s.find(what); pos != std::string::npos;
+         pos = s.find(what, pos + 1))
+        ++n;
+    return n;
+}
+
+TEST(Timeline, ChunksAndScopes) {
+    // Chunks only go through the thread pool when there is one
+    int nThreads = PbrtOptions.nThreads;
+    PbrtOptions.nThreads = 4;
+    ParallelInit();
+    std::string filename = "timeline_test.json";
+    TimelineInit(filename);
+    ParallelFor([](int64_t) { TimelineScope _("work", "test", "x", 7); },
+                100, 10);
+    {
+        TimelineScope _("outer", "test");
+    }
+    TimelineCleanup();
+    ParallelCleanup();
+    PbrtOptions.nThreads = nThreads;
+
+    std::string trace = ReadAll(filename);
+    EXPECT_EQ(0u, trace.find("{\"displayTimeUnit\""));
+    EXPECT_EQ(100, Count(trace, "\"name\": \"work\""));
+    EXPECT_EQ(10, Count(trace, "\"name\": \"ParallelFor chunk\""));
+    EXPECT_EQ(1, Count(trace, "\"name\": \"outer\""));
+    EXPECT_EQ(100, Count(trace, "{\"x\": 7}"));
+    EXPECT_NE(std::string::npos, trace.find("\"droppedEvents\": 0}"));
+
+    // Nothing is recorded once the timeline is written
+    EXPECT_FALSE(TimelineEnabled());
+    { TimelineScope _("after", "test"); }
+    remove(filename.c_str());
+}
+
+TEST(Timeline, RingBufferKeepsNewest) {
+    std::string filename = "timeline_ring_test.json";
+    TimelineInit(filename, 4);
+    for (int i = 0; i < 10; ++i)
+        TimelineRecord("event", "test", TimelineNow(), "i", i);
+    TimelineCleanup();
+
+    std::string trace = ReadAll(filename);
+    EXPECT_EQ(4, Count(trace, "\"name\": \"event\""));
+    for (int i = 6; i < 10; ++i)
+        EXPECT_NE(std::string::npos,
+                  trace.find("{\"i\": " + std::to_string(i) + "}"));
+    EXPECT_EQ(std::string::npos, trace.find("{\"i\": 5}"));
+    EXPECT_NE(std::string::npos, trace.find("\"droppedEvents\": 6}"));
+    remove(filename.c_str());
+}
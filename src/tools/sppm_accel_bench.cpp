@@ -0,0 +1,367 @@
+//
+// sppm_accel_bench.cpp
+//
+// Replays SPPM iterations captured with pbrt --sppmcapture, or the
+// synthetic distributions of SPPM_Synthetic.h: times the build and the
+// photon queries of each SPPM accelerator at increasing thread counts and
+// writes one CSV row per data set, accelerator and thread count, with the
+// median and variance of the trials and the parallel efficiency relative
+// to the smallest thread count.
+//
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "SPPM_Integrators/SPPM_Capture.h"
+#include "SPPM_Integrators/SPPM_PerfCounters.h"
+#include "SPPM_Integrators/SPPM_Pixel.h"
+#include "SPPM_Integrators/SPPM_Synthetic.h"
+#include "SPPM_Integrators/accelerator.h"
+#include "parallel.h"
+#include "paramset.h"
+#include "pbrt.h"
+#include <glog/logging.h>
+
+using namespace pbrt;
+
+static void usage(const char *msg = nullptr, ...) {
+    if (msg) {
+        va_list args;
+        va_start(args, msg);
+        fprintf(stderr, "sppm_accel_bench: ");
+        vfprintf(stderr, msg, args);
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, R"(usage: sppm_accel_bench [options] <capture files...>
+       sppm_accel_bench [options] --suite [--scale <s>]
+
+options:
+    --accel <a,b,...>  Accelerators to benchmark. Default: all of them.
+    --outfile <name>   Write the CSV to the given file. Default: stdout.
+    --perf             Add hardware counter columns (cycles, instructions,
+                       LLC, branch and dTLB misses) for the build and the
+                       query pass, per point and per hit (Linux only).
+    --scale <s>        Scale the suite's point and hit counts. Default: 1
+    --suite            Benchmark the synthetic distributions (uniform,
+                       planar, clusters, radius variance, ...) instead of
+                       capture files.
+    --threads <n>      Largest thread count; runs 1, 2, 4, ... up to <n>.
+                       A list such as 1,6,12,24 runs exactly those counts.
+                       Default: the number of cores.
+    --trials <n>       Builds and query passes per measurement; the median
+                       and variance are reported. Default: 3
+    --warmup <n>       Untimed builds and query passes before the trials.
+                       Default: 1
+)");
+    exit(1);
+}
+
+static std::vector<std::string> SplitNames(const std::string &list) {
+    std::vector<std::string> names;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        if (end > start) names.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+    return names;
+}
+
+static double Median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return (n & 1) ? v[n / 2] : .5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+// Sample variance; zero for a single trial
+static double Variance(const std::vector<double> &v) {
+    if (v.size() < 2) return 0;
+    double mean = 0, var = 0;
+    for (double x : v) mean += x;
+    mean /= v.size();
+    for (double x : v) var += (x - mean) * (x - mean);
+    return var / (v.size() - 1);
+}
+
+// "n" runs 1, 2, 4, ... up to n; "a,b,c" runs exactly those thread counts
+static std::vector<int> ParseThreadCounts(const std::string &arg) {
+    std::vector<int> counts;
+    if (arg.find(',') != std::string::npos) {
+        for (const std::string &n : SplitNames(arg))
+            counts.push_back(atoi(n.c_str()));
+        std::sort(counts.begin(), counts.end());
+        counts.erase(std::unique(counts.begin(), counts.end()),
+                     counts.end());
+    } else {
+        int maxThreads = atoi(arg.c_str());
+        for (int t = 1; t < maxThreads; t *= 2) counts.push_back(t);
+        counts.push_back(maxThreads);
+    }
+    return counts;
+}
+
+// Per-thread query counters, padded to a cache line
+struct alignas(64) QueryCounters {
+    int64_t checked = 0;
+    int64_t found = 0;
+};
+
+// Prints ",<count * scale>", or just "," if the event is unavailable
+static void PrintCount(FILE *out, const SPPMPerfCounts &counts, int event,
+                       double scale) {
+    if (counts.valid[event])
+        fprintf(out, ",%f", counts.count[event] * scale);
+    else
+        fprintf(out, ",");
+}
+
+struct BenchOptions {
+    std::vector<std::string> accelNames;
+    std::vector<int> threadCounts;
+    int nTrials = 3, nWarmup = 1;
+    bool perf = false;
+    FILE *out = stdout;
+};
+
+// Benchmarks every accelerator on one set of visible points and hits
+static bool RunBench(const std::string &name, const SPPMCaptureHeader &header,
+                     const SPPMCapturePoint *points,
+                     const SPPMCaptureHit *captureHits,
+                     const BenchOptions &options) {
+    int nPoints = header.nPoints;
+    int64_t nHits = header.nHits;
+
+    // Recreate the visible points; the accelerators only look at the
+    // positions and radii
+    std::unique_ptr<SPPMPixel[]> pixels(new SPPMPixel[nPoints]);
+    std::vector<SPPMPixel *> activePixels(nPoints);
+    for (int i = 0; i < nPoints; ++i) {
+        const SPPMCapturePoint &cp = points[i];
+        pixels[i].vp.p = Point3f(cp.p[0], cp.p[1], cp.p[2]);
+        pixels[i].radius = cp.radius;
+        activePixels[i] = &pixels[i];
+    }
+    std::vector<Point3f> hits(nHits);
+    for (int64_t i = 0; i < nHits; ++i) {
+        const SPPMCaptureHit &h = captureHits[i];
+        hits[i] = Point3f(h.p[0], h.p[1], h.p[2]);
+    }
+
+    SPPMAcceleratorSettings settings;
+    settings.initialSearchRadius = header.initialSearchRadius;
+    settings.photonsPerIteration = header.photonsPerIteration;
+    settings.nIterations = header.nIterations;
+
+    typedef std::chrono::steady_clock Clock;
+    auto msSince = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start)
+            .count();
+    };
+    int64_t referenceFound = -1;
+    ParamSet params;
+    for (const std::string &accelName : options.accelNames) {
+        // Medians at the smallest thread count, for the parallel efficiency
+        double baseBuild = 0, baseQuery = 0;
+        int baseThreads = 0;
+        for (int nThreads : options.threadCounts) {
+            PbrtOptions.nThreads = nThreads;
+            ParallelInit();
+            std::unique_ptr<SPPMAccelerator> accel =
+                CreateSPPMAccelerator(accelName, params, settings);
+            if (!accel) {
+                fprintf(stderr,
+                        "sppm_accel_bench: unknown accelerator \"%s\"\n",
+                        accelName.c_str());
+                ParallelCleanup();
+                return false;
+            }
+
+            std::unique_ptr<SPPMPerfCounters> perf;
+            if (options.perf) perf.reset(new SPPMPerfCounters);
+            SPPMPerfCounts buildCounts, queryCounts, perfStart;
+
+            std::vector<double> buildMs, queryMs;
+            int64_t checked = 0, found = 0;
+            for (int trial = -options.nWarmup; trial < options.nTrials;
+                 ++trial) {
+                // Counters are taken from the last trial
+                if (perf) perfStart = perf->Read();
+                Clock::time_point start = Clock::now();
+                accel->Build(activePixels);
+                buildMs.push_back(msSince(start));
+                if (perf) buildCounts = perf->Read() - perfStart;
+
+                // Query every photon hit, a chunk of hits per task
+                std::vector<QueryCounters> counters(MaxThreadIndex());
+                const int64_t chunkSize = 4096;
+                int64_t nChunks = (nHits + chunkSize - 1) / chunkSize;
+                if (perf) perfStart = perf->Read();
+                start = Clock::now();
+                ParallelFor(
+                    [&](int64_t chunk) {
+                        QueryCounters &c = counters[ThreadIndex];
+                        auto count = [&](SPPMPixel *) { ++c.found; };
+                        int64_t end = std::min(nHits, (chunk + 1) * chunkSize);
+                        for (int64_t i = chunk * chunkSize; i < end; ++i)
+                            c.checked += accel->Query(hits[i], count);
+                    },
+                    nChunks);
+                queryMs.push_back(msSince(start));
+                if (perf) queryCounts = perf->Read() - perfStart;
+                // Warm-up passes only fill the caches and the allocator
+                if (trial < 0) {
+                    buildMs.clear();
+                    queryMs.clear();
+                }
+                checked = found = 0;
+                for (const QueryCounters &c : counters) {
+                    checked += c.checked;
+                    found += c.found;
+                }
+            }
+
+            // Every accelerator must find the same visible points
+            if (referenceFound < 0)
+                referenceFound = found;
+            else if (found != referenceFound)
+                fprintf(stderr,
+                        "sppm_accel_bench: %s: %s found %lld visible points, "
+                        "%s found %lld\n",
+                        name.c_str(), accelName.c_str(), (long long)found,
+                        options.accelNames[0].c_str(),
+                        (long long)referenceFound);
+
+            double build = Median(buildMs), query = Median(queryMs);
+            if (baseThreads == 0) {
+                baseBuild = build;
+                baseQuery = query;
+                baseThreads = nThreads;
+            }
+            auto efficiency = [&](double base, double t) {
+                return t > 0 ? base * baseThreads / (t * nThreads) : 0.;
+            };
+            double perHit = 1. / std::max<int64_t>(nHits, 1);
+            fprintf(options.out,
+                    "%s,%s,%d,%d,%lld,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%llu",
+                    name.c_str(), accelName.c_str(), nThreads, nPoints,
+                    (long long)nHits, build, Variance(buildMs),
+                    build * 1e6 / std::max(nPoints, 1), query,
+                    Variance(queryMs), query * 1e6 * perHit,
+                    efficiency(baseBuild, build), efficiency(baseQuery, query),
+                    checked * perHit, found * perHit,
+                    (unsigned long long)accel->BytesUsed());
+            if (options.perf) {
+                double perPoint = 1. / std::max(nPoints, 1);
+                for (int e = 0; e < nSPPMPerfEvents; ++e)
+                    PrintCount(options.out, buildCounts, e, perPoint);
+                for (int e = 0; e < nSPPMPerfEvents; ++e)
+                    PrintCount(options.out, queryCounts, e, perHit);
+            }
+            fprintf(options.out, "\n");
+            fflush(options.out);
+
+            perf.reset();
+            accel.reset();
+            ParallelCleanup();
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_stderrthreshold = 1; // Warning and above.
+
+    BenchOptions options;
+    std::vector<std::string> captureFiles;
+    std::string outfile;
+    std::string threads = std::to_string(NumSystemCores());
+    bool suite = false;
+    Float scale = 1;
+    for (int i = 1; i < argc; ++i) {
+        auto value = [&](const char *name) {
+            if (i + 1 == argc) usage("missing value after %s", name);
+            return argv[++i];
+        };
+        if (!strcmp(argv[i], "--accel") || !strcmp(argv[i], "-accel"))
+            options.accelNames = SplitNames(value("--accel"));
+        else if (!strcmp(argv[i], "--outfile") || !strcmp(argv[i], "-outfile"))
+            outfile = value("--outfile");
+        else if (!strcmp(argv[i], "--perf") || !strcmp(argv[i], "-perf"))
+            options.perf = true;
+        else if (!strcmp(argv[i], "--scale") || !strcmp(argv[i], "-scale"))
+            scale = atof(value("--scale"));
+        else if (!strcmp(argv[i], "--suite") || !strcmp(argv[i], "-suite"))
+            suite = true;
+        else if (!strcmp(argv[i], "--threads") || !strcmp(argv[i], "-threads"))
+            threads = value("--threads");
+        else if (!strcmp(argv[i], "--trials") || !strcmp(argv[i], "-trials"))
+            options.nTrials = atoi(value("--trials"));
+        else if (!strcmp(argv[i], "--warmup") || !strcmp(argv[i], "-warmup"))
+            options.nWarmup = atoi(value("--warmup"));
+        else if (argv[i][0] == '-')
+            usage("unknown option \"%s\"", argv[i]);
+        else
+            captureFiles.push_back(argv[i]);
+    }
+    if (captureFiles.empty() == !suite)
+        usage("specify either capture files or --suite");
+    options.threadCounts = ParseThreadCounts(threads);
+    if (options.threadCounts.empty() || options.threadCounts[0] < 1 ||
+        options.nTrials < 1 || scale <= 0)
+        usage("--threads, --trials and --scale must be positive");
+    if (options.nWarmup < 0) usage("--warmup must not be negative");
+    if (options.accelNames.empty())
+        options.accelNames = SPPMAcceleratorNames();
+
+    if (!outfile.empty()) {
+        options.out = fopen(outfile.c_str(), "w");
+        if (!options.out) {
+            fprintf(stderr, "%s: %s\n", outfile.c_str(), strerror(errno));
+            return 1;
+        }
+    }
+    fprintf(options.out,
+            "data,accelerator,threads,points,hits,build_ms,build_ms_var,"
+            "build_ns_per_point,query_ms,query_ms_var,query_ns_per_hit,"
+            "build_efficiency,query_efficiency,points_checked_per_query,"
+            "found_per_query,bytes");
+    if (options.perf) {
+        for (const char *phase : {"build", "query"})
+            for (int e = 0; e < nSPPMPerfEvents; ++e)
+                fprintf(options.out, ",%s_%s_per_%s", phase,
+                        SPPMPerfEventName(e),
+                        strcmp(phase, "build") ? "hit" : "point");
+    }
+    fprintf(options.out, "\n");
+
+    bool ok = true;
+    for (const std::string &filename : captureFiles) {
+        SPPMCapture capture;
+        if (!capture.Open(filename)) return 1;
+        ok = ok && RunBench(filename, capture.Header(), capture.Points(),
+                            capture.Hits(), options);
+    }
+    if (suite) {
+        for (const SPPMSyntheticCase &c : SPPMSyntheticSuite(scale)) {
+            std::vector<SPPMCapturePoint> points;
+            std::vector<SPPMCaptureHit> hits;
+            ParallelInit();
+            SPPMCaptureHeader header =
+                GenerateSPPMSynthetic(c.params, &points, &hits);
+            ParallelCleanup();
+            ok = ok && RunBench(c.name, header, points.data(), hits.data(),
+                                options);
+        }
+    }
+    if (options.out != stdout) fclose(options.out);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+//
+// sppm_capture_gen.cpp
+//
+// Writes synthetic SPPM visible point and photon hit sets in the format of
+// pbrt --sppmcapture, for replaying with sppm_accel_bench.
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "SPPM_Integrators/SPPM_Capture.h"
+#include "SPPM_Integrators/SPPM_Synthetic.h"
+#include "parallel.h"
+#include "pbrt.h"
+#include <glog/logging.h>
+
+using namespace pbrt;
+
+static void usage(const char *msg = nullptr, ...) {
+    if (msg) {
+        va_list args;
+        va_start(args, msg);
+        fprintf(stderr, "sppm_capture_gen: ");
+        vfprintf(stderr, msg, args);
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, R"(usage: sppm_capture_gen [options] --outfile <capture file>
+       sppm_capture_gen --suite <directory> [--scale <s>]
+
+options:
+    --clusters <n>     Number of clusters for "clusters". Default: 32
+    --dist <name>      Point layout: uniform, planar, clusters, radiusvar or
+                       surfaces. Default: surfaces
+    --hits <n>         Number of photon hits. Default: 1000000
+    --missfraction <f> Fraction of hits placed anywhere in the box instead
+                       of on the points' surfaces. Default: 0.1
+    --points <n>       Number of visible points. Default: 1000000
+    --radius <r>       Search radius. Default: twice the point spacing
+    --radiusratio <r>  Largest to smallest radius for "radiusvar".
+                       Default: 1000
+    --seed <n>         Random seed. Default: 0
+    --thickness <t>    Slab thickness for "planar", relative to the box.
+                       Default: 0
+
+    --suite <dir>      Write every distribution of sppm_accel_bench --suite
+                       to <dir>/<name>.sppmcap.
+    --scale <s>        Scale the suite's point and hit counts. Default: 1
+)");
+    exit(1);
+}
+
+static bool Write(const std::string &filename,
+                  const SPPMSyntheticParams &params) {
+    std::vector<SPPMCapturePoint> points;
+    std::vector<SPPMCaptureHit> hits;
+    SPPMCaptureHeader header = GenerateSPPMSynthetic(params, &points, &hits);
+    if (!WriteSPPMCapture(filename, header, points, hits)) return false;
+    fprintf(stderr, "%s: %lld points, %lld hits, radius %f\n",
+            filename.c_str(), (long long)points.size(),
+            (long long)hits.size(), header.initialSearchRadius);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_stderrthreshold = 1; // Warning and above.
+
+    SPPMSyntheticParams params;
+    std::string outfile, suiteDir;
+    Float scale = 1;
+    for (int i = 1; i < argc; ++i) {
+        auto value = [&](const char *name) {
+            if (i + 1 == argc) usage("missing value after %s", name);
+            return argv[++i];
+        };
+        if (!strcmp(argv[i], "--clusters"))
+            params.nClusters = atoi(value("--clusters"));
+        else if (!strcmp(argv[i], "--dist")) {
+            const char *name = value("--dist");
+            if (!ParseSPPMSyntheticDistribution(name, &params.distribution))
+                usage("unknown distribution \"%s\"", name);
+        } else if (!strcmp(argv[i], "--hits"))
+            params.nHits = atoll(value("--hits"));
+        else if (!strcmp(argv[i], "--missfraction"))
+            params.missFraction = atof(value("--missfraction"));
+        else if (!strcmp(argv[i], "--outfile"))
+            outfile = value("--outfile");
+        else if (!strcmp(argv[i], "--points"))
+            params.nPoints = atoll(value("--points"));
+        else if (!strcmp(argv[i], "--radius"))
+            params.radius = atof(value("--radius"));
+        else if (!strcmp(argv[i], "--radiusratio"))
+            params.radiusRatio = atof(value("--radiusratio"));
+        else if (!strcmp(argv[i], "--scale"))
+            scale = atof(value("--scale"));
+        else if (!strcmp(argv[i], "--seed"))
+            params.seed = strtoull(value("--seed"), nullptr, 10);
+        else if (!strcmp(argv[i], "--suite"))
+            suiteDir = value("--suite");
+        else if (!strcmp(argv[i], "--thickness"))
+            params.thickness = atof(value("--thickness"));
+        else
+            usage("unknown option \"%s\"", argv[i]);
+    }
+    if (outfile.empty() == suiteDir.empty())
+        usage("specify exactly one of --outfile and --suite");
+    if (params.nPoints < 0 || params.nHits < 0 || scale <= 0)
+        usage("counts and scale must be positive");
+
+    ParallelInit();
+    bool ok = true;
+    if (!suiteDir.empty()) {
+        for (const SPPMSyntheticCase &c : SPPMSyntheticSuite(scale))
+            ok &= Write(suiteDir + "/" + c.name + ".sppmcap", c.params);
+    } else
+        ok = Write(outfile, params);
+    ParallelCleanup();
+    return ok ? 0 : 1;
+}
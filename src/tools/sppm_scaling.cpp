@@ -0,0 +1,265 @@
+//
+// sppm_scaling.cpp
+//
+// Strong-scaling benchmark of the SPPM integrators on a scene. Renders the
+// scene with each integrator at a sequence of thread counts, after
+// untimed warm-up renders, and writes one CSV row per integrator and
+// thread count: the median and variance of the accelerator build, photon
+// pass and total render times over the trials, and the parallel
+// efficiency of each relative to the smallest thread count.
+//
+// With --numa, every thread count is also run with the threads pinned to
+// cores and the accelerator copied to each NUMA node (pbrt --sppmnuma);
+// the "numa" column tells the two apart, and each is compared with its own
+// smallest thread count.
+//
+// The build and photon pass times come from the integrator's
+// --sppmtelemetry records, summed over the iterations of a render.
+// sppm_accel_bench measures the same for a replayed capture.
+//
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "SPPM_Integrators/accelerator.h"
+#include "api.h"
+#include "parallel.h"
+#include "pbrt.h"
+#include <glog/logging.h>
+
+using namespace pbrt;
+
+static void usage(const char *msg = nullptr, ...) {
+    if (msg) {
+        va_list args;
+        va_start(args, msg);
+        fprintf(stderr, "sppm_scaling: ");
+        vfprintf(stderr, msg, args);
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, R"(usage: sppm_scaling [options] <filename.pbrt>
+
+options:
+    --integrators <a,b,...> SPPM integrators to benchmark; the scene's
+                       integrator parameters are kept. Default: every
+                       "<accelerator>_sppm" integrator.
+    --numa             Also run each thread count with NUMA placement.
+    --outfile <name>   Write the CSV to the given file. Default: stdout.
+    --threads <n>      Largest thread count; runs 1, 2, 4, ... up to <n>.
+                       A list such as 1,6,12,24 runs exactly those counts.
+                       Default: the number of cores.
+    --trials <n>       Timed renders per measurement. Default: 3
+    --warmup <n>       Untimed renders before the trials. Default: 1
+)");
+    exit(1);
+}
+
+static std::vector<std::string> SplitNames(const std::string &list) {
+    std::vector<std::string> names;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        if (end > start) names.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+    return names;
+}
+
+static double Median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return (n & 1) ? v[n / 2] : .5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+// Sample variance; zero for a single trial
+static double Variance(const std::vector<double> &v) {
+    if (v.size() < 2) return 0;
+    double mean = 0, var = 0;
+    for (double x : v) mean += x;
+    mean /= v.size();
+    for (double x : v) var += (x - mean) * (x - mean);
+    return var / (v.size() - 1);
+}
+
+// "n" runs 1, 2, 4, ... up to n; "a,b,c" runs exactly those thread counts
+static std::vector<int> ParseThreadCounts(const std::string &arg) {
+    std::vector<int> counts;
+    if (arg.find(',') != std::string::npos) {
+        for (const std::string &n : SplitNames(arg))
+            counts.push_back(atoi(n.c_str()));
+        std::sort(counts.begin(), counts.end());
+        counts.erase(std::unique(counts.begin(), counts.end()),
+                     counts.end());
+    } else {
+        int maxThreads = atoi(arg.c_str());
+        for (int t = 1; t < maxThreads; t *= 2) counts.push_back(t);
+        counts.push_back(maxThreads);
+    }
+    return counts;
+}
+
+// Sums the build and photon pass columns of a telemetry CSV file, in
+// milliseconds. Returns false if the file has no records.
+static bool ReadTelemetry(const std::string &filename, double *buildMs,
+                          double *photonMs) {
+    std::ifstream in(filename);
+    std::string line;
+    if (!std::getline(in, line)) return false;
+    std::vector<std::string> header = SplitNames(line);
+    auto column = [&](const char *name) {
+        return size_t(std::find(header.begin(), header.end(), name) -
+                      header.begin());
+    };
+    size_t build = column("build"), photon = column("photonPass");
+    if (build >= header.size() || photon >= header.size()) return false;
+    *buildMs = *photonMs = 0;
+    int nRecords = 0;
+    while (std::getline(in, line)) {
+        // Empty fields are dropped, but they only occur in the hardware
+        // counter columns, after the timings
+        std::vector<std::string> fields = SplitNames(line);
+        if (fields.size() <= std::max(build, photon)) continue;
+        *buildMs += atof(fields[build].c_str()) * 1000;
+        *photonMs += atof(fields[photon].c_str()) * 1000;
+        ++nRecords;
+    }
+    return nRecords > 0;
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_stderrthreshold = 1; // Warning and above.
+
+    std::vector<std::string> integrators;
+    std::string sceneFile, outfile;
+    std::string threads = std::to_string(NumSystemCores());
+    int nTrials = 3, nWarmup = 1;
+    bool numa = false;
+    for (int i = 1; i < argc; ++i) {
+        auto value = [&](const char *name) {
+            if (i + 1 == argc) usage("missing value after %s", name);
+            return argv[++i];
+        };
+        if (!strcmp(argv[i], "--integrators") ||
+            !strcmp(argv[i], "-integrators"))
+            integrators = SplitNames(value("--integrators"));
+        else if (!strcmp(argv[i], "--numa") || !strcmp(argv[i], "-numa"))
+            numa = true;
+        else if (!strcmp(argv[i], "--outfile") || !strcmp(argv[i], "-outfile"))
+            outfile = value("--outfile");
+        else if (!strcmp(argv[i], "--threads") || !strcmp(argv[i], "-threads"))
+            threads = value("--threads");
+        else if (!strcmp(argv[i], "--trials") || !strcmp(argv[i], "-trials"))
+            nTrials = atoi(value("--trials"));
+        else if (!strcmp(argv[i], "--warmup") || !strcmp(argv[i], "-warmup"))
+            nWarmup = atoi(value("--warmup"));
+        else if (argv[i][0] == '-')
+            usage("unknown option \"%s\"", argv[i]);
+        else if (sceneFile.empty())
+            sceneFile = argv[i];
+        else
+            usage("only one scene file may be given");
+    }
+    if (sceneFile.empty()) usage("no scene file given");
+    std::vector<int> threadCounts = ParseThreadCounts(threads);
+    if (threadCounts.empty() || threadCounts[0] < 1 || nTrials < 1)
+        usage("--threads and --trials must be positive");
+    if (nWarmup < 0) usage("--warmup must not be negative");
+    if (integrators.empty())
+        for (const std::string &name : SPPMAcceleratorNames())
+            integrators.push_back(name + "_sppm");
+
+    FILE *out = stdout;
+    if (!outfile.empty()) {
+        out = fopen(outfile.c_str(), "w");
+        if (!out) {
+            fprintf(stderr, "%s: %s\n", outfile.c_str(), strerror(errno));
+            return 1;
+        }
+    }
+    fprintf(out,
+            "scene,integrator,threads,numa,build_ms,build_ms_var,photon_ms,"
+            "photon_ms_var,render_ms,render_ms_var,build_efficiency,"
+            "photon_efficiency,render_efficiency\n");
+
+    // The renders go to scratch files that are removed at the end
+    const std::string telemetryFile = "sppm_scaling_telemetry.csv";
+    const std::string imageFile = "sppm_scaling_image.pfm";
+    typedef std::chrono::steady_clock Clock;
+    bool ok = true;
+    for (const std::string &integrator : integrators) {
+        // Medians at the smallest thread count, for the parallel efficiency,
+        // without and with NUMA placement
+        double base[2][3] = {{0, 0, 0}, {0, 0, 0}};
+        int baseThreads[2] = {0, 0};
+        bool failed = false;
+        for (size_t t = 0; t < threadCounts.size() * (numa ? 2 : 1) &&
+                           !failed;
+             ++t) {
+            int nThreads = threadCounts[t / (numa ? 2 : 1)];
+            int placed = numa ? t % 2 : 0;
+            std::vector<double> times[3];
+            for (int trial = -nWarmup; trial < nTrials && !failed; ++trial) {
+                Options options;
+                options.nThreads = nThreads;
+                options.quiet = true;
+                options.imageFile = imageFile;
+                options.integratorName = integrator;
+                options.sppmTelemetryFile = telemetryFile;
+                options.pinThreads = options.sppmNumaReplicas = placed;
+                remove(telemetryFile.c_str());
+
+                Clock::time_point start = Clock::now();
+                pbrtInit(options);
+                pbrtParseFile(sceneFile);
+                pbrtCleanup();
+                double renderMs = std::chrono::duration<double, std::milli>(
+                                      Clock::now() - start)
+                                      .count();
+
+                double buildMs, photonMs;
+                if (!ReadTelemetry(telemetryFile, &buildMs, &photonMs)) {
+                    fprintf(stderr,
+                            "sppm_scaling: %s didn't render %s as SPPM\n",
+                            integrator.c_str(), sceneFile.c_str());
+                    failed = ok = false;
+                } else if (trial >= 0) {
+                    times[0].push_back(buildMs);
+                    times[1].push_back(photonMs);
+                    times[2].push_back(renderMs);
+                }
+            }
+            if (failed) break;
+
+            double median[3];
+            for (int i = 0; i < 3; ++i) median[i] = Median(times[i]);
+            if (baseThreads[placed] == 0) {
+                for (int i = 0; i < 3; ++i) base[placed][i] = median[i];
+                baseThreads[placed] = nThreads;
+            }
+            fprintf(out, "%s,%s,%d,%d", sceneFile.c_str(), integrator.c_str(),
+                    nThreads, placed);
+            for (int i = 0; i < 3; ++i)
+                fprintf(out, ",%f,%f", median[i], Variance(times[i]));
+            for (int i = 0; i < 3; ++i)
+                fprintf(out, ",%f",
+                        median[i] > 0 ? base[placed][i] * baseThreads[placed] /
+                                            (median[i] * nThreads)
+                                      : 0.);
+            fprintf(out, "\n");
+            fflush(out);
+        }
+    }
+    remove(telemetryFile.c_str());
+    remove(imageFile.c_str());
+    if (out != stdout) fclose(out);
+    return ok ? 0 : 1;
+}
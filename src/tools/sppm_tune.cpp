@@ -0,0 +1,290 @@
+//
+// sppm_tune.cpp
+//
+// Searches the build parameters of the SPPM accelerators for the fastest
+// settings on one or more SPPM iterations captured with pbrt
+// --sppmcapture (typically an early iteration, --sppmcaptureiter 0), and
+// writes them to the scene's sidecar file, which later accelerated SPPM
+// renders of the scene pick up.
+//
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "SPPM_Integrators/SPPM_Capture.h"
+#include "SPPM_Integrators/SPPM_Pixel.h"
+#include "SPPM_Integrators/SPPM_Tuning.h"
+#include "SPPM_Integrators/accelerator.h"
+#include "parallel.h"
+#include "paramset.h"
+#include "pbrt.h"
+#include <glog/logging.h>
+
+using namespace pbrt;
+
+static void usage(const char *msg = nullptr, ...) {
+    if (msg) {
+        va_list args;
+        va_start(args, msg);
+        fprintf(stderr, "sppm_tune: ");
+        vfprintf(stderr, msg, args);
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, R"(usage: sppm_tune [options] --scene <scene> <capture files...>
+
+options:
+    --accel <a,b,...>  Accelerators to tune. Default: all that have tunable
+                       parameters.
+    --outfile <name>   Write the settings to the given file. Default: the
+                       scene's sidecar, <scene>.sppmtune. Settings
+                       already in the file for other accelerators are kept.
+    --rounds <n>       Passes over the parameters; the search stops early
+                       once a pass changes nothing. Default: 2
+    --scene <name>     Scene file the captures were taken from.
+    --threads <n>      Threads to build and query with. Default: the number
+                       of cores.
+    --trials <n>       Builds and query passes per setting; the median is
+                       compared. Default: 3
+)");
+    exit(1);
+}
+
+static std::vector<std::string> SplitNames(const std::string &list) {
+    std::vector<std::string> names;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        if (end > start) names.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+    return names;
+}
+
+static double Median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return (n & 1) ? v[n / 2] : .5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+// A captured iteration, with the visible points recreated as pixels
+struct TuneData {
+    std::unique_ptr<SPPMPixel[]> pixels;
+    std::vector<SPPMPixel *> activePixels;
+    std::vector<Point3f> hits;
+    SPPMAcceleratorSettings settings;
+};
+
+static bool LoadCapture(const std::string &filename, TuneData *data) {
+    SPPMCapture capture;
+    if (!capture.Open(filename)) return false;
+    const SPPMCaptureHeader &header = capture.Header();
+    int nPoints = header.nPoints;
+    // The accelerators only look at the positions and radii
+    data->pixels.reset(new SPPMPixel[nPoints]);
+    data->activePixels.resize(nPoints);
+    for (int i = 0; i < nPoints; ++i) {
+        const SPPMCapturePoint &cp = capture.Points()[i];
+        data->pixels[i].vp.p = Point3f(cp.p[0], cp.p[1], cp.p[2]);
+        data->pixels[i].radius = cp.radius;
+        data->activePixels[i] = &data->pixels[i];
+    }
+    data->hits.resize(header.nHits);
+    for (uint64_t i = 0; i < header.nHits; ++i) {
+        const SPPMCaptureHit &h = capture.Hits()[i];
+        data->hits[i] = Point3f(h.p[0], h.p[1], h.p[2]);
+    }
+    data->settings.initialSearchRadius = header.initialSearchRadius;
+    data->settings.photonsPerIteration = header.photonsPerIteration;
+    data->settings.nIterations = header.nIterations;
+    return true;
+}
+
+static ParamSet MakeParams(const std::vector<SPPMTunableParam> &tunables,
+                           const std::vector<Float> &values) {
+    ParamSet params;
+    for (size_t i = 0; i < tunables.size(); ++i) {
+        if (tunables[i].isInt) {
+            std::unique_ptr<int[]> v(new int[1]);
+            v[0] = (int)values[i];
+            params.AddInt(tunables[i].name, std::move(v), 1);
+        } else {
+            std::unique_ptr<Float[]> v(new Float[1]);
+            v[0] = values[i];
+            params.AddFloat(tunables[i].name, std::move(v), 1);
+        }
+    }
+    return params;
+}
+
+// Milliseconds to build _accelName_ with _values_ and query every hit,
+// summed over the captures: the median of _nTrials_ after one warm-up pass
+static double Measure(const std::string &accelName,
+                      const std::vector<SPPMTunableParam> &tunables,
+                      const std::vector<Float> &values,
+                      const std::vector<TuneData> &data, int nTrials) {
+    typedef std::chrono::steady_clock Clock;
+    ParamSet params = MakeParams(tunables, values);
+    double total = 0;
+    for (const TuneData &d : data) {
+        std::unique_ptr<SPPMAccelerator> accel =
+            CreateSPPMAccelerator(accelName, params, d.settings);
+        if (!accel) return Infinity;
+        int64_t nHits = d.hits.size();
+        std::vector<double> ms;
+        for (int trial = -1; trial < nTrials; ++trial) {
+            Clock::time_point start = Clock::now();
+            accel->Build(d.activePixels);
+            // Query every photon hit, a chunk of hits per task
+            const int64_t chunkSize = 4096;
+            ParallelFor(
+                [&](int64_t chunk) {
+                    auto found = [](SPPMPixel *) {};
+                    int64_t end = std::min(nHits, (chunk + 1) * chunkSize);
+                    for (int64_t i = chunk * chunkSize; i < end; ++i)
+                        accel->Query(d.hits[i], found);
+                },
+                (nHits + chunkSize - 1) / chunkSize);
+            if (trial >= 0)
+                ms.push_back(std::chrono::duration<double, std::milli>(
+                                 Clock::now() - start)
+                                 .count());
+        }
+        total += Median(ms);
+    }
+    return total;
+}
+
+static std::string Describe(const std::vector<SPPMTunableParam> &tunables,
+                            const std::vector<Float> &values) {
+    std::string s;
+    for (size_t i = 0; i < tunables.size(); ++i) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s%s %g", i > 0 ? ", " : "",
+                 tunables[i].name, (double)values[i]);
+        s += buf;
+    }
+    return s;
+}
+
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_stderrthreshold = 1; // Warning and above.
+
+    std::vector<std::string> accelNames, captureFiles;
+    std::string outfile, scene;
+    int nRounds = 2, nThreads = 0, nTrials = 3;
+    for (int i = 1; i < argc; ++i) {
+        auto value = [&](const char *name) {
+            if (i + 1 == argc) usage("missing value after %s", name);
+            return argv[++i];
+        };
+        if (!strcmp(argv[i], "--accel") || !strcmp(argv[i], "-accel"))
+            accelNames = SplitNames(value("--accel"));
+        else if (!strcmp(argv[i], "--outfile") || !strcmp(argv[i], "-outfile"))
+            outfile = value("--outfile");
+        else if (!strcmp(argv[i], "--rounds") || !strcmp(argv[i], "-rounds"))
+            nRounds = atoi(value("--rounds"));
+        else if (!strcmp(argv[i], "--scene") || !strcmp(argv[i], "-scene"))
+            scene = value("--scene");
+        else if (!strcmp(argv[i], "--threads") || !strcmp(argv[i], "-threads"))
+            nThreads = atoi(value("--threads"));
+        else if (!strcmp(argv[i], "--trials") || !strcmp(argv[i], "-trials"))
+            nTrials = atoi(value("--trials"));
+        else if (argv[i][0] == '-')
+            usage("unknown option \"%s\"", argv[i]);
+        else
+            captureFiles.push_back(argv[i]);
+    }
+    if (captureFiles.empty()) usage("no capture files given");
+    if (scene.empty() && outfile.empty())
+        usage("specify the scene with --scene, or an --outfile");
+    if (nRounds < 1 || nTrials < 1 || nThreads < 0)
+        usage("--rounds and --trials must be positive");
+    if (outfile.empty()) outfile = SPPMTuningFilename(scene);
+    if (accelNames.empty()) {
+        for (const std::string &name : SPPMAcceleratorNames())
+            if (!SPPMAcceleratorTunables(name).empty())
+                accelNames.push_back(name);
+    }
+
+    std::vector<TuneData> data(captureFiles.size());
+    for (size_t i = 0; i < captureFiles.size(); ++i)
+        if (!LoadCapture(captureFiles[i], &data[i])) return 1;
+
+    PbrtOptions.nThreads = nThreads;
+    ParallelInit();
+    std::vector<SPPMTunedParam> tuned;
+    for (const std::string &accelName : accelNames) {
+        const std::vector<SPPMTunableParam> &tunables =
+            SPPMAcceleratorTunables(accelName);
+        if (tunables.empty()) {
+            fprintf(stderr,
+                    "sppm_tune: \"%s\" has no tunable parameters; skipping\n",
+                    accelName.c_str());
+            continue;
+        }
+
+        // Coordinate descent from the defaults: try every value of one
+        // parameter with the others fixed, keep the fastest, and move on.
+        // A value must beat the best time by 2% to count, so that timing
+        // noise doesn't move the settings away from the defaults.
+        std::vector<Float> best;
+        for (const SPPMTunableParam &t : tunables)
+            best.push_back(t.defaultValue);
+        double defaultMs = Measure(accelName, tunables, best, data, nTrials);
+        if (defaultMs == Infinity) {
+            fprintf(stderr, "sppm_tune: unknown accelerator \"%s\"\n",
+                    accelName.c_str());
+            ParallelCleanup();
+            return 1;
+        }
+        double bestMs = defaultMs;
+        for (int round = 0; round < nRounds; ++round) {
+            bool changed = false;
+            for (size_t p = 0; p < tunables.size(); ++p) {
+                for (Float v : tunables[p].values) {
+                    if (v == best[p]) continue;
+                    std::vector<Float> values = best;
+                    values[p] = v;
+                    double ms =
+                        Measure(accelName, tunables, values, data, nTrials);
+                    if (ms < .98 * bestMs) {
+                        best = values;
+                        bestMs = ms;
+                        changed = true;
+                    }
+                }
+            }
+            if (!changed) break;
+        }
+        printf("%s: %.3f ms with the defaults, %.3f ms with %s\n",
+               accelName.c_str(), defaultMs, bestMs,
+               Describe(tunables, best).c_str());
+        for (size_t p = 0; p < tunables.size(); ++p)
+            tuned.push_back(
+                {accelName, tunables[p].name, tunables[p].isInt, best[p]});
+    }
+    ParallelCleanup();
+
+    // Keep the settings of the accelerators that weren't tuned this time
+    std::vector<SPPMTunedParam> previous, merged;
+    ReadSPPMTuning(outfile, &previous);
+    for (const SPPMTunedParam &p : previous)
+        if (std::find(accelNames.begin(), accelNames.end(), p.accelerator) ==
+            accelNames.end())
+            merged.push_back(p);
+    merged.insert(merged.end(), tuned.begin(), tuned.end());
+
+    std::string comment = "SPPM accelerator settings written by sppm_tune "
+                          "from";
+    for (const std::string &f : captureFiles) comment += " " + f;
+    return WriteSPPMTuning(outfile, comment, merged) ? 0 : 1;
+}